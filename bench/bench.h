@@ -0,0 +1,38 @@
+#pragma once
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef countof
+#define countof(arr)    (sizeof(arr) / sizeof(arr[0]))
+#endif
+
+/* Mem alloc for benchmarks (never fails) */
+
+static inline void * xmalloc(size_t size) {
+  void * p = malloc(size);
+  if (p == 0) {
+    fputs("Out of memory\n", stderr);
+    abort();
+  }
+  return p;
+}
+
+static inline void xfree(void * p) {
+  free(p);
+}
+
+/* Timing */
+
+static inline double bench_now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+#define BENCH_STARTED()             fputs("\nStarting benchmarks from " __FILE__ " ...\n\n", stdout)
+#define BENCH_REPORT(name, ms)      fprintf(stdout, "%-48s %12.3f ms\n", (name), (ms))
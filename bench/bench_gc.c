@@ -0,0 +1,493 @@
+#include "bench.h"
+#include "mem.h"
+
+static void oom_abort(struct silc_mem_init_t* mem_init) {
+  fputs(";; " __FILE__ " - out of memory, aborting...\n", stderr);
+  abort();
+}
+
+static struct silc_mem_init_t g_mem_init = {
+  .context = NULL,
+  .init_memory_size = 8 * 1024 * 1024,
+  .max_memory_size = 8 * 1024 * 1024,
+  .init_root_vector_size = 10,
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+/**
+ * Allocates count dead conses interleaved with count live conses, the live ones are referenced from a rooted vector.
+ * Returns duration of the garbage collection, that follows the allocation.
+ */
+static double gc_interleaved_conses(int count) {
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &g_mem_init);
+
+  silc_obj vec = silc_int_mem_alloc(m, count, NULL, SILC_TYPE_OREF, 100);
+  silc_int_mem_add_root(m, vec);
+
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* garbage */
+    silc_obj o = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    silc_get_oref(m, vec, NULL)[i] = o;
+  }
+
+  double start = bench_now_ms();
+  silc_int_mem_gc(m);
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates count dead conses on top of the small live set.
+ * Returns duration of the garbage collection, that follows the allocation.
+ */
+static double gc_dead_conses(int count) {
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &g_mem_init);
+
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  }
+
+  double start = bench_now_ms();
+  silc_int_mem_gc(m);
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates old live set of count conses, then young garbage with a few survivors.
+ * Returns duration of the minor (or full) garbage collection, that follows the allocation.
+ */
+static double gc_young_garbage(int count, int minor) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.nursery_size = init.init_memory_size;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  silc_obj vec = silc_int_mem_alloc(m, count, NULL, SILC_TYPE_OREF, 100);
+  silc_int_mem_add_root(m, vec);
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    silc_get_oref(m, vec, NULL)[i] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  }
+  silc_int_mem_minor_gc(m); /* promote live set */
+
+  for (int i = 0; i < 100000; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    silc_obj o = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    if (i % 1000 == 0) {
+      silc_get_oref(m, vec, NULL)[i % count] = o;
+      silc_int_mem_write_barrier(m, vec, o);
+    }
+  }
+
+  double start = bench_now_ms();
+  if (minor) {
+    silc_int_mem_minor_gc(m);
+  } else {
+    silc_int_mem_gc(m);
+  }
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates live set of count conses, then churns through garbage conses.
+ * Returns the longest allocation pause, incremental collection is enabled if slice budget is positive.
+ */
+static double gc_max_pause(int count, int gc_slice_budget) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.gc_slice_budget = gc_slice_budget;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  silc_obj vec = silc_int_mem_alloc(m, count, NULL, SILC_TYPE_OREF, 100);
+  silc_int_mem_add_root(m, vec);
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    silc_get_oref(m, vec, NULL)[i] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  }
+
+  double result = 0;
+  for (int i = 0; i < 4000000; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    double start = bench_now_ms();
+    silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    double pause = bench_now_ms() - start;
+    if (pause > result) {
+      result = pause;
+    }
+  }
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates dead conses interleaved with live byte buffers of the given size, so that compaction has to move them.
+ * Returns duration of the garbage collection, that follows the allocation.
+ */
+static double gc_live_buffers(int buf_size, int large_object_size) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.init_memory_size = init.max_memory_size = 64 * 1024 * 1024;
+  init.large_object_size = large_object_size;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  const int count = 16;
+  silc_obj vec = silc_int_mem_alloc(m, count, NULL, SILC_TYPE_OREF, 100);
+  silc_int_mem_add_root(m, vec);
+  for (int i = 0; i < count; ++i) {
+    silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* garbage */
+    silc_obj o = silc_int_mem_alloc(m, buf_size, NULL, SILC_TYPE_BREF, 101);
+    silc_get_oref(m, vec, NULL)[i] = o;
+  }
+
+  double start = bench_now_ms();
+  silc_int_mem_gc(m);
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates count dead object references interleaved with count live ones, the live ones make a list.
+ * Returns duration of the garbage collection, that follows the allocation.
+ */
+static double gc_interleaved_orefs(int count) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.init_memory_size = init.max_memory_size = 32 * 1024 * 1024;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  silc_obj holder = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 100);
+  silc_int_mem_add_root(m, holder);
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), silc_get_oref(m, holder, NULL)[0] };
+    silc_int_mem_alloc(m, 2, a, SILC_TYPE_OREF, 101); /* garbage */
+    silc_get_oref(m, holder, NULL)[0] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_OREF, 101);
+  }
+
+  double start = bench_now_ms();
+  silc_int_mem_gc(m);
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates list of count object references interleaved with garbage, collects garbage and walks the list
+ * the given number of times. Returns duration of the walks, i.e. cost of the object reference dereference.
+ */
+static double traverse_oref_list(int count, int rounds) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.init_memory_size = init.max_memory_size = 32 * 1024 * 1024;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  silc_obj holder = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 100);
+  silc_int_mem_add_root(m, holder);
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), silc_get_oref(m, holder, NULL)[0] };
+    silc_int_mem_alloc(m, 2, a, SILC_TYPE_OREF, 101); /* garbage */
+    silc_get_oref(m, holder, NULL)[0] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_OREF, 101);
+  }
+  silc_int_mem_gc(m);
+
+  double start = bench_now_ms();
+  long long sum = 0;
+  for (int r = 0; r < rounds; ++r) {
+    for (silc_obj it = silc_get_oref(m, holder, NULL)[0]; it != SILC_OBJ_NIL;) {
+      silc_obj* t = silc_int_mem_get_ref(m, it, NULL, NULL);
+      sum += silc_obj_to_int(t[0]);
+      it = t[1];
+    }
+  }
+  double result = bench_now_ms() - start;
+
+  if (sum != (long long) rounds * count * (count - 1) / 2) {
+    fputs(";; " __FILE__ " - list is corrupted\n", stderr);
+    abort();
+  }
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates count short-lived conses in the heap with the given nursery size.
+ * Returns duration of the allocation, including garbage collections it triggers.
+ */
+static double alloc_conses(int count, int nursery_size) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.nursery_size = nursery_size;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  double start = bench_now_ms();
+  silc_obj list = SILC_OBJ_NIL;
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), (i % 16) ? list : SILC_OBJ_NIL };
+    list = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  }
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates count short-lived three-element vectors, every 100th of them is kept in the ring of 1000 live vectors,
+ * so that the live set stays small. Returns duration of the allocation, including garbage collections it triggers.
+ */
+static double alloc_orefs(int count) {
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &g_mem_init);
+
+  const int ring_size = 1000;
+  silc_obj ring = silc_int_mem_alloc(m, ring_size, NULL, SILC_TYPE_OREF, 100);
+  silc_int_mem_add_root(m, ring);
+
+  double start = bench_now_ms();
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL, SILC_OBJ_NIL };
+    silc_obj o = silc_int_mem_alloc(m, 3, a, SILC_TYPE_OREF, 101);
+    if (i % 100 == 0) {
+      silc_get_oref(m, ring, NULL)[(i / 100) % ring_size] = o;
+    }
+  }
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Processes count requests, each of them builds a temporary list of 1000 conses, that becomes garbage once
+ * the request is done. Returns duration of the processing, requests are run in the allocation regions if use_regions
+ * is set and in the heap with the given nursery size otherwise.
+ */
+static double alloc_requests(int count, int use_regions, int nursery_size) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.nursery_size = nursery_size;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  double start = bench_now_ms();
+  for (int i = 0; i < count; ++i) {
+    struct silc_region_t region;
+    if (use_regions) {
+      silc_int_mem_begin_region(m, &region);
+    }
+
+    silc_obj list = SILC_OBJ_NIL;
+    for (int j = 0; j < 1000; ++j) {
+      silc_obj a[] = { silc_int_to_obj(j), list };
+      list = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    }
+
+    if (use_regions) {
+      silc_int_mem_end_region(m, &region);
+    }
+  }
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Processes 10000 requests of 1000 garbage conses on top of count live conses. Returns the longest request,
+ * collection is triggered by the allocations that reach the target occupancy, unless hint collects garbage
+ * in advance between the requests, if use_hint is set.
+ */
+static double max_request_time(int count, int use_hint) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.gc_target_occupancy = 50;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  silc_obj vec = silc_int_mem_alloc(m, count, NULL, SILC_TYPE_OREF, 100);
+  silc_int_mem_add_root(m, vec);
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    silc_get_oref(m, vec, NULL)[i] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  }
+
+  double result = 0;
+  for (int i = 0; i < 10000; ++i) {
+    if (use_hint) {
+      silc_int_mem_gc_hint(m);
+    }
+
+    double start = bench_now_ms();
+    silc_obj list = SILC_OBJ_NIL;
+    for (int j = 0; j < 1000; ++j) {
+      silc_obj a[] = { silc_int_to_obj(j), list };
+      list = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    }
+    double duration = bench_now_ms() - start;
+    if (duration > result) {
+      result = duration;
+    }
+  }
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+/**
+ * Allocates count live two-element vectors in the heap, that starts at 1M and grows up to 256M, heap buffer is
+ * allocated by malloc or reserved by anonymous mmap if mmap_heap is set. Returns duration of the allocation,
+ * including garbage collections and heap resizes it triggers.
+ */
+static double alloc_growing_heap(int count, int mmap_heap) {
+  struct silc_mem_init_t init = g_mem_init;
+  init.init_memory_size = 1024 * 1024;
+  init.max_memory_size = 256 * 1024 * 1024;
+  init.mmap_heap = mmap_heap;
+
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  silc_obj holder = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 0);
+  silc_int_mem_add_root(m, holder);
+
+  double start = bench_now_ms();
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), silc_get_oref(m, holder, NULL)[0] };
+    silc_obj vec = silc_int_mem_alloc(m, 2, a, SILC_TYPE_OREF, 0);
+    silc_get_oref(m, holder, NULL)[0] = vec;
+  }
+  double result = bench_now_ms() - start;
+
+  silc_int_mem_free(m);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  /* all the benchmarks share the heap settings, so that they measure the selected collection strategy */
+  if (argc > 1 && strcmp(argv[1], "--semispace") == 0) {
+    g_mem_init.gc_strategy = SILC_MEM_GC_SEMISPACE;
+  }
+
+  BENCH_STARTED();
+
+  int counts[] = { 10000, 20000, 40000, 1000000 };
+  char name[64];
+
+  for (int i = 0; i < countof(counts); ++i) {
+    sprintf(name, "gc: %d dead conses", counts[i]);
+    BENCH_REPORT(name, gc_dead_conses(counts[i]));
+  }
+
+  for (int i = 0; i < countof(counts); ++i) {
+    sprintf(name, "gc: %d dead/live interleaved conses", counts[i]);
+    BENCH_REPORT(name, gc_interleaved_conses(counts[i]));
+  }
+
+  for (int i = 0; i < countof(counts); ++i) {
+    sprintf(name, "full gc: %d old conses, 100000 young", counts[i]);
+    BENCH_REPORT(name, gc_young_garbage(counts[i], 0));
+    sprintf(name, "minor gc: %d old conses, 100000 young", counts[i]);
+    BENCH_REPORT(name, gc_young_garbage(counts[i], 1));
+  }
+
+  for (int i = 0; i < countof(counts); ++i) {
+    sprintf(name, "max pause: %d live conses, stop-the-world", counts[i]);
+    BENCH_REPORT(name, gc_max_pause(counts[i], 0));
+    sprintf(name, "max pause: %d live conses, incremental", counts[i]);
+    BENCH_REPORT(name, gc_max_pause(counts[i], 1024));
+  }
+
+  int buf_sizes[] = { 64 * 1024, 1024 * 1024 };
+  for (int i = 0; i < countof(buf_sizes); ++i) {
+    sprintf(name, "gc: 16 live %d byte buffers", buf_sizes[i]);
+    BENCH_REPORT(name, gc_live_buffers(buf_sizes[i], 0));
+    sprintf(name, "gc: 16 live %d byte buffers, large objects", buf_sizes[i]);
+    BENCH_REPORT(name, gc_live_buffers(buf_sizes[i], 1024));
+  }
+
+  /* compare these with the build, that uses direct object references, see configure --direct */
+  int oref_counts[] = { 10000, 100000, 1000000 };
+  for (int i = 0; i < countof(oref_counts); ++i) {
+    sprintf(name, "gc: %d dead/live interleaved orefs", oref_counts[i]);
+    BENCH_REPORT(name, gc_interleaved_orefs(oref_counts[i]));
+    sprintf(name, "traverse: list of %d orefs, 10 times", oref_counts[i]);
+    BENCH_REPORT(name, traverse_oref_list(oref_counts[i], 10));
+  }
+
+  int alloc_counts[] = { 1000000, 10000000 };
+  for (int i = 0; i < countof(alloc_counts); ++i) {
+    sprintf(name, "alloc: %d conses", alloc_counts[i]);
+    BENCH_REPORT(name, alloc_conses(alloc_counts[i], 0));
+    sprintf(name, "alloc: %d conses, 64K nursery", alloc_counts[i]);
+    BENCH_REPORT(name, alloc_conses(alloc_counts[i], 64 * 1024));
+  }
+
+  for (int i = 0; i < countof(alloc_counts); ++i) {
+    sprintf(name, "alloc: %d orefs, 1%% survive", alloc_counts[i]);
+    BENCH_REPORT(name, alloc_orefs(alloc_counts[i]));
+  }
+
+  int request_counts[] = { 1000, 10000 };
+  for (int i = 0; i < countof(request_counts); ++i) {
+    sprintf(name, "alloc: %d requests of 1000 conses", request_counts[i]);
+    BENCH_REPORT(name, alloc_requests(request_counts[i], 0, 0));
+    sprintf(name, "alloc: %d requests of 1000 conses, 64K nursery", request_counts[i]);
+    BENCH_REPORT(name, alloc_requests(request_counts[i], 0, 64 * 1024));
+    sprintf(name, "alloc: %d requests of 1000 conses, regions", request_counts[i]);
+    BENCH_REPORT(name, alloc_requests(request_counts[i], 1, 0));
+  }
+
+  int live_counts[] = { 10000, 100000, 1000000 };
+  for (int i = 0; i < countof(live_counts); ++i) {
+    sprintf(name, "max request: %d live conses, paced", live_counts[i]);
+    BENCH_REPORT(name, max_request_time(live_counts[i], 0));
+    sprintf(name, "max request: %d live conses, gc hint", live_counts[i]);
+    BENCH_REPORT(name, max_request_time(live_counts[i], 1));
+  }
+
+  int growth_counts[] = { 1000000, 4000000 };
+  for (int i = 0; i < countof(growth_counts); ++i) {
+    sprintf(name, "alloc: %d live vectors, growing malloc heap", growth_counts[i]);
+    BENCH_REPORT(name, alloc_growing_heap(growth_counts[i], 0));
+    sprintf(name, "alloc: %d live vectors, growing mmap heap", growth_counts[i]);
+    BENCH_REPORT(name, alloc_growing_heap(growth_counts[i], 1));
+  }
+
+  return 0;
+}
@@ -2,8 +2,8 @@
 # Generic target directory for object files
 TO          =	target/obj
 
-CFLAGS      += -Wall -Werror -Wimplicit -pedantic -std=c99
-LFLAGS      += -lm
+CFLAGS      += -Wall -Werror -Wimplicit -pedantic -std=c99 -pthread
+LFLAGS      += -lm -pthread
 
 CC          = gcc
 LINKER      = gcc
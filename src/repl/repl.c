@@ -1,18 +1,207 @@
 #include "silc.h"
 
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void print_usage() {
+  fputs("Usage: silc [options] [script...]\n"
+        "Options:\n"
+        "  --heap-init=SIZE      initial heap size in bytes, K, M and G suffixes are supported\n"
+        "  --heap-max=SIZE       maximum heap size in bytes, K, M and G suffixes are supported\n"
+        "  --heap-growth=FACTOR  heap growth factor, e.g. 1.5\n"
+        "  --heap-mmap           reserve maximum heap size by mmap, so that heap is resized in place\n"
+        "  --gc-semispace        copy live objects to the spare heap buffer instead of compacting the heap\n"
+        "  --gc-target=PERCENT   start collection once live objects would take PERCENT of the used heap\n"
+        "  --gc-idle             collect garbage, if it pays off, before waiting for input\n"
+        "  --background-gc       collect garbage in background while waiting for input\n"
+        "  --alloc-sample=SIZE   sample allocation call stack once per SIZE allocated bytes, 64K by default\n"
+        "  --alloc-profile=FILE  write allocated memory per call stack to FILE in the folded format on exit\n"
+        "  --retained-profile=FILE\n"
+        "                        write memory, retained by the call stacks, to FILE in the folded format on exit\n"
+        "  --image=FILE          start from the image, saved by --save-image\n"
+        "  --save-image=FILE     save context image to FILE on exit\n",
+        stderr);
+}
+
+#define DEFAULT_ALLOC_SAMPLE_INTERVAL (64 * 1024)
+
+/* Profile files, written on exit */
+static const char* g_alloc_profile_file = NULL;
+static const char* g_retained_profile_file = NULL;
+
+/* Indicates whether or not garbage is collected before waiting for input, see --gc-idle */
+static bool g_gc_idle = false;
+
+/* Image files, the first one is loaded on start and the second one is written on exit */
+static const char* g_image_file = NULL;
+static const char* g_save_image_file = NULL;
+
+/* Parses size with an optional K, M or G suffix, returns 0 if size is malformed */
+static size_t parse_size(const char* str) {
+  char* end = NULL;
+  unsigned long long size = strtoull(str, &end, 10);
+  switch (*end) {
+    case 'G': case 'g':
+      size *= 1024;
+    case 'M': case 'm':
+      size *= 1024;
+    case 'K': case 'k':
+      size *= 1024;
+      ++end;
+  }
+
+  return (end == str || *end != 0) ? 0 : (size_t) size;
+}
+
+/* Parses heap size, returns 0 and reports an error if it exceeds the maximum heap size of the build */
+static size_t parse_heap_size(const char* str) {
+  size_t size = parse_size(str);
+  if (size > silc_get_max_heap_size()) {
+    fprintf(stderr, ";; Heap size %s exceeds maximum heap size of %zu bytes\n", str, silc_get_max_heap_size());
+    return 0;
+  }
+  return size;
+}
+
+/* Parses option and returns true if it is a valid one */
+static bool parse_option(const char* arg, struct silc_ctx_settings_t* settings) {
+  if (strcmp(arg, "--heap-mmap") == 0) {
+    settings->mmap_heap = 1;
+    return true;
+  }
+
+  if (strcmp(arg, "--gc-semispace") == 0) {
+    settings->semispace_gc = 1;
+    return true;
+  }
+
+  if (strcmp(arg, "--gc-idle") == 0) {
+    g_gc_idle = true;
+    return true;
+  }
+
+  if (strcmp(arg, "--background-gc") == 0) {
+    settings->background_gc = 1;
+    return true;
+  }
+
+  const char* value = strchr(arg, '=');
+  if (value == NULL) {
+    return false;
+  }
+  ++value;
+
+  if (strncmp(arg, "--heap-init=", value - arg) == 0) {
+    settings->init_heap_size = parse_heap_size(value);
+    return settings->init_heap_size > 0;
+  }
+
+  if (strncmp(arg, "--heap-max=", value - arg) == 0) {
+    settings->max_heap_size = parse_heap_size(value);
+    return settings->max_heap_size > 0;
+  }
+
+  if (strncmp(arg, "--heap-growth=", value - arg) == 0) {
+    settings->heap_growth_factor = strtod(value, NULL);
+    return settings->heap_growth_factor > 1.0;
+  }
+
+  if (strncmp(arg, "--gc-target=", value - arg) == 0) {
+    settings->gc_target_occupancy = atoi(value);
+    return settings->gc_target_occupancy > 0 && settings->gc_target_occupancy < 100;
+  }
+
+  if (strncmp(arg, "--alloc-sample=", value - arg) == 0) {
+    settings->alloc_sample_interval = parse_size(value);
+    return settings->alloc_sample_interval > 0;
+  }
+
+  if (strncmp(arg, "--alloc-profile=", value - arg) == 0) {
+    g_alloc_profile_file = value;
+    return *value != 0;
+  }
+
+  if (strncmp(arg, "--retained-profile=", value - arg) == 0) {
+    g_retained_profile_file = value;
+    return *value != 0;
+  }
+
+  if (strncmp(arg, "--image=", value - arg) == 0) {
+    g_image_file = value;
+    return *value != 0;
+  }
+
+  if (strncmp(arg, "--save-image=", value - arg) == 0) {
+    g_save_image_file = value;
+    return *value != 0;
+  }
+
+  return false;
+}
+
+static void write_profile(struct silc_ctx_t* c, const char* file_name, int retained) {
+  FILE* f = fopen(file_name, "w");
+  if (f == NULL) {
+    fprintf(stderr, ";; Unable to write profile to %s\n", file_name);
+    return;
+  }
+  silc_write_alloc_profile(c, f, retained);
+  fclose(f);
+}
+
 int main(int argc, const char** argv) {
+  /* parse options, that precede script names */
+  struct silc_ctx_settings_t settings = {0};
+  int arg_index = 1;
+  for (; arg_index < argc && strncmp(argv[arg_index], "--", 2) == 0; ++arg_index) {
+    if (!parse_option(argv[arg_index], &settings)) {
+      fprintf(stderr, ";; Invalid option: %s\n", argv[arg_index]);
+      print_usage();
+      return 1;
+    }
+  }
+
+  if ((g_alloc_profile_file != NULL || g_retained_profile_file != NULL) && settings.alloc_sample_interval == 0) {
+    settings.alloc_sample_interval = DEFAULT_ALLOC_SAMPLE_INTERVAL;
+  }
+
   /* create context and display welcome prompt */
-  struct silc_ctx_t* c = silc_new_context();
+  struct silc_ctx_t* c = NULL;
+  if (g_image_file != NULL) {
+    c = silc_new_context_from_image_with_settings(g_image_file, &settings);
+    if (c == NULL) {
+      fprintf(stderr, ";; Unable to load image %s\n", g_image_file);
+      return 1;
+    }
+  } else {
+    c = silc_new_context_with_settings(&settings);
+  }
   fputs(";; SilcLisp by Alex Shabanov\n", stdout);
 
   /* load scripts */
-  for (int i = 1; i < argc; ++i) {
+  for (int i = arg_index; i < argc; ++i) {
     silc_load(c, argv[i]);
   }
 
   silc_obj eof = silc_err_from_code(1000); /* custom error code that will indicate an end of input */
   for (;;) {
     fputs("\n? ", stdout);
+    fflush(stdout);
+
+    /* collect garbage in advance, so that evaluation of the input does not pause for it */
+    if (g_gc_idle) {
+      silc_gc_hint(c);
+    }
+
+    /* let background collector work while waiting for input */
+    silc_park(c);
+    int ch = fgetc(stdin);
+    if (ch != EOF) {
+      ungetc(ch, stdin);
+    }
+    silc_unpark(c);
+
     silc_obj input = silc_read(c, stdin, eof);
     /* end of file reached? */
     if (input == eof) {
@@ -40,6 +229,19 @@ int main(int argc, const char** argv) {
     fprintf(stderr, ";; Error: %s\n", silc_err_code_to_str(error_code));
   }
 
+  /* retained profile only counts live objects, so garbage is collected first */
+  if (g_retained_profile_file != NULL) {
+    silc_gc(c);
+    write_profile(c, g_retained_profile_file, 1);
+  }
+  if (g_alloc_profile_file != NULL) {
+    write_profile(c, g_alloc_profile_file, 0);
+  }
+
+  if (g_save_image_file != NULL && silc_try_get_err_code(silc_save_image(c, g_save_image_file)) > 0) {
+    fprintf(stderr, ";; Unable to save image to %s\n", g_save_image_file);
+  }
+
   /* get exit code and free context */
   int exit_code = silc_get_exit_code(c);
   silc_free_context(c);
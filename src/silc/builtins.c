@@ -65,7 +65,7 @@ silc_obj silc_internal_fn_cons(struct silc_funcall_t* f) {
 }
 
 silc_obj silc_internal_fn_plus(struct silc_funcall_t* f) {
-  int result = 0;
+  silc_fixnum result = 0;
 
   for (int i = 0; i < f->argc; ++i) {
     silc_obj arg;
@@ -87,7 +87,7 @@ silc_obj silc_internal_fn_plus(struct silc_funcall_t* f) {
 }
 
 silc_obj silc_internal_fn_minus(struct silc_funcall_t* f) {
-  int result = 0;
+  silc_fixnum result = 0;
 
   for (int i = 0; i < f->argc; ++i) {
     silc_obj arg;
@@ -110,7 +110,7 @@ silc_obj silc_internal_fn_minus(struct silc_funcall_t* f) {
 }
 
 silc_obj silc_internal_fn_div(struct silc_funcall_t* f) {
-  int result = 0;
+  silc_fixnum result = 0;
 
   for (int i = 0; i < f->argc; ++i) {
     silc_obj arg;
@@ -133,7 +133,7 @@ silc_obj silc_internal_fn_div(struct silc_funcall_t* f) {
 }
 
 silc_obj silc_internal_fn_mul(struct silc_funcall_t* f) {
-  int result = 1;
+  silc_fixnum result = 1;
 
   for (int i = 0; i < f->argc; ++i) {
     silc_obj arg;
@@ -158,7 +158,7 @@ silc_obj silc_internal_fn_inc(struct silc_funcall_t* f) {
   SILC_CHECKED_SET(arg, f->argv[0]);
 
   if ((SILC_GET_TYPE(arg) == SILC_TYPE_INL) && (SILC_GET_INL_SUBTYPE(arg) == SILC_INL_SUBTYPE_INT)) {
-    int val = silc_obj_to_int(arg) + 1;
+    silc_fixnum val = silc_obj_to_int(arg) + 1;
     if (val > SILC_MAX_INT) {
       /* TODO: upgrade to long (or BigInteger) */
       return silc_err_from_code(SILC_ERR_VALUE_OUT_OF_RANGE);
@@ -183,6 +183,16 @@ silc_obj silc_internal_fn_gc(struct silc_funcall_t* f) {
   return SILC_OBJ_NIL;
 }
 
+silc_obj silc_internal_fn_gc_hint(struct silc_funcall_t* f) {
+  EXPECT_ARG_COUNT(f, 0);
+  return silc_gc_hint(f->ctx) ? SILC_OBJ_TRUE : SILC_OBJ_FALSE;
+}
+
+silc_obj silc_internal_fn_gc_stats(struct silc_funcall_t* f) {
+  EXPECT_ARG_COUNT(f, 0);
+  return silc_gc_stats(f->ctx);
+}
+
 silc_obj silc_internal_fn_quit(struct silc_funcall_t* f) {
   if (f->argc > 0) {
     silc_obj arg;
@@ -201,3 +211,14 @@ silc_obj silc_internal_fn_begin(struct silc_funcall_t* f) {
 
   return f->argv[f->argc - 1];
 }
+
+silc_obj silc_internal_fn_with_region(struct silc_funcall_t* f) {
+  EXPECT_ARG_COUNT(f, 1);
+
+  /* result is registered as a handle, so that region is kept if the result has been allocated in it */
+  struct silc_region_t region;
+  silc_region_begin(f->ctx, &region);
+  silc_obj result = silc_handle(f->ctx, silc_eval(f->ctx, f->argv[0]));
+  silc_region_end(f->ctx, &region);
+  return result;
+}
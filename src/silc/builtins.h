@@ -33,7 +33,11 @@ silc_obj silc_internal_fn_mul(struct silc_funcall_t* f);
 silc_obj silc_internal_fn_load(struct silc_funcall_t* f);
 
 silc_obj silc_internal_fn_gc(struct silc_funcall_t* f);
+silc_obj silc_internal_fn_gc_hint(struct silc_funcall_t* f);
+silc_obj silc_internal_fn_gc_stats(struct silc_funcall_t* f);
 
 silc_obj silc_internal_fn_quit(struct silc_funcall_t* f);
 
 silc_obj silc_internal_fn_begin(struct silc_funcall_t* f);
+
+silc_obj silc_internal_fn_with_region(struct silc_funcall_t* f);
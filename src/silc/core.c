@@ -12,6 +12,8 @@
  * limitations under the License.
  */
 
+#define _POSIX_C_SOURCE 200112L /* mmap */
+
 #include "silc.h"
 
 #include <stdio.h>
@@ -19,6 +21,11 @@
 #include <string.h>
 #include <stdbool.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "mem.h"
 #include "builtins.h"
 
@@ -41,6 +48,18 @@ static void * xmalloc(size_t size);
 static void * xmallocz(size_t size);
 static inline void xfree(void * p);
 
+/* Reader, see read.c */
+silc_obj silc_int_read(struct silc_ctx_t* c, FILE* f, silc_obj eof);
+
+/* Allocation profile */
+struct silc_alloc_profile_t;
+static int record_alloc_sample(struct silc_mem_init_t* init, silc_obj obj, int type, int subtype, long long bytes);
+static struct silc_alloc_profile_t* new_alloc_profile();
+static void free_alloc_profile(struct silc_alloc_profile_t* p);
+
+/* Symbols */
+static silc_obj get_bucket_sym(struct silc_ctx_t* c, silc_obj cell_car);
+
 
 /*******************************************************************************
  * Types                                                                       *
@@ -55,8 +74,8 @@ typedef silc_obj (* silc_fn_ptr)(struct silc_funcall_t* f);
 struct silc_ctx_t {
   struct silc_settings_t* settings;
 
-  /* stack */
-  silc_obj*             stack;
+  /* stack, its contents can be moved by garbage collector, see get_stack */
+  silc_obj              stack_obj;
   int                   stack_end;  /* index of the position after last inserted element in the stack */
   int                   stack_size; /* total stack size */
 
@@ -79,12 +98,35 @@ struct silc_ctx_t {
 
   /* exit code */
   int                   exit_code;
+
+  /* allocation profile, NULL unless allocation sampling is enabled */
+  struct silc_alloc_profile_t* alloc_profile;
+
+  /* shared heap, this context has been created from, or NULL */
+  struct silc_shared_t* shared;
+
+  /* associations of the shared symbols, indexed by their slot numbers, see get_sym_assoc_cell */
+  silc_obj              shared_sym_assocs;
 };
 
 struct silc_settings_t {
   FILE*                 out; /* default output stream (used in print function) */
 };
 
+/* Frozen context, see silc_freeze_context, globals are held as the shared references */
+struct silc_shared_t {
+  struct silc_mem_init_t* mem_init;
+  struct silc_mem_t*      mem;
+
+  /* symbol table, it is never written to, so that it holds every symbol of the frozen context */
+  silc_obj              sym_name_hash_table;
+
+  /* associations of the symbols, that have been moved out of them, see move_sym_assocs */
+  silc_obj              sym_assocs;
+
+  silc_obj              lambda_begin;
+};
+
 
 /* Low-level mem alloc functions */
 
@@ -115,23 +157,61 @@ static inline void xfree(void * p) {
 #define SILC_DEFAULT_SYM_HT_SIZE          (512)
 #define SILC_DEFAULT_SYM_HT_LOAD_FACTOR   (0.75)
 
+/* Size of the symbol table of the context, that shares the symbols of the frozen context */
+#define SILC_SHARED_CTX_SYM_HT_SIZE       (1021)
+
 #define SILC_DEFAULT_CONS_ARR_SIZE        (256)
 
+#define SILC_DEFAULT_NURSERY_SIZE         (256 * 1024)
+
+#define SILC_DEFAULT_LARGE_OBJECT_SIZE    (16 * 1024)
+
+#define SILC_DEFAULT_INIT_MEMORY_SIZE     (1024 * 1024)
+
+#define SILC_DEFAULT_MAX_MEMORY_SIZE      (16 * 1024 * 1024)
+
 static void oom_abort(struct silc_mem_init_t* init) {
   fputs(";; Out of heap\n", stderr);
   abort();
 }
 
-static void init_mem(struct silc_ctx_t* c) {
+/* Converts heap size in bytes to the count of silc_obj units, falls back to default size if it is not set */
+static int heap_size_from_byte_count(size_t byte_count, int default_size) {
+  size_t size = byte_count / sizeof(silc_obj);
+  if (size == 0) {
+    return default_size;
+  }
+  return size < INT_MAX ? (int) size : INT_MAX;
+}
+
+static struct silc_mem_init_t* new_mem_init(struct silc_ctx_t* c, const struct silc_ctx_settings_t* settings) {
   struct silc_mem_init_t* init = xmallocz(sizeof(struct silc_mem_init_t));
 
   init->context = c;
-  init->init_memory_size = 1024 * 1024;
-  init->max_memory_size = 16 * 1024 * 1024;
+  init->init_memory_size = heap_size_from_byte_count(settings->init_heap_size, SILC_DEFAULT_INIT_MEMORY_SIZE);
+  init->max_memory_size = heap_size_from_byte_count(settings->max_heap_size, SILC_DEFAULT_MAX_MEMORY_SIZE);
+  init->growth_factor = settings->heap_growth_factor;
+  init->background_gc = settings->background_gc != 0;
+  init->mmap_heap = settings->mmap_heap != 0;
+  init->gc_strategy = settings->semispace_gc != 0 ? SILC_MEM_GC_SEMISPACE : SILC_MEM_GC_MARK_COMPACT;
+  init->gc_target_occupancy = settings->gc_target_occupancy;
+  init->nursery_size = SILC_DEFAULT_NURSERY_SIZE;
+  init->large_object_size = SILC_DEFAULT_LARGE_OBJECT_SIZE;
+  init->shared = c->shared != NULL ? c->shared->mem : NULL;
   init->oom_abort = oom_abort;
+  if (settings->alloc_sample_interval > 0) {
+    init->alloc_sample_interval = settings->alloc_sample_interval < INT_MAX ? (int) settings->alloc_sample_interval :
+        INT_MAX;
+    init->on_alloc_sample = record_alloc_sample;
+    c->alloc_profile = new_alloc_profile();
+  }
   init->alloc_mem = xmalloc;
   init->free_mem = xfree;
+  return init;
+}
 
+static void init_mem(struct silc_ctx_t* c, const struct silc_ctx_settings_t* settings) {
+  struct silc_mem_init_t* init = new_mem_init(c, settings);
   struct silc_mem_t* mem = xmallocz(sizeof(struct silc_mem_t));
   silc_int_mem_init(mem, init);
 
@@ -139,8 +219,8 @@ static void init_mem(struct silc_ctx_t* c) {
   c->mem = mem;
 }
 
-static void init_globals(struct silc_ctx_t* c) {
-  c->sym_name_hash_table = silc_hash_table(c, 8179/*prime*/);
+static void init_globals(struct silc_ctx_t* c, int sym_ht_size) {
+  c->sym_name_hash_table = silc_hash_table(c, sym_ht_size);
   silc_int_mem_add_root(c->mem, c->sym_name_hash_table);
 }
 
@@ -157,7 +237,10 @@ static silc_fn_ptr g_silc_builtin_functions[] = {
   &silc_internal_fn_mul,
   &silc_internal_fn_begin,
   &silc_internal_fn_gc,
-  &silc_internal_fn_quit
+  &silc_internal_fn_gc_stats,
+  &silc_internal_fn_quit,
+  &silc_internal_fn_with_region,
+  &silc_internal_fn_gc_hint
 };
 
 static int find_fn_pos(struct silc_ctx_t* c, silc_fn_ptr fn_ptr) {
@@ -181,11 +264,16 @@ static bool are_same_objects(silc_obj lhs, silc_obj rhs) {
   return lhs == rhs;
 }
 
+static bool is_hash_table_subtype(int subtype) {
+  return subtype == SILC_OREF_HASHTABLE_SUBTYPE || subtype == SILC_OREF_WEAK_KEY_HASHTABLE_SUBTYPE ||
+      subtype == SILC_OREF_WEAK_VALUE_HASHTABLE_SUBTYPE;
+}
+
 static silc_obj* lookup_hash_table_cell(struct silc_ctx_t* c, silc_obj hash_table, silc_obj key) {
   int size = 0;
   silc_obj* contents;
   int subtype = silc_int_mem_parse_ref(c->mem, hash_table, &size, NULL, &contents);
-  SILC_ASSERT(subtype == SILC_OREF_HASHTABLE_SUBTYPE && size > 0 && contents != NULL);
+  SILC_ASSERT(is_hash_table_subtype(subtype) && size > 0 && contents != NULL);
 
   /* get position in a hash table */
   int pos = 1 + obj_hash_code(key, size - 1);
@@ -194,13 +282,49 @@ static silc_obj* lookup_hash_table_cell(struct silc_ctx_t* c, silc_obj hash_tabl
   return contents + pos;
 }
 
-silc_obj silc_hash_table(struct silc_ctx_t* c, int initial_size) {
-  silc_obj result = silc_int_mem_alloc(c->mem, initial_size + 1, NULL, SILC_TYPE_OREF, SILC_OREF_HASHTABLE_SUBTYPE);
+/*
+ * Weakly held parts of the hash table entries are wrapped into weak references, inline objects are never collected,
+ * so they are kept as is. Entry dies once its weakly held part is collected, dead entries are unlinked by puts.
+ */
+
+static silc_obj wrap_entry_part(struct silc_ctx_t* c, silc_obj o, bool weak) {
+  return (weak && SILC_GET_TYPE(o) != SILC_TYPE_INL) ? silc_int_mem_alloc_weak_ref(c->mem, o) : o;
+}
+
+static silc_obj unwrap_entry_part(struct silc_ctx_t* c, silc_obj o, bool weak) {
+  return (weak && SILC_GET_TYPE(o) != SILC_TYPE_INL) ? silc_int_mem_get_weak_ref_target(c->mem, o) : o;
+}
+
+static bool is_dead_entry(struct silc_ctx_t* c, silc_obj* entry_contents, int subtype) {
+  if (subtype == SILC_OREF_HASHTABLE_SUBTYPE) {
+    return false;
+  }
+
+  silc_obj weak_part = entry_contents[subtype == SILC_OREF_WEAK_KEY_HASHTABLE_SUBTYPE ? 0 : 1];
+  return SILC_GET_TYPE(weak_part) != SILC_TYPE_INL && silc_int_mem_get_weak_ref_target(c->mem, weak_part) == SILC_OBJ_NIL;
+}
+
+static silc_obj new_hash_table(struct silc_ctx_t* c, int initial_size, int subtype) {
+  silc_obj result = silc_int_mem_alloc(c->mem, initial_size + 1, NULL, SILC_TYPE_OREF, subtype);
   silc_get_oref(c->mem, result, NULL)[0] = silc_int_to_obj(0); /* element count */
   return result;
 }
 
+silc_obj silc_hash_table(struct silc_ctx_t* c, int initial_size) {
+  return new_hash_table(c, initial_size, SILC_OREF_HASHTABLE_SUBTYPE);
+}
+
+silc_obj silc_weak_key_hash_table(struct silc_ctx_t* c, int initial_size) {
+  return new_hash_table(c, initial_size, SILC_OREF_WEAK_KEY_HASHTABLE_SUBTYPE);
+}
+
+silc_obj silc_weak_value_hash_table(struct silc_ctx_t* c, int initial_size) {
+  return new_hash_table(c, initial_size, SILC_OREF_WEAK_VALUE_HASHTABLE_SUBTYPE);
+}
+
 silc_obj silc_hash_table_get(struct silc_ctx_t* c, silc_obj hash_table, silc_obj key, silc_obj not_found_val) {
+  int subtype = silc_get_ref_subtype(c, hash_table);
+  bool weak_keys = subtype == SILC_OREF_WEAK_KEY_HASHTABLE_SUBTYPE;
   silc_obj* entry_list_ptr = lookup_hash_table_cell(c, hash_table, key);
 
   for (silc_obj cell = *entry_list_ptr; cell != SILC_OBJ_NIL;) {
@@ -208,8 +332,10 @@ silc_obj silc_hash_table_get(struct silc_ctx_t* c, silc_obj hash_table, silc_obj
     silc_obj cur_entry = cell_contents[0]; /* get current hash table entry */
 
     silc_obj* cur_entry_contents = silc_parse_cons(c->mem, cur_entry);
-    if (are_same_objects(key, cur_entry_contents[0])) {
-      return cur_entry_contents[1]; /* return value */
+    if (!is_dead_entry(c, cur_entry_contents, subtype) &&
+        are_same_objects(key, unwrap_entry_part(c, cur_entry_contents[0], weak_keys))) {
+      /* return value */
+      return unwrap_entry_part(c, cur_entry_contents[1], subtype == SILC_OREF_WEAK_VALUE_HASHTABLE_SUBTYPE);
     }
 
     cell = cell_contents[1]; /* go to next cell */
@@ -219,28 +345,74 @@ silc_obj silc_hash_table_get(struct silc_ctx_t* c, silc_obj hash_table, silc_obj
 }
 
 silc_obj silc_hash_table_put(struct silc_ctx_t* c, silc_obj hash_table, silc_obj key, silc_obj value, silc_obj not_found_val) {
-  silc_obj* entry_list_ptr = lookup_hash_table_cell(c, hash_table, key);
-
-  for (silc_obj cell = *entry_list_ptr; cell != SILC_OBJ_NIL;) {
+  int subtype = silc_get_ref_subtype(c, hash_table);
+  bool weak_keys = subtype == SILC_OREF_WEAK_KEY_HASHTABLE_SUBTYPE;
+  bool weak_values = subtype == SILC_OREF_WEAK_VALUE_HASHTABLE_SUBTYPE;
+
+  /* keep arguments alive while entry parts are being allocated */
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(c->mem, &scope);
+  silc_int_mem_handle(c->mem, hash_table);
+  silc_int_mem_handle(c->mem, key);
+  silc_int_mem_handle(c->mem, value);
+  silc_obj entry_value = silc_int_mem_handle(c->mem, wrap_entry_part(c, value, weak_values));
+
+  silc_obj prev_cell = SILC_OBJ_NIL;
+  for (silc_obj cell = *lookup_hash_table_cell(c, hash_table, key); cell != SILC_OBJ_NIL;) {
     silc_obj* cell_contents = silc_parse_cons(c->mem, cell);
     silc_obj cur_entry = cell_contents[0]; /* get current hash table entry */
+    silc_obj next_cell = cell_contents[1];
 
     silc_obj* cur_entry_contents = silc_parse_cons(c->mem, cur_entry);
-    if (are_same_objects(key, cur_entry_contents[0])) {
-      silc_obj existing_value = cur_entry_contents[1];
-      cur_entry_contents[1] = value; /* override old value in place */
+    if (is_dead_entry(c, cur_entry_contents, subtype)) {
+      /* unlink dead entry */
+      if (prev_cell == SILC_OBJ_NIL) {
+        *lookup_hash_table_cell(c, hash_table, key) = next_cell;
+        silc_int_mem_write_barrier(c->mem, hash_table, next_cell);
+      } else {
+        silc_parse_cons(c->mem, prev_cell)[1] = next_cell;
+        silc_int_mem_write_barrier(c->mem, prev_cell, next_cell);
+      }
+      cell = next_cell;
+      continue;
+    }
+
+    if (are_same_objects(key, unwrap_entry_part(c, cur_entry_contents[0], weak_keys))) {
+      silc_obj existing_value = unwrap_entry_part(c, cur_entry_contents[1], weak_values);
+      cur_entry_contents[1] = entry_value; /* override old value in place */
+      silc_int_mem_write_barrier(c->mem, cur_entry, entry_value);
+      silc_int_mem_close_handle_scope(c->mem, &scope);
       return existing_value;
     }
 
-    cell = cell_contents[1]; /* go to next cell */
+    prev_cell = cell;
+    cell = next_cell; /* go to next cell */
   }
 
   /* no entry found, insert a new one */
-  silc_obj new_entry = silc_cons(c, key, value);
-  *entry_list_ptr = silc_cons(c, new_entry, *entry_list_ptr);
+  silc_obj entry_key = silc_int_mem_handle(c->mem, wrap_entry_part(c, key, weak_keys));
+  silc_obj new_entry = silc_int_mem_handle(c->mem, silc_cons(c, entry_key, entry_value));
+  silc_obj new_cell = silc_cons(c, new_entry, *lookup_hash_table_cell(c, hash_table, key));
+
+  /* hash table might have been moved by garbage collector, so cell should be looked up again */
+  *lookup_hash_table_cell(c, hash_table, key) = new_cell;
+  silc_int_mem_write_barrier(c->mem, hash_table, new_cell);
+
+  silc_int_mem_close_handle_scope(c->mem, &scope);
   return not_found_val;
 }
 
+silc_obj silc_weak_ref(struct silc_ctx_t* c, silc_obj target) {
+  return silc_int_mem_alloc_weak_ref(c->mem, target);
+}
+
+silc_obj silc_weak_ref_get(struct silc_ctx_t* c, silc_obj weak_ref) {
+  if (silc_get_ref_subtype(c, weak_ref) != SILC_OREF_WEAK_REF_SUBTYPE) {
+    return silc_err_from_code(SILC_ERR_INVALID_ARGS);
+  }
+  return silc_int_mem_get_weak_ref_target(c->mem, weak_ref);
+}
+
 /*
  * Function argument list checking utility
  */
@@ -312,9 +484,14 @@ static silc_obj create_function(struct silc_ctx_t* c,
 }
 
 static silc_obj add_builtin_function(struct silc_ctx_t* c, const char* symbol_name, silc_fn_ptr fn_ptr, bool special) {
+  /* keep function alive while symbol is being created */
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(c->mem, &scope);
+
   /* create function */
   silc_obj fn = create_function(c, (special ? SILC_FN_SPECIAL : 0) | SILC_FN_BUILTIN, SILC_OBJ_NIL, fn_ptr,
     SILC_OBJ_NIL, SILC_OBJ_NIL);
+  silc_int_mem_handle(c->mem, fn);
   int errcode = silc_try_get_err_code(fn);
   if (errcode > 0) {
     fprintf(stderr, ";; FATAL: unable to register function %s, errcode=%d\n", symbol_name, errcode);
@@ -326,6 +503,7 @@ static silc_obj add_builtin_function(struct silc_ctx_t* c, const char* symbol_na
   silc_obj prev_assoc = silc_set_sym_assoc(c, sym, fn);
   SILC_ASSERT(silc_try_get_err_code(prev_assoc) == SILC_ERR_UNRESOLVED_SYMBOL);
 
+  silc_int_mem_close_handle_scope(c->mem, &scope);
   return fn;
 }
 
@@ -348,10 +526,13 @@ static void init_builtins(struct silc_ctx_t* c) {
 
   add_builtin_function(c, "define", &silc_internal_fn_define, true);
   add_builtin_function(c, "lambda", &silc_internal_fn_lambda, true);
+  add_builtin_function(c, "with-region", &silc_internal_fn_with_region, true);
 
   c->lambda_begin = add_builtin_function(c, "begin", &silc_internal_fn_begin, false);
 
   add_builtin_function(c, "gc", &silc_internal_fn_gc, false);
+  add_builtin_function(c, "gc-hint", &silc_internal_fn_gc_hint, false);
+  add_builtin_function(c, "gc-stats", &silc_internal_fn_gc_stats, false);
   add_builtin_function(c, "quit", &silc_internal_fn_quit, false);
 }
 
@@ -363,34 +544,264 @@ static void init_stack(struct silc_ctx_t* c) {
   /* immediately mark stack as a root object */
   silc_int_mem_add_root(c->mem, stack_obj);
 
-  /* cache stack pointer for performance */
-  c->stack = silc_get_oref(c->mem, stack_obj, NULL);
+  c->stack_obj = stack_obj;
   c->stack_size = stack_size;
 }
 
+/** Returns stack contents, should be called again after any allocation as garbage collector might move the stack */
+static inline silc_obj* get_stack(struct silc_ctx_t* c) {
+  return silc_get_oref(c->mem, c->stack_obj, NULL);
+}
+
 struct silc_ctx_t* silc_new_context() {
+  struct silc_ctx_settings_t settings = {0};
+  return silc_new_context_with_settings(&settings);
+}
+
+static struct silc_ctx_t* alloc_context() {
   struct silc_ctx_t* c = xmallocz(sizeof(struct silc_ctx_t));
 
   /* settings */
   struct silc_settings_t * s = xmallocz(sizeof(struct silc_settings_t));
   s->out = stdout;
   c->settings = s;
+  return c;
+}
+
+struct silc_ctx_t* silc_new_context_with_settings(const struct silc_ctx_settings_t* settings) {
+  struct silc_ctx_t* c = alloc_context();
 
   /* heap memory */
-  init_mem(c);
+  init_mem(c, settings);
 
   /* stack, uses heap memory */
   init_stack(c);
 
   /* globals */
-  init_globals(c);
+  init_globals(c, 8179/*prime*/);
   init_builtins(c);
 
   return c;
 }
 
+size_t silc_get_max_heap_size() {
+  return sizeof(silc_obj) * (size_t) SILC_INT_MEM_MAX_MEMORY_SIZE;
+}
+
+/*
+ * Context image: header with the globals, followed by the heap image, see silc_int_mem_save_image.
+ * Builtin functions refer to fn_array by their indices, so image is only compatible with the same builtins.
+ */
+
+#define SILC_IMAGE_MAGIC                  "SILCIMG"
+#define SILC_IMAGE_VERSION                (2)
+
+struct silc_image_header_t {
+  char                  magic[8];
+  int                   version;
+  int                   obj_size;
+  int                   fn_count;
+  int                   stack_size;
+  silc_obj              stack_obj;
+  silc_obj              sym_name_hash_table;
+  silc_obj              current_env;
+  silc_obj              lambda_begin;
+};
+
+silc_obj silc_save_image(struct silc_ctx_t* c, const char* file_name) {
+  if (c->shared != NULL) {
+    return silc_err_from_code(SILC_ERR_INVALID_ARGS); /* image would reference the shared heap */
+  }
+
+  FILE* f = fopen(file_name, "wb");
+  if (f == NULL) {
+    return silc_err_from_code(SILC_ERR_IO);
+  }
+
+  struct silc_image_header_t h = {
+    .magic = SILC_IMAGE_MAGIC,
+    .version = SILC_IMAGE_VERSION,
+    .obj_size = sizeof(silc_obj),
+    .fn_count = c->fn_count,
+    .stack_size = c->stack_size,
+    .stack_obj = c->stack_obj,
+    .sym_name_hash_table = c->sym_name_hash_table,
+    .current_env = c->current_env,
+    .lambda_begin = c->lambda_begin
+  };
+
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && silc_int_mem_save_image(c->mem, f);
+  ok = fclose(f) == 0 && ok;
+  return ok ? SILC_OBJ_NIL : silc_err_from_code(SILC_ERR_IO);
+}
+
+/** Creates context from the mapped image, returns NULL if image is malformed */
+static struct silc_ctx_t* new_context_from_image(const char* image, size_t size,
+                                                 const struct silc_ctx_settings_t* settings) {
+  struct silc_image_header_t h;
+  if (size < sizeof(h)) {
+    return NULL;
+  }
+
+  memcpy(&h, image, sizeof(h));
+  if (memcmp(h.magic, SILC_IMAGE_MAGIC, sizeof(h.magic)) != 0 || h.version != SILC_IMAGE_VERSION ||
+      h.obj_size != sizeof(silc_obj) || h.fn_count != countof(g_silc_builtin_functions)) {
+    return NULL;
+  }
+
+  struct silc_ctx_t* c = alloc_context();
+  struct silc_mem_init_t* init = new_mem_init(c, settings);
+  struct silc_mem_t* mem = xmallocz(sizeof(struct silc_mem_t));
+  if (silc_int_mem_init_from_image(mem, init, image + sizeof(h), size - sizeof(h)) == 0) {
+    if (c->alloc_profile != NULL) {
+      free_alloc_profile(c->alloc_profile);
+    }
+    xfree(mem);
+    xfree(init);
+    xfree(c->settings);
+    xfree(c);
+    return NULL;
+  }
+  c->mem_init = init;
+  c->mem = mem;
+
+  /* globals are restored as is, since positions are preserved */
+  c->stack_obj = h.stack_obj;
+  c->stack_size = h.stack_size;
+  c->sym_name_hash_table = h.sym_name_hash_table;
+  c->current_env = h.current_env;
+  c->lambda_begin = h.lambda_begin;
+  c->fn_array = g_silc_builtin_functions;
+  c->fn_count = h.fn_count;
+  return c;
+}
+
+struct silc_ctx_t* silc_new_context_from_image(const char* file_name) {
+  struct silc_ctx_settings_t settings = {0};
+  return silc_new_context_from_image_with_settings(file_name, &settings);
+}
+
+struct silc_ctx_t* silc_new_context_from_image_with_settings(const char* file_name,
+                                                             const struct silc_ctx_settings_t* settings) {
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = (size_t) st.st_size;
+  void* image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    return NULL;
+  }
+
+  struct silc_ctx_t* c = new_context_from_image(image, size, settings);
+  munmap(image, size);
+  return c;
+}
+
+/*
+ * Shared heap: heap of the frozen context, whose objects are shared by the contexts created from it.
+ * Shared heap is read-only, so that every symbol of the frozen context holds its slot number in place of
+ * the association, associations are moved to the vector, that is copied to the heap of every sharing context.
+ */
+
+/** Moves associations of the symbols to the returned vector, symbols get their slot numbers instead */
+static silc_obj move_sym_assocs(struct silc_ctx_t* c) {
+  int count = silc_obj_to_int(silc_get_oref(c->mem, c->sym_name_hash_table, NULL)[0]);
+  silc_obj sym_assocs = silc_int_mem_alloc(c->mem, count, NULL, SILC_TYPE_OREF, SILC_OREF_SYM_ASSOCS_SUBTYPE);
+
+  /* symbol count includes the collected symbols, that have not been unlinked yet */
+  int slot = 0;
+  int table_size = 0;
+  silc_obj* table = silc_get_oref(c->mem, c->sym_name_hash_table, &table_size);
+  for (int i = 1; i < table_size; ++i) {
+    for (silc_obj cell = table[i]; cell != SILC_OBJ_NIL;) {
+      silc_obj* pc = silc_parse_cons(c->mem, cell);
+      silc_obj sym = get_bucket_sym(c, pc[0]);
+      if (sym != SILC_OBJ_NIL) {
+        SILC_ASSERT(slot < count);
+        silc_obj* sym_contents = silc_get_oref(c->mem, sym, NULL);
+        silc_get_oref(c->mem, sym_assocs, NULL)[slot] = sym_contents[2];
+        silc_int_mem_write_barrier(c->mem, sym_assocs, sym_contents[2]);
+        sym_contents[2] = silc_int_to_obj(slot++);
+      }
+      cell = pc[1];
+    }
+  }
+  return sym_assocs;
+}
+
+struct silc_shared_t* silc_freeze_context(struct silc_ctx_t* c) {
+  if (c->shared != NULL) {
+    return NULL; /* shared heap can not reference another one */
+  }
+
+  silc_obj sym_assocs = move_sym_assocs(c);
+  silc_obj roots[] = { c->sym_name_hash_table, sym_assocs, c->lambda_begin };
+  silc_int_mem_freeze(c->mem, roots, countof(roots));
+
+  struct silc_shared_t* shared = xmallocz(sizeof(struct silc_shared_t));
+  shared->mem_init = c->mem_init;
+  shared->mem = c->mem;
+  shared->sym_name_hash_table = roots[0];
+  shared->sym_assocs = roots[1];
+  shared->lambda_begin = roots[2];
+
+  /* frozen heap never allocates, so that it never calls back the context */
+  c->mem_init->context = NULL;
+  if (c->alloc_profile != NULL) {
+    free_alloc_profile(c->alloc_profile);
+  }
+  xfree(c->settings);
+  xfree(c);
+  return shared;
+}
+
+struct silc_ctx_t* silc_new_context_from_shared(struct silc_shared_t* shared) {
+  struct silc_ctx_settings_t settings = {0};
+  return silc_new_context_from_shared_with_settings(shared, &settings);
+}
+
+struct silc_ctx_t* silc_new_context_from_shared_with_settings(struct silc_shared_t* shared,
+                                                              const struct silc_ctx_settings_t* settings) {
+  struct silc_ctx_t* c = alloc_context();
+  c->shared = shared;
+
+  init_mem(c, settings);
+  init_stack(c);
+  init_globals(c, SILC_SHARED_CTX_SYM_HT_SIZE);
+
+  /* builtins are shared along with their symbols, shared heap does not move, so that associations are copied as is */
+  int count = 0;
+  silc_obj* sym_assocs = silc_get_oref(c->mem, shared->sym_assocs, &count);
+  c->shared_sym_assocs = silc_int_mem_alloc(c->mem, count, sym_assocs, SILC_TYPE_OREF, SILC_OREF_SYM_ASSOCS_SUBTYPE);
+  silc_int_mem_add_root(c->mem, c->shared_sym_assocs);
+
+  c->fn_array = g_silc_builtin_functions;
+  c->fn_count = countof(g_silc_builtin_functions);
+  c->lambda_begin = shared->lambda_begin;
+  return c;
+}
+
+void silc_free_shared(struct silc_shared_t* shared) {
+  silc_int_mem_free(shared->mem);
+  xfree(shared->mem);
+  xfree(shared->mem_init);
+  xfree(shared);
+}
+
 void silc_free_context(struct silc_ctx_t * c) {
   silc_int_mem_free(c->mem);
+  if (c->alloc_profile != NULL) {
+    free_alloc_profile(c->alloc_profile);
+  }
   xfree(c->mem);
   xfree(c->settings);
   xfree(c->mem_init);
@@ -398,10 +809,115 @@ void silc_free_context(struct silc_ctx_t * c) {
   xfree(c);
 }
 
+void silc_open_handle_scope(struct silc_ctx_t* c, struct silc_handle_scope_t* scope) {
+  silc_int_mem_open_handle_scope(c->mem, scope);
+}
+
+void silc_close_handle_scope(struct silc_ctx_t* c, struct silc_handle_scope_t* scope) {
+  silc_int_mem_close_handle_scope(c->mem, scope);
+}
+
+silc_obj silc_handle(struct silc_ctx_t* c, silc_obj o) {
+  return silc_int_mem_handle(c->mem, o);
+}
+
+void silc_region_begin(struct silc_ctx_t* c, struct silc_region_t* region) {
+  silc_int_mem_begin_region(c->mem, region);
+}
+
+bool silc_region_end(struct silc_ctx_t* c, struct silc_region_t* region) {
+  return silc_int_mem_end_region(c->mem, region);
+}
+
 void silc_gc(struct silc_ctx_t* c) {
   silc_int_mem_gc(c->mem);
 }
 
+int silc_gc_hint(struct silc_ctx_t* c) {
+  return silc_int_mem_gc_hint(c->mem) >= 0;
+}
+
+/* GC statistics are inline integers, cumulative times and sizes are scaled down, so that they fit them longer */
+
+static silc_obj stat_to_obj(long long val) {
+  return silc_int_to_obj(val < SILC_MAX_INT ? (silc_fixnum) val : SILC_MAX_INT - 1);
+}
+
+/* Helpers below register every list they create in the current handle scope */
+
+static silc_obj add_stat(struct silc_ctx_t* c, silc_obj stats, const char* name, silc_obj val) {
+  silc_int_mem_handle(c->mem, val);
+  silc_obj sym = silc_int_mem_handle(c->mem, silc_sym_from_buf(c, name, strlen(name)));
+  silc_obj stat = silc_int_mem_handle(c->mem, silc_cons(c, sym, val));
+  return silc_int_mem_handle(c->mem, silc_cons(c, stat, stats));
+}
+
+static silc_obj alloc_counter_to_list(struct silc_ctx_t* c, silc_obj key,
+                                      const struct silc_mem_alloc_counter_t* counter) {
+  silc_obj kbytes = silc_int_mem_handle(c->mem, silc_cons(c, stat_to_obj(counter->bytes / 1024), SILC_OBJ_NIL));
+  silc_obj values = silc_int_mem_handle(c->mem, silc_cons(c, stat_to_obj(counter->count), kbytes));
+  return silc_int_mem_handle(c->mem, silc_cons(c, key, values));
+}
+
+silc_obj silc_gc_stats(struct silc_ctx_t* c) {
+  /* take a snapshot, since the counters are updated by the allocations below */
+  struct silc_mem_gc_counters_t counters = *silc_int_mem_get_gc_counters(c->mem);
+  int subtype_count = SILC_MEM_TRACKED_SUBTYPE_COUNT;
+  struct silc_mem_alloc_counter_t* by_subtype = xmalloc(sizeof(struct silc_mem_alloc_counter_t) * subtype_count);
+  memcpy(by_subtype, c->mem->alloc_by_subtype, sizeof(struct silc_mem_alloc_counter_t) * subtype_count);
+
+  /* keep the intermediate lists alive */
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(c->mem, &scope);
+
+  silc_obj by_subtype_list = SILC_OBJ_NIL;
+  for (int i = subtype_count - 1; i >= 0; --i) {
+    if (by_subtype[i].count > 0) {
+      silc_obj key = i < subtype_count - 1 ? silc_int_to_obj(i) : silc_sym_from_buf(c, "other", 5);
+      silc_int_mem_handle(c->mem, key);
+      silc_obj counter = alloc_counter_to_list(c, key, by_subtype + i);
+      by_subtype_list = silc_int_mem_handle(c->mem, silc_cons(c, counter, by_subtype_list));
+    }
+  }
+  xfree(by_subtype);
+
+  const char* type_names[] = { "inl", "cons", "oref", "bref" };
+  silc_obj by_type_list = SILC_OBJ_NIL;
+  for (int type = SILC_TYPE_BREF; type > SILC_TYPE_INL; --type) {
+    silc_obj key = silc_int_mem_handle(c->mem, silc_sym_from_buf(c, type_names[type], strlen(type_names[type])));
+    silc_obj counter = alloc_counter_to_list(c, key, counters.alloc_by_type + type);
+    by_type_list = silc_int_mem_handle(c->mem, silc_cons(c, counter, by_type_list));
+  }
+
+  silc_obj histogram = SILC_OBJ_NIL;
+  for (int i = SILC_MEM_PAUSE_HISTOGRAM_SIZE - 1; i >= 0; --i) {
+    histogram = silc_int_mem_handle(c->mem, silc_cons(c, stat_to_obj(counters.pause_histogram[i]), histogram));
+  }
+
+  silc_obj stats = SILC_OBJ_NIL;
+  stats = add_stat(c, stats, "alloc-by-subtype", by_subtype_list);
+  stats = add_stat(c, stats, "alloc-by-type", by_type_list);
+  stats = add_stat(c, stats, "moved-kbytes", stat_to_obj(counters.moved_bytes / 1024));
+  stats = add_stat(c, stats, "reclaimed-objects", stat_to_obj(counters.reclaimed_objects));
+  stats = add_stat(c, stats, "reclaimed-kbytes", stat_to_obj(counters.reclaimed_bytes / 1024));
+  stats = add_stat(c, stats, "pause-histogram", histogram);
+  stats = add_stat(c, stats, "max-pause-us", stat_to_obj(counters.max_pause_ns / 1000));
+  stats = add_stat(c, stats, "total-pause-us", stat_to_obj(counters.total_pause_ns / 1000));
+  stats = add_stat(c, stats, "minor-gc-count", stat_to_obj(counters.minor_gc_count));
+  stats = add_stat(c, stats, "gc-count", stat_to_obj(counters.gc_count));
+
+  silc_int_mem_close_handle_scope(c->mem, &scope);
+  return stats;
+}
+
+void silc_park(struct silc_ctx_t* c) {
+  silc_int_mem_park(c->mem);
+}
+
+void silc_unpark(struct silc_ctx_t* c) {
+  silc_int_mem_unpark(c->mem);
+}
+
 void silc_set_exit_code(struct silc_ctx_t* c, int code) {
   c->exit_code = code;
 }
@@ -425,6 +941,15 @@ silc_obj silc_load(struct silc_ctx_t* c, const char* file_name) {
   return silc_err_from_code(SILC_ERR_INTERNAL);
 }
 
+silc_obj silc_read(struct silc_ctx_t* c, FILE* f, silc_obj eof) {
+  /* reader registers the parts of expression, that are being read */
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(c->mem, &scope);
+  silc_obj result = silc_int_read(c, f, eof);
+  silc_int_mem_close_handle_scope(c->mem, &scope);
+  return result;
+}
+
 silc_obj silc_get_lambda_begin(struct silc_ctx_t* c) {
   return c->lambda_begin;
 }
@@ -444,6 +969,9 @@ const char* silc_err_code_to_str(int code) {
     case SILC_ERR_STACK_OVERFLOW:
       return "stack overflow";
 
+    case SILC_ERR_IO:
+      return "input/output error";
+
     case SILC_ERR_INVALID_ARGS:
       return "invalid arguments";
 
@@ -572,16 +1100,30 @@ silc_obj silc_define_function(struct silc_ctx_t* c, silc_obj arg_list, silc_obj
  * String hash code calculation
  */
 
+/** Hash codes are kept in int, so that they are always representable as inline integers */
+#define SILC_MAX_HASH_CODE    (SILC_MAX_INT < INT_MAX ? (int) SILC_MAX_INT : INT_MAX)
+
 static inline int calc_hash_code(const char* buf, int size, int modulo) {
   int result = 0;
   for (int i = 0; i < size; ++i) {
     result = 31 * result + buf[i];
   }
-  return ((result % modulo) + modulo) % modulo;
+  return (int) (((result % modulo) + (long long) modulo) % modulo);
 }
 
 /* Sym */
 
+/**
+ * Returns cell, that holds association of the given symbol. Shared symbol holds its slot number instead of
+ * the association, since shared heap is read-only, its association is held by the context heap.
+ */
+static silc_obj* get_sym_assoc_cell(struct silc_ctx_t* c, silc_obj sym, silc_obj* sym_contents) {
+  if (silc_int_mem_is_shared(sym)) {
+    return silc_get_oref(c->mem, c->shared_sym_assocs, NULL) + silc_obj_to_int(sym_contents[2]);
+  }
+  return sym_contents + 2;
+}
+
 static silc_obj get_sym_info(struct silc_ctx_t* c, silc_obj o, silc_obj* sym_str, silc_obj* hash_code) {
   int len = 0;
   silc_obj* obj_contents = NULL;
@@ -598,7 +1140,7 @@ static silc_obj get_sym_info(struct silc_ctx_t* c, silc_obj o, silc_obj* sym_str
   if (sym_str != NULL) {
     *sym_str = obj_contents[1];
   }
-  return obj_contents[2];
+  return *get_sym_assoc_cell(c, o, obj_contents);
 }
 
 
@@ -632,47 +1174,120 @@ static int is_same_sym_str(struct silc_ctx_t* c, silc_obj sym, const char* buf,
   return compare_str(c, sym_str, buf, size) == 0;
 }
 
-silc_obj silc_sym_from_buf(struct silc_ctx_t* c, const char* buf, int size) {
+/*
+ * Symbol table holds symbols weakly until they get associated with a value, so that the symbols, which are
+ * not referenced from elsewhere, are collected along with their names. Bucket cells hold either weak references
+ * to the unassociated symbols or the associated symbols themselves.
+ */
+
+static silc_obj* get_sym_bucket(struct silc_ctx_t* c, silc_obj sym_name_hash_table, int hash_code) {
   int hash_table_size = 0;
   silc_obj* hash_table_contents;
-  int hash_table_subtype = silc_int_mem_parse_ref(c->mem, c->sym_name_hash_table, &hash_table_size, NULL, &hash_table_contents);
+  int hash_table_subtype = silc_int_mem_parse_ref(c->mem, sym_name_hash_table, &hash_table_size, NULL, &hash_table_contents);
 
   SILC_ASSERT(hash_table_subtype == SILC_OREF_HASHTABLE_SUBTYPE && hash_table_size > 0 && hash_table_contents != NULL);
 
-  int hash_table_count = silc_obj_to_int(hash_table_contents[0]);
+  int pos_modulo = hash_table_size - 1; // here and below: 1 is a service information size
+  return hash_table_contents + 1 + (hash_code % pos_modulo);
+}
 
-  /* lookup and optional insert */
-  int hash_code = calc_hash_code(buf, size, SILC_MAX_INT);
-  SILC_ASSERT((hash_code >= 0) && (hash_code < SILC_MAX_INT));
+/** Returns symbol, held by the given bucket cell, or SILC_OBJ_NIL if it has been collected */
+static silc_obj get_bucket_sym(struct silc_ctx_t* c, silc_obj cell_car) {
+  if (silc_int_mem_parse_ref(c->mem, cell_car, NULL, NULL, NULL) == SILC_OREF_WEAK_REF_SUBTYPE) {
+    return silc_int_mem_get_weak_ref_target(c->mem, cell_car);
+  }
+  return cell_car;
+}
 
-  int pos_modulo = hash_table_size - 1; // here and below: 1 is a service information size
-  int pos = 1 + (hash_code % pos_modulo);
+/** Makes symbol table hold the given symbol strongly */
+static void retain_sym(struct silc_ctx_t* c, silc_obj sym) {
+  silc_obj hash_code = SILC_OBJ_ZERO;
+  get_sym_info(c, sym, NULL, &hash_code);
+
+  for (silc_obj cell = *get_sym_bucket(c, c->sym_name_hash_table, silc_obj_to_int(hash_code)); cell != SILC_OBJ_NIL;) {
+    silc_obj* pc = silc_parse_cons(c->mem, cell);
+    if (pc[0] != sym && get_bucket_sym(c, pc[0]) == sym) {
+      pc[0] = sym;
+      silc_int_mem_write_barrier(c->mem, cell, sym);
+      return;
+    }
+    cell = pc[1];
+  }
+}
+
+/** Looks the symbol up in the read-only symbol table of the shared heap, returns SILC_OBJ_NIL if it is not there */
+static silc_obj find_shared_sym(struct silc_ctx_t* c, const char* buf, int size, silc_obj hash_code_obj) {
+  silc_obj cell = *get_sym_bucket(c, c->shared->sym_name_hash_table, silc_obj_to_int(hash_code_obj));
+  while (cell != SILC_OBJ_NIL) {
+    silc_obj* pc = silc_parse_cons(c->mem, cell);
+    silc_obj sym = get_bucket_sym(c, pc[0]);
+    if (sym != SILC_OBJ_NIL && is_same_sym_str(c, sym, buf, size, hash_code_obj)) {
+      return sym;
+    }
+    cell = pc[1];
+  }
+  return SILC_OBJ_NIL;
+}
+
+silc_obj silc_sym_from_buf(struct silc_ctx_t* c, const char* buf, int size) {
+  /* lookup and optional insert */
+  int hash_code = calc_hash_code(buf, size, SILC_MAX_HASH_CODE);
+  SILC_ASSERT((hash_code >= 0) && (hash_code < SILC_MAX_HASH_CODE));
   silc_obj hash_code_obj = silc_int_to_obj(hash_code);
 
-  silc_obj* pc = NULL;
-  silc_obj hash_table_cell = hash_table_contents[pos];
-  for (silc_obj cell = hash_table_cell; cell != SILC_OBJ_NIL; cell = pc[1]) {
-    pc = silc_parse_cons(c->mem, cell); /* go to next */
-    silc_obj other_sym = pc[0];
+  /* shared symbols take precedence, context symbol table only holds the symbols, that are not shared */
+  if (c->shared != NULL) {
+    silc_obj shared_sym = find_shared_sym(c, buf, size, hash_code_obj);
+    if (shared_sym != SILC_OBJ_NIL) {
+      return shared_sym;
+    }
+  }
+
+  silc_obj* bucket = get_sym_bucket(c, c->sym_name_hash_table, hash_code);
+  silc_obj* prev_link = bucket;
+  for (silc_obj cell = *bucket; cell != SILC_OBJ_NIL;) {
+    silc_obj* pc = silc_parse_cons(c->mem, cell); /* go to next */
+    silc_obj other_sym = get_bucket_sym(c, pc[0]);
+    if (other_sym == SILC_OBJ_NIL) {
+      /* symbol has been collected, unlink its cell */
+      *prev_link = pc[1];
+      silc_int_mem_write_barrier(c->mem, prev_link == bucket ? c->sym_name_hash_table : cell, pc[1]);
+      silc_obj* hash_table_contents = silc_get_oref(c->mem, c->sym_name_hash_table, NULL);
+      hash_table_contents[0] = silc_int_to_obj(silc_obj_to_int(hash_table_contents[0]) - 1);
+      cell = pc[1];
+      continue;
+    }
+
     if (is_same_sym_str(c, other_sym, buf, size, hash_code_obj)) {
       return other_sym;
     }
+    prev_link = pc + 1;
+    cell = pc[1];
   }
 
-  /* create new entry */
+  /* create new entry, keep newly allocated objects alive until entry is inserted */
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(c->mem, &scope);
+
   silc_obj contents[] = {
     hash_code_obj,              /* [0] symbol string's hash code */
-    silc_str(c, buf, size),     /* [1] symbol string */
+    silc_int_mem_handle(c->mem, silc_str(c, buf, size)), /* [1] symbol string */
     silc_err_from_code(SILC_ERR_UNRESOLVED_SYMBOL) /* [2] assoc (initially unresolved) */
   };
   silc_obj result = silc_int_mem_alloc(c->mem, 3, contents, SILC_TYPE_OREF, SILC_OREF_SYMBOL_SUBTYPE);
+  silc_int_mem_handle(c->mem, result);
+  silc_obj weak_sym = silc_int_mem_handle(c->mem, silc_int_mem_alloc_weak_ref(c->mem, result));
+  silc_obj new_cell = silc_cons(c, weak_sym, *get_sym_bucket(c, c->sym_name_hash_table, hash_code));
 
-  /* insert that entry to the hash table */
-  hash_table_contents[pos] = silc_cons(c, result, hash_table_cell);
+  /* insert that entry to the hash table, hash table might have been moved by garbage collector */
+  *get_sym_bucket(c, c->sym_name_hash_table, hash_code) = new_cell;
+  silc_int_mem_write_barrier(c->mem, c->sym_name_hash_table, new_cell);
 
   /* update count */
-  hash_table_contents[0] = silc_int_to_obj(hash_table_count + 1);
+  silc_obj* hash_table_contents = silc_get_oref(c->mem, c->sym_name_hash_table, NULL);
+  hash_table_contents[0] = silc_int_to_obj(silc_obj_to_int(hash_table_contents[0]) + 1);
 
+  silc_int_mem_close_handle_scope(c->mem, &scope);
   return result;
 }
 
@@ -689,8 +1304,17 @@ silc_obj silc_set_sym_assoc(struct silc_ctx_t* c, silc_obj o, silc_obj new_assoc
   }
 
   SILC_ASSERT(len == 3 && obj_contents != NULL);
-  silc_obj old_assoc = obj_contents[2];
-  obj_contents[2] = new_assoc;
+  silc_obj* assoc_cell = get_sym_assoc_cell(c, o, obj_contents);
+  silc_obj old_assoc = *assoc_cell;
+  *assoc_cell = new_assoc;
+  bool shared = silc_int_mem_is_shared(o);
+  silc_int_mem_write_barrier(c->mem, shared ? c->shared_sym_assocs : o, new_assoc);
+
+  /* associated symbol is no longer eligible for collection, shared symbols are never collected */
+  if (!shared && silc_try_get_err_code(old_assoc) == SILC_ERR_UNRESOLVED_SYMBOL &&
+      silc_try_get_err_code(new_assoc) != SILC_ERR_UNRESOLVED_SYMBOL) {
+    retain_sym(c, o);
+  }
   return old_assoc;
 }
 
@@ -698,6 +1322,28 @@ silc_obj silc_str(struct silc_ctx_t* c, const char* buf, int size) {
   return silc_int_mem_alloc(c->mem, size, buf, SILC_TYPE_BREF, SILC_BREF_STR_SUBTYPE);
 }
 
+silc_obj silc_str_from_byte_buf(struct silc_ctx_t* c, silc_obj byte_buf, int size) {
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(c->mem, &scope);
+  silc_int_mem_handle(c->mem, byte_buf);
+  silc_obj result = silc_int_mem_alloc(c->mem, size, NULL, SILC_TYPE_BREF, SILC_BREF_STR_SUBTYPE);
+
+  /* byte buffer contents are retrieved after allocation as garbage collector might move it */
+  if (size > 0) {
+    char* src = NULL;
+    int len = silc_byte_buf_get(c, byte_buf, &src);
+    SILC_ASSERT(len >= size && src != NULL);
+    (void) len;
+
+    char* dest = NULL;
+    silc_int_mem_parse_ref(c->mem, result, &len, &dest, NULL);
+    memcpy(dest, src, size);
+  }
+
+  silc_int_mem_close_handle_scope(c->mem, &scope);
+  return result;
+}
+
 int silc_get_str_chars(struct silc_ctx_t* c, silc_obj o, char* buf, int pos, int size) {
   int len = 0;
   char* char_content = NULL;
@@ -753,6 +1399,234 @@ silc_obj silc_cdr(struct silc_ctx_t* c, silc_obj cons) {
   return get_cons_cell(c, cons, 1);
 }
 
+/*
+ * Allocation profile.
+ * Sampled allocations are attributed to the call stack, i.e. to the forms, that are being evaluated, and to the type
+ * of the allocated object. Every distinct stack is an allocation site, sampled objects keep their sites while they
+ * survive collections, so that both allocated and retained memory can be written out as folded stacks.
+ */
+
+#define SILC_MAX_ALLOC_SITE_STACK_SIZE    (4096)
+
+struct silc_alloc_site_t {
+  char*                 stack; /* frame names, separated by semicolons, ending with the bracketed object type */
+  int                   hash_code;
+  long long             count; /* sampled allocations */
+  long long             bytes; /* estimated allocated bytes */
+};
+
+struct silc_alloc_profile_t {
+  /* heads of the forms, that are being evaluated, they are kept alive by the forms themselves */
+  silc_obj*             frames;
+  int                   frame_count;
+  int                   frame_capacity;
+
+  struct silc_alloc_site_t* sites;
+  int                   site_count;
+  int                   site_capacity;
+
+  /* open addressing table of the site indexes keyed by the stack hash code, -1 stands for the vacant slot */
+  int*                  site_table;
+  int                   site_table_size; /* power of two, at least twice as large as site_count */
+};
+
+static void push_frame(struct silc_ctx_t* c, silc_obj head) {
+  struct silc_alloc_profile_t* p = c->alloc_profile;
+  if (p->frame_count == p->frame_capacity) {
+    int new_capacity = p->frame_capacity > 0 ? p->frame_capacity * 2 : 64;
+    silc_obj* new_frames = xmalloc(sizeof(silc_obj) * new_capacity);
+    if (p->frames != NULL) {
+      memcpy(new_frames, p->frames, sizeof(silc_obj) * p->frame_count);
+      xfree(p->frames);
+    }
+    p->frames = new_frames;
+    p->frame_capacity = new_capacity;
+  }
+  p->frames[p->frame_count++] = head;
+}
+
+/* Appends string to the stack buffer, returns new length of the stack */
+static int append_frame_name(char* stack, int len, const char* name, int name_len) {
+  int size = name_len < SILC_MAX_ALLOC_SITE_STACK_SIZE - 1 - len ? name_len : SILC_MAX_ALLOC_SITE_STACK_SIZE - 1 - len;
+  memcpy(stack + len, name, size);
+  return len + size;
+}
+
+static int append_frame(struct silc_ctx_t* c, char* stack, int len, silc_obj head) {
+  silc_obj sym_str = SILC_OBJ_NIL;
+  if (SILC_GET_TYPE(head) == SILC_TYPE_OREF && silc_int_mem_parse_ref(c->mem, head, NULL, NULL, NULL) ==
+      SILC_OREF_SYMBOL_SUBTYPE) {
+    get_sym_info(c, head, &sym_str, NULL);
+    int size = silc_get_str_chars(c, sym_str, stack + len, 0, SILC_MAX_ALLOC_SITE_STACK_SIZE - 1 - len);
+    for (int i = len; i < len + size; ++i) {
+      if (stack[i] == ';' || stack[i] == ' ') {
+        stack[i] = '_'; /* frame names should not break the folded format */
+      }
+    }
+    return len + size;
+  }
+
+  /* anonymous function, e.g. ((lambda (x) x) 1) */
+  return append_frame_name(stack, len, "lambda", 6);
+}
+
+static const char* get_subtype_name(int type, int subtype) {
+  if (type == SILC_TYPE_CONS) {
+    return "cons";
+  }
+
+  switch (subtype) {
+    case SILC_OREF_SYMBOL_SUBTYPE: return "symbol";
+    case SILC_OREF_HASHTABLE_SUBTYPE: return "hash-table";
+    case SILC_OREF_WEAK_KEY_HASHTABLE_SUBTYPE: return "weak-key-hash-table";
+    case SILC_OREF_WEAK_VALUE_HASHTABLE_SUBTYPE: return "weak-value-hash-table";
+    case SILC_OREF_FUNCTION_SUBTYPE: return "function";
+    case SILC_OREF_WEAK_REF_SUBTYPE: return "weak-ref";
+    case SILC_OREF_STACK_SUBTYPE: return "stack";
+    case SILC_OREF_ROOT_VECTOR_SUBTYPE: return "root-vector";
+    case SILC_BREF_STR_SUBTYPE: return "str";
+    case SILC_BREF_BUFFER_SUBTYPE: return "byte-buf";
+  }
+  return type == SILC_TYPE_OREF ? "oref" : "bref";
+}
+
+/* Returns slot of the site table, that holds the site with the given stack or the vacant one, where it belongs */
+static int find_alloc_site_slot(struct silc_alloc_profile_t* p, const char* stack, int hash_code) {
+  int mask = p->site_table_size - 1;
+  for (int slot = hash_code & mask;; slot = (slot + 1) & mask) {
+    int i = p->site_table[slot];
+    if (i < 0 || (p->sites[i].hash_code == hash_code && strcmp(p->sites[i].stack, stack) == 0)) {
+      return slot;
+    }
+  }
+}
+
+static void resize_alloc_site_table(struct silc_alloc_profile_t* p, int new_size) {
+  int* new_table = xmalloc(sizeof(int) * new_size);
+  memset(new_table, -1, sizeof(int) * new_size);
+  int mask = new_size - 1;
+  for (int i = 0; i < p->site_count; ++i) {
+    int slot = p->sites[i].hash_code & mask;
+    while (new_table[slot] >= 0) {
+      slot = (slot + 1) & mask;
+    }
+    new_table[slot] = i;
+  }
+
+  if (p->site_table != NULL) {
+    xfree(p->site_table);
+  }
+  p->site_table = new_table;
+  p->site_table_size = new_size;
+}
+
+static int find_or_add_alloc_site(struct silc_alloc_profile_t* p, const char* stack, int len) {
+  if (2 * (p->site_count + 1) > p->site_table_size) {
+    resize_alloc_site_table(p, p->site_table_size > 0 ? p->site_table_size * 2 : 128);
+  }
+
+  int hash_code = calc_hash_code(stack, len, SILC_MAX_HASH_CODE);
+  int slot = find_alloc_site_slot(p, stack, hash_code);
+  if (p->site_table[slot] >= 0) {
+    return p->site_table[slot];
+  }
+
+  if (p->site_count == p->site_capacity) {
+    int new_capacity = p->site_capacity > 0 ? p->site_capacity * 2 : 64;
+    struct silc_alloc_site_t* new_sites = xmalloc(sizeof(struct silc_alloc_site_t) * new_capacity);
+    if (p->sites != NULL) {
+      memcpy(new_sites, p->sites, sizeof(struct silc_alloc_site_t) * p->site_count);
+      xfree(p->sites);
+    }
+    p->sites = new_sites;
+    p->site_capacity = new_capacity;
+  }
+
+  struct silc_alloc_site_t* site = p->sites + p->site_count;
+  site->stack = xmalloc(len + 1);
+  memcpy(site->stack, stack, len + 1);
+  site->hash_code = hash_code;
+  site->count = 0;
+  site->bytes = 0;
+  p->site_table[slot] = p->site_count;
+  return p->site_count++;
+}
+
+/* Called by the heap for the sampled allocation, must not allocate objects */
+static int record_alloc_sample(struct silc_mem_init_t* init, silc_obj obj, int type, int subtype, long long bytes) {
+  struct silc_ctx_t* c = init->context;
+  struct silc_alloc_profile_t* p = c->alloc_profile;
+
+  /* root frame comes first in the folded stack */
+  char stack[SILC_MAX_ALLOC_SITE_STACK_SIZE];
+  int len = append_frame_name(stack, 0, "silc", 4);
+  for (int i = 0; i < p->frame_count; ++i) {
+    len = append_frame_name(stack, len, ";", 1);
+    len = append_frame(c, stack, len, p->frames[i]);
+  }
+  const char* subtype_name = get_subtype_name(type, subtype);
+  len = append_frame_name(stack, len, ";[", 2);
+  len = append_frame_name(stack, len, subtype_name, strlen(subtype_name));
+  len = append_frame_name(stack, len, "]", 1);
+  stack[len] = 0;
+
+  int site = find_or_add_alloc_site(p, stack, len);
+  ++p->sites[site].count;
+  p->sites[site].bytes += bytes;
+  return site;
+}
+
+static struct silc_alloc_profile_t* new_alloc_profile() {
+  return xmallocz(sizeof(struct silc_alloc_profile_t));
+}
+
+static void free_alloc_profile(struct silc_alloc_profile_t* p) {
+  for (int i = 0; i < p->site_count; ++i) {
+    xfree(p->sites[i].stack);
+  }
+  if (p->sites != NULL) {
+    xfree(p->sites);
+  }
+  if (p->site_table != NULL) {
+    xfree(p->site_table);
+  }
+  if (p->frames != NULL) {
+    xfree(p->frames);
+  }
+  xfree(p);
+}
+
+int silc_write_alloc_profile(struct silc_ctx_t* c, FILE* out, int retained) {
+  struct silc_alloc_profile_t* p = c->alloc_profile;
+  if (p == NULL) {
+    return 0;
+  }
+
+  long long* bytes = xmallocz(sizeof(long long) * (p->site_count > 0 ? p->site_count : 1));
+  if (retained) {
+    int sample_count = 0;
+    const struct silc_mem_alloc_sample_t* samples = silc_int_mem_get_alloc_samples(c->mem, &sample_count);
+    for (int i = 0; i < sample_count; ++i) {
+      bytes[samples[i].site] += samples[i].bytes;
+    }
+  } else {
+    for (int i = 0; i < p->site_count; ++i) {
+      bytes[i] = p->sites[i].bytes;
+    }
+  }
+
+  int result = 0;
+  for (int i = 0; i < p->site_count; ++i) {
+    if (bytes[i] > 0) {
+      fprintf(out, "%s %lld\n", p->sites[i].stack, bytes[i]);
+      ++result;
+    }
+  }
+
+  xfree(bytes);
+  return result;
+}
+
 /*
  * Evaluation
  */
@@ -784,7 +1658,8 @@ static silc_obj push_arguments(struct silc_ctx_t* c, silc_obj cdr, bool special_
     }
 
     /* insert element to the stack and update last element index */
-    c->stack[c->stack_end] = car;
+    get_stack(c)[c->stack_end] = car;
+    silc_int_mem_write_barrier(c->mem, c->stack_obj, car);
     c->stack_end = new_stack_end;
   }
   return SILC_OBJ_NIL;
@@ -796,19 +1671,19 @@ static silc_obj call_builtin(struct silc_ctx_t* c, silc_obj arg_values, silc_obj
 
   /* save stack state */
   int prev_end = c->stack_end;
+  int fn_pos = silc_obj_to_int(fn_contents[2]); /* function position */
+  SILC_ASSERT(fn_pos >= 0 && fn_pos < c->fn_count);
 
   /* put arguments to the function stack */
   silc_obj result = push_arguments(c, arg_values, special);
   if (silc_try_get_err_code(result) < 0) {
-    int fn_pos = silc_obj_to_int(fn_contents[2]); /* function position */
-    SILC_ASSERT(fn_pos >= 0 && fn_pos < c->fn_count);
     silc_fn_ptr fn_ptr = c->fn_array[fn_pos];
 
     /* ok, now prepare function call context */
     struct silc_funcall_t funcall = {
       .ctx = c,
       .argc = c->stack_end - prev_end,
-      .argv = c->stack + prev_end
+      .argv = get_stack(c) + prev_end
     };
     SILC_ASSERT(funcall.argc >= 0);
 
@@ -816,7 +1691,11 @@ static silc_obj call_builtin(struct silc_ctx_t* c, silc_obj arg_values, silc_obj
     result = fn_ptr(&funcall);
   }
 
-  /* Restore stack state */
+  /* Restore stack state, popped elements are cleared, so that they neither keep nor reference released objects */
+  silc_obj* stack = get_stack(c);
+  for (int i = prev_end; i < c->stack_end; ++i) {
+    stack[i] = SILC_OBJ_NIL;
+  }
   c->stack_end = prev_end;
 
   return result;
@@ -836,6 +1715,7 @@ static silc_obj call_lambda(struct silc_ctx_t* c, silc_obj arg_values, silc_obj*
   silc_obj result = SILC_OBJ_NIL;
   silc_obj prev_env = c->current_env;
   silc_obj arg_names = fn_contents[3];
+  silc_obj body = fn_contents[2]; /* fn_contents should not be used after allocation */
   silc_obj saved_arg_value_pairs = SILC_OBJ_NIL;
 
   /* prepare environment */
@@ -851,13 +1731,14 @@ static silc_obj call_lambda(struct silc_ctx_t* c, silc_obj arg_values, silc_obj*
       result = silc_err_from_code(SILC_ERR_INVALID_ARGS); /* invalid number of args */
       goto LRestore;
     }
-    silc_obj eval_arg = silc_eval(c, silc_car(c, val_it));
+    silc_obj eval_arg = silc_int_mem_handle(c->mem, silc_eval(c, silc_car(c, val_it)));
     if (silc_try_get_err_code(eval_arg) >= 0) {
       result = eval_arg;
       goto LRestore;
     }
 
-    new_env = silc_cons(c, silc_cons(c, sym, eval_arg), new_env);
+    silc_obj entry = silc_int_mem_handle(c->mem, silc_cons(c, sym, eval_arg));
+    new_env = silc_int_mem_handle(c->mem, silc_cons(c, entry, new_env));
 
     /* go to next value */
     val_it = silc_cdr(c, val_it);
@@ -875,14 +1756,15 @@ static silc_obj call_lambda(struct silc_ctx_t* c, silc_obj arg_values, silc_obj*
 
     /* save previous value */
     silc_obj prev_arg_value = silc_get_sym_info(c, arg_name, NULL);
-    saved_arg_value_pairs = silc_cons(c, silc_cons(c, arg_name, prev_arg_value), saved_arg_value_pairs);
+    silc_obj saved_pair = silc_int_mem_handle(c->mem, silc_cons(c, arg_name, prev_arg_value));
+    saved_arg_value_pairs = silc_int_mem_handle(c->mem, silc_cons(c, saved_pair, saved_arg_value_pairs));
 
     /* ...and associate it with a new one */
     silc_set_sym_assoc(c, arg_name, arg_value);
   }
 
   /* eval function body */
-  result = silc_eval(c, fn_contents[2]);
+  result = silc_eval(c, body);
 
 LRestore:
   restore_args(c, saved_arg_value_pairs);
@@ -892,14 +1774,16 @@ LRestore:
 }
 
 static silc_obj eval_cons_or_return_error(struct silc_ctx_t* c, silc_obj cons) {
-  /* Parse cons */
+  /* Parse cons, cons contents should not be used after evaluation as garbage collector might move them */
   silc_obj* cons_contents = silc_parse_cons(c->mem, cons);
+  silc_obj arg_values = cons_contents[1];
 
   /* Get CAR and try evaluate it to function */
   SILC_CHECKED_DECLARE(fn, silc_eval(c, cons_contents[0]));
   if (SILC_GET_TYPE(fn) != SILC_TYPE_OREF) {
     return silc_err_from_code(SILC_ERR_NOT_A_FUNCTION);
   }
+  silc_int_mem_handle(c->mem, fn); /* function might be a newly created one, e.g. ((lambda (x) x) 1) */
 
   int len = 0;
   silc_obj* fn_contents = NULL;
@@ -912,21 +1796,31 @@ static silc_obj eval_cons_or_return_error(struct silc_ctx_t* c, silc_obj cons) {
   /* parse function */
   int fn_flags = silc_obj_to_int(fn_contents[0]);
 
+  if (c->alloc_profile != NULL) {
+    push_frame(c, silc_parse_cons(c->mem, cons)[0]);
+  }
+
   silc_obj result;
   if (fn_flags & SILC_FN_BUILTIN) {
-    result = call_builtin(c, cons_contents[1], fn_contents, fn_flags & SILC_FN_SPECIAL);
+    result = call_builtin(c, arg_values, fn_contents, fn_flags & SILC_FN_SPECIAL);
   } else {
-    result = call_lambda(c, cons_contents[1], fn_contents);
+    result = call_lambda(c, arg_values, fn_contents);
+  }
+
+  if (c->alloc_profile != NULL) {
+    --c->alloc_profile->frame_count;
   }
 
   return result;
 }
 
+/** Evaluates the form, result is not registered as a handle, so the caller should do it before allocation */
 static silc_obj eval_cons(struct silc_ctx_t* c, silc_obj cons) {
-  struct silc_int_alloc_mode_t prev_mode;
-  silc_int_mem_set_auto_mark_roots(c->mem, &prev_mode);
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(c->mem, &scope);
+  silc_int_mem_handle(c->mem, cons); /* evaluated form should be kept alive during evaluation */
   silc_obj result = eval_cons_or_return_error(c, cons);
-  silc_int_mem_restore_roots(c->mem, &prev_mode);
+  silc_int_mem_close_handle_scope(c->mem, &scope);
   return result;
 }
 
@@ -939,7 +1833,7 @@ static silc_obj eval_oref(struct silc_ctx_t* c, silc_obj o) {
   }
 
   /* object is a symbol, we need to return an association */
-  return contents[2];
+  return *get_sym_assoc_cell(c, o, contents);
 }
 
 silc_obj silc_eval(struct silc_ctx_t* c, silc_obj o) {
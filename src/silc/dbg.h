@@ -20,12 +20,12 @@ static inline void dbg_silc_dump_heap_pos(struct silc_mem_t* mem) {
   /* heap state dump */
   for (int i = 0; i < mem->pos_count; ++i) {
     silc_obj fpos = mem->buf[mem->last_pos_index - i];
-    fprintf(stderr, "\t[DBG] heap_pos[%d]=0x%08X (index=%d, gc_mark=%s, type=%d)\n",
+    fprintf(stderr, "\t[DBG] heap_pos[%d]=0x%08llX (index=%d, gc_mark=%s, type=%d)\n",
       i,
-      fpos,
+      (unsigned long long) fpos,
       (int) (fpos >> SILC_INT_MEM_POS_SHIFT),
-      ((fpos & SILC_INT_MEM_POS_GC_BIT) ? "yes" : "no"),
-      fpos & SILC_INT_TYPE_MASK);
+      (silc_int_mem_is_pos_marked(mem, i) ? "yes" : "no"),
+      (int) (fpos & SILC_INT_TYPE_MASK));
   }
 }
 
@@ -41,51 +41,65 @@ static inline void dbg_silc_dump_gc_stats(struct silc_mem_t* mem, FILE* out) {
     ";;   Usable Memory:    %8d unit(s)\n"
     ";;   Pos Count:        %8d unit(s)\n"
     ";;   Free Pos Count:   %8d unit(s)\n"
+    ";;   Cons Capacity:    %8d cell(s)\n"
+    ";;   Cons Count:       %8d cell(s)\n"
     ";;\n",
-    stats.total_memory, stats.free_memory, stats.usable_memory, stats.pos_count, stats.free_pos_count);
+    stats.total_memory, stats.free_memory, stats.usable_memory, stats.pos_count, stats.free_pos_count,
+    stats.cons_capacity, stats.cons_count);
+
+  const struct silc_mem_gc_counters_t* counters = silc_int_mem_get_gc_counters(mem);
+  fprintf(out,
+    ";;   GC Count:         %8lld\n"
+    ";;   Minor GC Count:   %8lld\n"
+    ";;   Total Pause:      %8lld us\n"
+    ";;   Max Pause:        %8lld us\n"
+    ";;   Reclaimed Memory: %8lld byte(s)\n"
+    ";;   Moved Memory:     %8lld byte(s)\n"
+    ";;\n",
+    counters->gc_count, counters->minor_gc_count, counters->total_pause_ns / 1000, counters->max_pause_ns / 1000,
+    counters->reclaimed_bytes, counters->moved_bytes);
 
   /* heap dump */
   fputs(";; [DBG] Heap:\n", out);
   for (int i = 0; i < mem->pos_count; ++i) {
     silc_obj fpos = mem->buf[mem->last_pos_index - i];
-    if (fpos == SILC_INT_MEM_FREE_POS) {
+    if (SILC_INT_MEM_IS_FREE_POS(fpos)) {
       fprintf(out, ";; [DBG] heap_pos[%d]=FREE\n", i);
       continue;
     }
     int obj_pos = (int) (fpos >> SILC_INT_MEM_POS_SHIFT);
     int type = SILC_GET_TYPE(fpos);
-    fprintf(out, ";; [DBG] heap_pos[%d]=0x%08X, obj_index=%d, gc_mark=%s, type=%d\n",
+    fprintf(out, ";; [DBG] heap_pos[%d]=0x%08llX, %s=%d, gc_mark=%s, type=%d\n",
       i,
-      fpos,
+      (unsigned long long) fpos,
+      ((fpos & SILC_INT_MEM_POS_LARGE_BIT) ? "large_obj_slot" : "obj_index"),
       obj_pos,
-      ((fpos & SILC_INT_MEM_POS_GC_BIT) ? "yes" : "no"),
+      (silc_int_mem_is_pos_marked(mem, i) ? "yes" : "no"),
       type);
 
     fputs(";; [DBG] object: ", out);
-    silc_obj* o = mem->buf + obj_pos;
+    silc_obj obj = (((silc_obj) i) << SILC_INT_TYPE_SHIFT) | type;
+    silc_obj* o;
+    int subtype;
     int len;
     switch (type) {
-    case SILC_TYPE_CONS:
-      fprintf(out, "%X %X", o[0], o[1]);
-      break;
-
     case SILC_TYPE_OREF:
-      len = silc_obj_to_int(o[1]);
-      fprintf(out, "oref subtype=%d len=%d |", silc_obj_to_int(o[0]), len);
+      o = silc_int_mem_get_ref(mem, obj, &subtype, &len);
+      fprintf(out, "oref subtype=%d len=%d |", subtype, len);
       for (int j = 0; j < len; ++j) {
-        fprintf(out, " %X", o[2 + j]);
+        fprintf(out, " %llX", (unsigned long long) o[j]);
       }
       break;
 
     case SILC_TYPE_BREF:
-      len = silc_obj_to_int(o[1]);
-      fprintf(out, "bref subtype=%d len=%d |", silc_obj_to_int(o[0]), len);
+      o = silc_int_mem_get_ref(mem, obj, &subtype, &len);
+      fprintf(out, "bref subtype=%d len=%d |", subtype, len);
       for (int j = 0; j < len; ++j) {
-        fprintf(out, " %02X", ((char *)(o + 2))[j]);
+        fprintf(out, " %02X", ((char *) o)[j]);
       }
       fputs(" | ", out);
       for (int j = 0; j < len; ++j) {
-        char c = ((char *)(o + 2))[j];
+        char c = ((char *) o)[j];
         fprintf(out, "%c", ((c >= 32 && c < 127) ? c : '.'));
       }
       break;
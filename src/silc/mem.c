@@ -12,408 +12,3221 @@
  * limitations under the License.
  */
 
+#define _DEFAULT_SOURCE /* clock_gettime, anonymous mmap and madvise */
+
 #include "mem.h"
 
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+static void pos_vec_add(struct silc_mem_t* mem, struct silc_mem_pos_vec_t* vec, int pos) {
+  if (vec->count == vec->capacity) {
+    int new_capacity = vec->capacity * 2 + 16;
+    int* new_arr = mem->init->alloc_mem(sizeof(int) * new_capacity);
+    if (vec->arr != NULL) {
+      memcpy(new_arr, vec->arr, sizeof(int) * vec->count);
+      mem->init->free_mem(vec->arr);
+    }
+    vec->arr = new_arr;
+    vec->capacity = new_capacity;
+  }
 
-/** How big silc_obj array should be to fit byte_count bytes? */
-static inline int silc_obj_count_from_byte_count(int byte_count) {
-  SILC_ASSERT(byte_count >= 0);
-  return ((byte_count + sizeof(silc_obj) - 1) / sizeof(silc_obj));
+  vec->arr[vec->count++] = pos;
 }
 
-static silc_obj * get_contents_and_mark(struct silc_mem_t * mem, silc_obj obj) {
-  int pos_index = silc_int_mem_get_pos_index(mem, obj);
-  silc_obj pos_fval = mem->buf[pos_index];
-  silc_obj * result;
-
-  if (pos_fval & SILC_INT_MEM_POS_GC_BIT) {
-    result = NULL; /* object has already been marked */
-  } else {
-    /* object has not been marked, mark it and return its contents */
-    mem->buf[pos_index] = pos_fval | SILC_INT_MEM_POS_GC_BIT;
-    result = mem->buf + (pos_fval >> SILC_INT_MEM_POS_SHIFT);
+static void pos_vec_free(struct silc_mem_t* mem, struct silc_mem_pos_vec_t* vec) {
+  if (vec->arr != NULL) {
+    mem->init->free_mem(vec->arr);
   }
+}
 
-  return result;
+/**
+ * Mark stack entry is either an object reference position or the complement of a cons cell index,
+ * so that entries fit int regardless of silc_obj width. Byte references and inline objects are never pushed.
+ */
+static inline int to_mark_entry(silc_obj obj) {
+  int index = (int) (obj >> SILC_INT_TYPE_SHIFT);
+  return SILC_GET_TYPE(obj) == SILC_TYPE_CONS ? ~index : index;
 }
 
-static void gc_mark(struct silc_mem_t * mem, silc_obj v) {
-  silc_obj * t;
+static inline silc_obj from_mark_entry(int entry) {
+  if (entry < 0) {
+    return (((silc_obj) ~entry) << SILC_INT_TYPE_SHIFT) | SILC_TYPE_CONS;
+  }
+  return (((silc_obj) entry) << SILC_INT_TYPE_SHIFT) | SILC_TYPE_OREF;
+}
 
-  switch (SILC_GET_TYPE(v)) {
-    case SILC_TYPE_CONS:
-      t = get_contents_and_mark(mem, v);
-      if (t == NULL) {
-        break;
-      }
+#define SILC_INT_MEM_DEFAULT_MAX_MARK_STACK_SIZE  (1024 * 1024)
 
-      gc_mark(mem, t[0]); /* cons.car */
-      gc_mark(mem, t[1]); /* cons.cdr */
-      break;
+static int get_max_mark_stack_size(struct silc_mem_t* mem) {
+  int max_mark_stack_size = mem->init->max_mark_stack_size;
+  return max_mark_stack_size > 0 ? max_mark_stack_size : SILC_INT_MEM_DEFAULT_MAX_MARK_STACK_SIZE;
+}
 
-    case SILC_TYPE_OREF: /* contents: sequence of silc_obj */
-      t = get_contents_and_mark(mem, v);
-      if (t == NULL) {
-        break;
-      }
+/** Returns upper bound of the position numbers, positions are heap indexes in the direct mode */
+static int get_pos_limit(struct silc_mem_t* mem) {
+#ifdef SILC_DIRECT_OBJ
+  return mem->avail_index;
+#else
+  return mem->pos_count;
+#endif
+}
 
-      { /* handle nested objects */
-        int size = silc_obj_to_int(t[1]);
-        for (int i = 0; i < size; ++i) {
-          gc_mark(mem, t[i + 2]);
-        }
-      }
-      break;
+/** Returns size of the position table in silc_obj units, there is no position table in the direct mode */
+static int get_pos_table_size(struct silc_mem_t* mem) {
+#ifdef SILC_DIRECT_OBJ
+  return 0;
+#else
+  return mem->pos_count;
+#endif
+}
 
-    case SILC_TYPE_BREF: /* contents: unknown, but no GC-able things, mark and return */
-      get_contents_and_mark(mem, v);
-      break;
+/** Returns type of the object at the given occupied position */
+static int get_pos_type(struct silc_mem_t* mem, int pos) {
+#ifdef SILC_DIRECT_OBJ
+  return SILC_INT_MEM_TEST_BIT(mem->bref_bits, pos) ? SILC_TYPE_BREF : SILC_TYPE_OREF;
+#else
+  return mem->buf[mem->last_pos_index - pos] & SILC_INT_TYPE_MASK;
+#endif
+}
+
+/** Grows mark bitmap, so that it covers all the positions, existing marks are preserved */
+static void ensure_mark_bits(struct silc_mem_t* mem) {
+  int size = (get_pos_limit(mem) + SILC_INT_MEM_BITMAP_WORD_BITS - 1) / SILC_INT_MEM_BITMAP_WORD_BITS;
+  if (size <= mem->mark_bits_size) {
+    return;
+  }
+
+  int new_size = mem->mark_bits_size * 2 > size ? mem->mark_bits_size * 2 : size;
+  unsigned int* new_bits = mem->init->alloc_mem(sizeof(unsigned int) * new_size);
+  if (mem->mark_bits != NULL) {
+    memcpy(new_bits, mem->mark_bits, sizeof(unsigned int) * mem->mark_bits_size);
+    mem->init->free_mem(mem->mark_bits);
   }
+  memset(new_bits + mem->mark_bits_size, 0, sizeof(unsigned int) * (new_size - mem->mark_bits_size));
+
+  mem->mark_bits = new_bits;
+  mem->mark_bits_size = new_size;
 }
 
-static void mark_root_objects(struct silc_mem_t* mem) {
-  /* TODO: optimize by not looking into the entire object contents */
-  gc_mark(mem, mem->root_vector);
+#ifndef SILC_DIRECT_OBJ
+static void clear_mark_bits(struct silc_mem_t* mem) {
+  if (mem->mark_bits != NULL) {
+    memset(mem->mark_bits, 0, sizeof(unsigned int) * mem->mark_bits_size);
+  }
 }
+#endif
 
-static void init_heap(struct silc_mem_t* mem, struct silc_mem_init_t* init) {
-  int init_memory_size = init->init_memory_size;
-  if (init_memory_size < 4) {
-    fputs(";; [FATAL] init memory size is too small\n", stderr);
-    abort();
+/* min_index of the full marking, minor one passes young_index, that is zero until the first object survives */
+#define SILC_INT_MEM_FULL_MARKING         (-1)
+
+/** Marks an object and returns true if it has not been marked before and it resides at or above min_index */
+static bool gc_try_mark(struct silc_mem_t* mem, silc_obj obj, int min_index) {
+  if (SILC_GET_TYPE(obj) == SILC_TYPE_INL || silc_int_mem_is_shared(obj)) {
+    return false; /* shared objects are never collected, so they are never scanned */
   }
 
-  mem->buf = init->alloc_mem(sizeof(silc_obj) * init_memory_size);
-  mem->last_pos_index = init_memory_size - 1;
-  mem->avail_index = 0;
-  mem->pos_count = 0;
-  mem->cached_last_occupied_pos_index = 0;
-}
+  int pos = (int) (obj >> SILC_INT_TYPE_SHIFT);
+  if (SILC_GET_TYPE(obj) == SILC_TYPE_CONS) {
+    if (SILC_INT_MEM_TEST_BIT(mem->cons_mark_bits, pos) ||
+        (min_index >= 0 && pos < mem->young_cell_index && !SILC_INT_MEM_TEST_BIT(mem->cons_young_bits, pos))) {
+      return false; /* cell has already been marked or it is out of the collected generation */
+    }
 
-/**
- * Tries to allocate n consecutive blocks (silc_obj[n]) in the heap.
- * Total size of the allocated memory is <code>n * sizeof(silc_obj)</code> bytes.
- * Returns index of position that contains index of the available sequence or -1 if heap is full.
- *
- * @param mem Managed memory context
- * @param n Count of silc_obj units to be allocated
- * @param type Type information to be propagated to pos (duplicates type info embedded into silc_obj)
- * @return Index of position index or -1 if allocation failed
- */
-static int try_alloc(struct silc_mem_t * mem, int n, int type) {
-  int new_pos_index = mem->pos_count;
-  int new_pos_count = mem->pos_count;
+    SILC_INT_MEM_SET_BIT(mem->cons_mark_bits, pos);
+    return true;
+  }
 
-  /* try find vacant position */
-  for (int i = mem->cached_last_occupied_pos_index; i < mem->pos_count; ++i) {
-    int pos_idx = (int) mem->buf[mem->last_pos_index - i];
-    if (pos_idx == SILC_INT_MEM_FREE_POS) {
-      new_pos_index = i;
-      goto LPosFound;
+  unsigned int* word = mem->mark_bits + pos / SILC_INT_MEM_BITMAP_WORD_BITS;
+  unsigned int bit = 1U << (pos % SILC_INT_MEM_BITMAP_WORD_BITS);
+  if (*word & bit) {
+    return false; /* object has already been marked */
+  }
+
+  /* position word is only read by the minor collection, large objects are never young */
+  if (min_index >= 0) {
+    silc_obj pos_fval = mem->buf[silc_int_mem_get_pos_index(mem, obj)];
+    if ((pos_fval & SILC_INT_MEM_POS_LARGE_BIT) || (int) (pos_fval >> SILC_INT_MEM_POS_SHIFT) < min_index) {
+      return false; /* object is out of the collected generation */
     }
   }
 
-  /* no vacant position, addition of a new one is required */
-  ++new_pos_count;
+  *word |= bit;
+  return true;
+}
 
-LPosFound:
-  /* optimization: start looking up for the next vacant index without reiterating over occupied cells */
-  mem->cached_last_occupied_pos_index = new_pos_index + 1;
+/**
+ * Shades an object gray: marks it and pushes it to the mark stack unless it has already been marked.
+ * Byte references have no nested objects and thus become black right away.
+ * If mark stack is full, the object stays marked but unscanned and the heap is rescanned later, see gc_rescan.
+ */
+static void gc_shade(struct silc_mem_t* mem, silc_obj obj, int min_index) {
+  if (!gc_try_mark(mem, obj, min_index) || SILC_GET_TYPE(obj) == SILC_TYPE_BREF) {
+    return;
+  }
 
-  /* calculate new available index */
-  int new_avail_index = mem->avail_index + n;
-  int result = -1;
+  if (mem->mark_stack.count < get_max_mark_stack_size(mem)) {
+    pos_vec_add(mem, &mem->mark_stack, to_mark_entry(obj));
+  } else {
+    mem->mark_stack_overflow = true;
+  }
+}
 
-  /* allocation succeeds if heap is not empty */
-  if (new_avail_index <= (mem->last_pos_index - new_pos_count)) {
-    /* ok, the heap has enough space to place n blocks, update heap state */
-    result = new_pos_index;
+/** Returns count of the strongly referenced elements of the object reference, weak reference has none */
+static inline int get_traced_length(silc_obj* t) {
+  return silc_int_mem_get_obj_subtype(t) == SILC_OREF_WEAK_REF_SUBTYPE ? 0 : silc_int_mem_get_obj_length(t);
+}
 
-    /* record currently available index */
-    mem->buf[mem->last_pos_index - new_pos_index] = (mem->avail_index << SILC_INT_MEM_POS_SHIFT) | type;
+/** Shades objects, referenced from the given object, returns amount of scanned silc_obj units */
+static int gc_scan(struct silc_mem_t* mem, silc_obj obj, int min_index) {
+  silc_obj* t = silc_int_mem_get_contents(mem, obj);
+  int from = 0;
+  int to = 2;
 
-    /* update position indexes counter */
-    mem->pos_count = new_pos_count;
+  if (SILC_GET_TYPE(obj) == SILC_TYPE_OREF) {
+    from = silc_int_mem_get_obj_header_size(t);
+    to = from + get_traced_length(t);
+  }
 
-    /* update next available index */
-    mem->avail_index = new_avail_index;
+  for (int i = from; i < to; ++i) {
+    gc_shade(mem, t[i], min_index);
   }
 
-  return result;
+  return to;
 }
 
-static int alloc_or_fail(struct silc_mem_t * mem, int n, int type) {
-  int result;
-  int gc_attempted = 0;
+/**
+ * Blackens gray object and returns amount of scanned silc_obj units.
+ * Cdr chains are followed in a loop rather than through the mark stack, until the given budget is exhausted.
+ */
+static int gc_blacken(struct silc_mem_t* mem, silc_obj obj, int min_index, int budget) {
+  int work = 0;
+
+  while (SILC_GET_TYPE(obj) == SILC_TYPE_CONS) {
+    silc_obj* t = silc_int_mem_get_contents(mem, obj);
+    gc_shade(mem, t[0], min_index); /* cons.car */
+    work += 2;
+
+    silc_obj cdr = t[1];
+    if (work >= budget || SILC_GET_TYPE(cdr) != SILC_TYPE_CONS) {
+      gc_shade(mem, cdr, min_index);
+      return work;
+    }
 
-LTryAlloc:
-  result = try_alloc(mem, n, type);
-  if (result < 0) {
-    if (gc_attempted) {
-      mem->init->oom_abort(mem->init);
-    } else {
-      silc_int_mem_gc(mem);
-      gc_attempted = 1;
-      goto LTryAlloc;
+    if (!gc_try_mark(mem, cdr, min_index)) {
+      return work; /* the rest of the list has already been marked */
     }
+    obj = cdr;
   }
 
-  return result;
+  return work + gc_scan(mem, obj, min_index);
+}
+
+/** Shades objects, referenced from the given cell, if it is marked */
+static void gc_rescan_cell(struct silc_mem_t* mem, int cell, int min_index) {
+  if (SILC_INT_MEM_TEST_BIT(mem->cons_mark_bits, cell)) {
+    gc_scan(mem, (((silc_obj) cell) << SILC_INT_TYPE_SHIFT) | SILC_TYPE_CONS, min_index);
+  }
 }
 
-static void update_positions(struct silc_mem_t* mem, int pos_index, int obj_size) {
-  for (int j = pos_index; j < mem->pos_count; ++j) {
-    silc_obj fpos = mem->buf[mem->last_pos_index - j];
-    if (fpos == SILC_INT_MEM_FREE_POS) {
-      continue; /* no need to update free position cell */
+/**
+ * Recovers from the mark stack overflow: shades objects, referenced from every marked object of the collected
+ * generation, so that marked objects, that have not been pushed to the mark stack, get scanned.
+ */
+static void gc_rescan(struct silc_mem_t* mem, int min_index) {
+  mem->mark_stack_overflow = false;
+
+  /* young objects are listed in the young logs, full collection has to look through the position table and cells */
+  int count = min_index >= 0 ? mem->young_pos.count : get_pos_limit(mem);
+  for (int i = 0; i < count; ++i) {
+    int pos = min_index >= 0 ? mem->young_pos.arr[i] : i;
+    if (!silc_int_mem_is_pos_marked(mem, pos)) {
+      continue;
+    }
+
+    int type = get_pos_type(mem, pos);
+    if (type == SILC_TYPE_BREF) {
+      continue;
     }
 
-    int type = fpos & SILC_INT_TYPE_MASK;
-    int obj_pos = fpos >> SILC_INT_MEM_POS_SHIFT;
+    gc_scan(mem, (((silc_obj) pos) << SILC_INT_TYPE_SHIFT) | type, min_index);
+  }
 
-    /* update position */
-    mem->buf[mem->last_pos_index - j] = ((obj_pos - obj_size) << SILC_INT_MEM_POS_SHIFT) | type;
+  /* young cells are the logged ones and the ones at or above young_cell_index */
+  for (int i = 0; min_index >= 0 && i < mem->young_cells.count; ++i) {
+    gc_rescan_cell(mem, mem->young_cells.arr[i], min_index);
+  }
+  for (int cell = min_index >= 0 ? mem->young_cell_index : 0; cell < mem->cons_count; ++cell) {
+    gc_rescan_cell(mem, cell, min_index);
   }
 }
 
-#define SILC_INT_MEM_INITIAL_ROOT_VECTOR_SIZE     (1000)
+/**
+ * Blackens gray objects until either the given amount of work (in silc_obj units) is done or
+ * there are no gray objects left. Returns true if marking is complete.
+ */
+static bool gc_drain(struct silc_mem_t* mem, int min_index, int budget) {
+  int work = 0;
 
-static silc_obj create_root_vector(struct silc_mem_t* mem, int size) {
-  silc_obj root_vector = silc_int_mem_alloc(mem, size + 2, NULL, SILC_TYPE_OREF, SILC_OREF_ROOT_VECTOR_SUBTYPE);
+  while (work < budget) {
+    if (mem->mark_stack.count == 0) {
+      if (!mem->mark_stack_overflow) {
+        return true;
+      }
 
-  silc_obj* rv = silc_get_oref(mem, root_vector, NULL);
+      gc_rescan(mem, min_index);
+      continue;
+    }
 
-  rv[0] = silc_int_to_obj(size); /* total capacity */
-  rv[1] = SILC_OBJ_ZERO; /* current size */
+    silc_obj obj = from_mark_entry(mem->mark_stack.arr[--mem->mark_stack.count]);
+    work += gc_blacken(mem, obj, min_index, budget - work);
+  }
 
-  return root_vector;
+  return mem->mark_stack.count == 0 && !mem->mark_stack_overflow;
 }
 
-/* External functions */
+/**
+ * Shades root objects: root vector entries up to its size rather than its capacity and registered handles.
+ * Root vector itself is marked without being scanned.
+ */
+static void gc_shade_roots(struct silc_mem_t* mem, int min_index) {
+  gc_try_mark(mem, mem->root_vector, min_index);
 
-void silc_int_mem_init(struct silc_mem_t* new_mem, struct silc_mem_init_t* init) {
-  new_mem->init = init;
-  init_heap(new_mem, init);
+  silc_obj* rv = silc_get_oref(mem, mem->root_vector, NULL);
+  int size = silc_obj_to_int(rv[1]);
+  for (int i = 0; i < size; ++i) {
+    gc_shade(mem, rv[2 + i], min_index);
+  }
 
-  /* Alloc root vector */
-  if (init->init_root_vector_size <= 0) {
-    init->init_root_vector_size = SILC_INT_MEM_INITIAL_ROOT_VECTOR_SIZE;
+  for (int i = 0; i < mem->handle_count; ++i) {
+    gc_shade(mem, mem->handles[i], min_index);
   }
-  new_mem->root_vector = create_root_vector(new_mem, init->init_root_vector_size);
 }
 
-void silc_int_mem_free(struct silc_mem_t * mem) {
-  mem->init->free_mem(mem->buf);
+/*
+ * Collection pacing.
+ * Full collection is started once the memory, allocated since the last one, reaches the trigger, rather than once
+ * the heap is full. If L units are live after collection and share s of the allocated memory survives, then once
+ * A more units are allocated, live objects take (L + s * A) / (L + A) of the used memory, trigger makes it equal
+ * to the target occupancy T: A = L * (1 - T) / (T - s). It is GOGC rule if nothing survives, and collection is left
+ * to the heap overflow if survival rate reaches the target, since collecting earlier would not reclaim more.
+ */
+
+/* Target occupancy, silc_int_mem_gc_hint relies on, if it has not been set */
+#define SILC_INT_MEM_DEFAULT_TARGET_OCCUPANCY     (50)
+
+/** Returns memory, occupied by the objects (excluding positions), in silc_obj units */
+static long long get_used_memory(struct silc_mem_t* mem) {
+  return (long long) silc_int_mem_get_alloc_index(mem) + mem->large_object_memory +
+      2LL * (mem->cons_count - mem->cons_free_count);
 }
 
-void silc_int_mem_add_root(struct silc_mem_t* mem, silc_obj o) {
-  /* unfold root vector */
-  silc_obj* rv = silc_get_oref(mem, mem->root_vector, NULL);
-  int capacity = silc_obj_to_int(rv[0]);
-  int size = silc_obj_to_int(rv[1]);
-  silc_obj* arr = rv + 2;
+/** Returns memory, allocated since the heap initialization, in silc_obj units */
+static long long get_total_alloc(struct silc_mem_t* mem) {
+  long long bytes = 0;
+  for (int type = SILC_TYPE_CONS; type <= SILC_TYPE_BREF; ++type) {
+    bytes += mem->gc_counters.alloc_by_type[type].bytes;
+  }
+  return bytes / (long long) sizeof(silc_obj);
+}
 
-  /* update size and check that it is within the desired capacity */
-  int new_size = size + 1;
-  if (new_size > capacity) {
-    /* resize root vector */
-    int new_capacity = capacity * 2;
-    silc_obj new_root_vector = create_root_vector(mem, new_capacity);
-    /* copy contents */
-    silc_obj* new_rv = silc_get_oref(mem, new_root_vector, NULL);
-    memcpy(new_rv, rv, sizeof(silc_obj) * new_capacity);
-    rv[0] = silc_int_to_obj(new_capacity);
+/** Returns memory, that can be allocated before the full collection is due, LLONG_MAX if pacing is disabled */
+static long long get_alloc_until_gc(struct silc_mem_t* mem) {
+  if (mem->init->gc_target_occupancy <= 0) {
+    return LLONG_MAX;
+  }
 
-    /* update root vector pointer and retry operation */
-    mem->root_vector = new_root_vector;
+  long long left = mem->gc_trigger - (get_total_alloc(mem) - mem->gc_alloc_base);
+  return left > 0 ? left : 0;
+}
+
+/** Updates survival rate and trigger of the next collection, should be called once full collection is done */
+static void update_gc_trigger(struct silc_mem_t* mem) {
+  long long total_alloc = get_total_alloc(mem);
+  long long allocated = total_alloc - mem->gc_alloc_base;
+  long long live = get_used_memory(mem);
+  if (allocated > 0) {
+    /* growth of the live memory is attributed to the allocation, so that dying old objects lower the estimate */
+    long long survived = live > mem->last_gc_live ? live - mem->last_gc_live : 0;
+    int rate = survived < allocated ? (int) (survived * 100 / allocated) : 100;
+    mem->survival_percent = (mem->survival_percent + rate) / 2;
+  }
+  mem->gc_alloc_base = total_alloc;
+  mem->last_gc_live = live;
+
+  int target = mem->init->gc_target_occupancy > 0 ? mem->init->gc_target_occupancy :
+      SILC_INT_MEM_DEFAULT_TARGET_OCCUPANCY;
+  target = target < 100 ? target : 99;
+  if (mem->survival_percent >= target) {
+    mem->gc_trigger = LLONG_MAX;
     return;
   }
 
-  /* add an object and update size */
-  arr[size] = o;
-  rv[1] = silc_int_to_obj(new_size);
+  /* small heaps are not collected more often than once a quarter of the initial heap is allocated */
+  long long min_trigger = mem->init->init_memory_size / 4;
+  long long trigger = live * (100 - target) / (target - mem->survival_percent);
+  mem->gc_trigger = trigger > min_trigger ? trigger : min_trigger;
 }
 
-void silc_int_mem_set_auto_mark_roots(struct silc_mem_t* mem, struct silc_int_alloc_mode_t* prev_mode) {
-  bool prev_auto_mark_enabled = mem->auto_mark_enabled;
-  mem->auto_mark_enabled = true;
+/** Recalculates the heap index, up to which objects can be allocated by the inline fast path */
+static void update_alloc_limit(struct silc_mem_t* mem) {
+  int limit = mem->last_pos_index;
 
-  /* unfold root vector */
-  silc_obj* rv = silc_get_oref(mem, mem->root_vector, NULL);
+  if (mem->marking) {
+    limit = -1; /* objects are allocated black by the slow path */
+  } else {
+    /* young conses take 2 units of the nursery each */
+    int nursery_limit = mem->young_index + mem->init->nursery_size - 2 * silc_int_mem_get_young_cell_count(mem);
+    if (mem->init->nursery_size > 0 && nursery_limit < limit) {
+      limit = nursery_limit; /* minor collection is due */
+    }
+
+    if (mem->init->gc_slice_budget > 0) {
+      /* incremental marking is due once either heap or cons region is half full, cons takes 2 units of the limit */
+      int marking_limit = mem->last_pos_index / 2 - get_pos_table_size(mem);
+      int cons_limit = silc_int_mem_get_alloc_index(mem) +
+          2 * (mem->cons_capacity / 2 - (mem->cons_count - mem->cons_free_count));
+      limit = marking_limit < limit ? marking_limit : limit;
+      limit = cons_limit < limit ? cons_limit : limit;
+    }
+
+    /* full collection is due once allocation reaches the trigger */
+    long long alloc_until_gc = get_alloc_until_gc(mem);
+    if (alloc_until_gc < limit - silc_int_mem_get_alloc_index(mem)) {
+      limit = silc_int_mem_get_alloc_index(mem) + (int) alloc_until_gc;
+    }
+  }
 
-  /* store previous size */
-  prev_mode->auto_mark_enabled = prev_auto_mark_enabled;
-  prev_mode->prev_size = silc_obj_to_int(rv[1]);
+  mem->alloc_limit_index = limit;
 }
 
-void silc_int_mem_restore_roots(struct silc_mem_t* mem, struct silc_int_alloc_mode_t* prev_mode) {
-  /* unfold root vector */
-  silc_obj* rv = silc_get_oref(mem, mem->root_vector, NULL);
+/*
+ * Allocation regions.
+ * Free lists are put aside while the regions are open, so that region objects are bump allocated on top of the heap
+ * and the cons region, and closing region releases them by restoring the allocation state. Write barrier marks
+ * the region escaped once a reference to its object is stored into an object older than the region, so that closing
+ * region does not scan anything but the handles, that are still registered. Escaped region and the one, that has been
+ * interrupted by a collection, is abandoned, i.e. its objects become ordinary ones.
+ */
 
-  /* get snapshot of root vector, that needs to be restored */
-  int head_size = prev_mode->prev_size;
-  int tail_size = silc_obj_to_int(rv[1]);
-  SILC_ASSERT(tail_size >= head_size);
-  silc_obj* arr = rv + 2;
+/** Returns true if the given object has been allocated in the given open region */
+static bool is_in_region(struct silc_region_t* region, silc_obj obj) {
+  int index = (int) (obj >> SILC_INT_TYPE_SHIFT);
+  if (silc_int_mem_is_shared(obj)) {
+    return false;
+  }
 
-  /* restore state */
-  mem->auto_mark_enabled = prev_mode->auto_mark_enabled;
-  rv[1] = silc_int_to_obj(prev_mode->prev_size);
+  switch (SILC_GET_TYPE(obj)) {
+    case SILC_TYPE_INL:
+      return false;
+
+    case SILC_TYPE_CONS:
+      return index >= region->cons_count;
 
-  /* nullify references */
-  for (int i = head_size; i < tail_size; ++i) {
-    arr[i] = SILC_OBJ_NIL;
+    default:
+      return index >= region->pos_limit;
   }
 }
 
-void silc_int_mem_gc(struct silc_mem_t * mem) {
-  mark_root_objects(mem);
+/** Returns true if some of the open regions have not been abandoned, the innermost ones are abandoned last */
+static bool has_live_regions(struct silc_mem_t* mem) {
+  return mem->region != NULL && !mem->region->abandoned;
+}
 
-  /* iterate over all the available objects and compactify memory */
-  /* start from the last element and move to the first to minimize amount of moved memory */
-  int can_shrink_pos_count = 1;
-  int initial_pos = mem->pos_count - 1;
-  for (int i = initial_pos; i >= 0; --i) {
-    int index_pos = mem->last_pos_index - i;
-    silc_obj pos_fval = mem->buf[index_pos];
-    /* is this position is free, i.e. points to nothing? */
-    if (pos_fval == SILC_INT_MEM_FREE_POS) {
-      if (can_shrink_pos_count) {
-        --mem->pos_count;
-      }
-      continue;
-    }
+static void swap_free_list_heads(int* lhs, int* rhs) {
+  int head = *lhs;
+  *lhs = *rhs;
+  *rhs = head;
+}
 
-    /* is this position belongs to the object marked as being referenced from the GC roots? */
-    if (pos_fval & SILC_INT_MEM_POS_GC_BIT) {
-      /* reset GC bit and continue */
-      mem->buf[index_pos] &= ~SILC_INT_MEM_POS_GC_BIT;
-      can_shrink_pos_count = 0; /* pos_count can no longer be shrinked */
-      continue;
-    }
+/** Puts free lists aside once the outermost live region is opened, restores them once it is closed or abandoned */
+static void swap_region_free_lists(struct silc_mem_t* mem) {
+  swap_free_list_heads(&mem->free_pos_head, &mem->region_free_pos_head);
+  swap_free_list_heads(&mem->cons_free_head, &mem->region_cons_free_head);
+#ifdef SILC_DIRECT_OBJ
+  for (int i = 0; i < SILC_INT_MEM_FREE_LIST_COUNT; ++i) {
+    swap_free_list_heads(mem->free_heads + i, mem->region_free_heads + i);
+  }
+#endif
+}
+
+/** Abandons open regions, should be called before objects are collected or allocated outside of the heap top */
+static void abandon_regions(struct silc_mem_t* mem) {
+  if (!has_live_regions(mem)) {
+    return;
+  }
 
-    /* ok, this object is not referenced from GC roots and thus it is eligible for garbage collection */
-    int fpos = mem->buf[index_pos];
+  for (struct silc_region_t* region = mem->region; region != NULL && !region->abandoned; region = region->prev) {
+    region->abandoned = true;
+  }
+  swap_region_free_lists(mem);
+}
 
-    /* mark position entry as free */
-    mem->buf[index_pos] = SILC_INT_MEM_FREE_POS;
+/** Starts incremental marking cycle, root vector becomes the only gray object */
+static void start_incremental_marking(struct silc_mem_t* mem) {
+  abandon_regions(mem);
+  ensure_mark_bits(mem);
+  mem->marking = true;
+  mem->alloc_limit_index = -1;
+  mem->alloc_since_slice = 0;
+  gc_shade_roots(mem, SILC_INT_MEM_FULL_MARKING);
+}
 
-    if (can_shrink_pos_count) {
-      --mem->pos_count; /* shrink position if possible */
-    }
+/**
+ * Completes incremental marking. Root vector and handles are modified without write barrier, so they are rescanned
+ * before the remaining gray objects are blackened.
+ */
+static void finish_incremental_marking(struct silc_mem_t* mem) {
+  gc_shade_roots(mem, SILC_INT_MEM_FULL_MARKING);
+  gc_drain(mem, SILC_INT_MEM_FULL_MARKING, INT_MAX);
+  mem->marking = false;
+  update_alloc_limit(mem);
+}
 
-    /* calculate object size and move memory */
-    int obj_index = fpos >> SILC_INT_MEM_POS_SHIFT;
-    silc_obj* obj_mem = mem->buf + obj_index;
-    int obj_size = -1;
-    switch (fpos & SILC_INT_TYPE_MASK) {
-      case SILC_TYPE_CONS:
-        obj_size = 2;
-        break;
+/** Makes all the objects old, should be called once collection is done */
+static void reset_young_generation(struct silc_mem_t* mem) {
+  for (int i = 0; i < mem->young_cells.count; ++i) {
+    SILC_INT_MEM_CLEAR_BIT(mem->cons_young_bits, mem->young_cells.arr[i]);
+  }
+  for (int i = 0; i < mem->remembered_cells.count; ++i) {
+    SILC_INT_MEM_CLEAR_BIT(mem->cons_remembered_bits, mem->remembered_cells.arr[i]);
+  }
 
-      case SILC_TYPE_OREF:
-        obj_size = 2 + silc_obj_to_int(obj_mem[1]);
-        break;
+  mem->young_index = mem->avail_index;
+  mem->young_cell_index = mem->init->nursery_size > 0 ? mem->cons_count : INT_MAX;
+  mem->young_pos.count = 0;
+  mem->remembered_pos.count = 0;
+  mem->young_cells.count = 0;
+  mem->remembered_cells.count = 0;
+}
 
-      case SILC_TYPE_BREF:
-        obj_size = 2 + silc_obj_count_from_byte_count(silc_obj_to_int(obj_mem[1]));
-        break;
+/*
+ * Parallel marking.
+ * Experimental and off by default, it is only enabled by gc_threads and not used by the contexts.
+ * Collecting thread and gc_threads helper threads mark the whole heap while the mutator is stopped.
+ * Every worker keeps a private mark stack and a shared deque, guarded by a mutex. Once the private stack grows,
+ * a batch of its entries is published to the shared deque, so that idle workers could steal it.
+ * Mark bits are set by atomic operations, so every object is scanned by exactly one worker.
+ * Idle workers yield a few times, while the others may publish more work, and then park until work is published
+ * or marking is complete, so that they do not burn the cores of the busy host.
+ */
+
+/* Count of mark stack entries, that are published to the shared deque at once */
+#define SILC_INT_MEM_PAR_MARK_BATCH_SIZE  (64)
+
+/* Count of yields, that idle worker makes before it parks */
+#define SILC_INT_MEM_PAR_MARK_SPIN_COUNT  (16)
+
+struct silc_mem_gc_worker_t {
+  struct silc_mem_t*        mem;
+  pthread_t                 thread;
+
+  /** Private mark stack, accessed by the owning worker only */
+  struct silc_mem_pos_vec_t local;
+
+  /** Shared deque of gray objects, that can be stolen by other workers */
+  pthread_mutex_t           lock;
+  struct silc_mem_pos_vec_t shared;
+};
+
+struct silc_mem_gc_pool_t {
+  /** Workers, the first one is run by the collecting thread, the others by the helper threads */
+  struct silc_mem_gc_worker_t* workers;
+  int                       worker_count;
+
+  /** Count of workers, that have run out of work, marking is complete once all the workers are idle */
+  int                       idle_count;
+
+  /** Count of idle workers, that wait for work_cond, they are woken up once work is published or marking is over */
+  int                       parked_count;
+  pthread_cond_t            work_cond;
+
+  /** Helper threads wait for the next marking epoch or for the shutdown */
+  pthread_mutex_t           lock;
+  pthread_cond_t            start_cond;
+  pthread_cond_t            done_cond;
+  int                       epoch;
+  int                       running_count;
+  bool                      shutdown;
+};
+
+static bool par_try_mark(struct silc_mem_t* mem, silc_obj obj) {
+  if (SILC_GET_TYPE(obj) == SILC_TYPE_INL || silc_int_mem_is_shared(obj)) {
+    return false;
+  }
+
+  int pos = (int) (obj >> SILC_INT_TYPE_SHIFT);
+  unsigned int* bits = SILC_GET_TYPE(obj) == SILC_TYPE_CONS ? mem->cons_mark_bits : mem->mark_bits;
+  unsigned int* word = bits + pos / SILC_INT_MEM_BITMAP_WORD_BITS;
+  unsigned int bit = 1U << (pos % SILC_INT_MEM_BITMAP_WORD_BITS);
+  if (__atomic_load_n(word, __ATOMIC_RELAXED) & bit) {
+    return false; /* cheap check, that avoids atomic write for the objects, that have already been marked */
+  }
+
+  return (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) == 0;
+}
+
+static void par_shade(struct silc_mem_gc_worker_t* w, silc_obj obj) {
+  struct silc_mem_t* mem = w->mem;
+  if (!par_try_mark(mem, obj) || SILC_GET_TYPE(obj) == SILC_TYPE_BREF) {
+    return;
+  }
+
+  if (w->local.count < get_max_mark_stack_size(mem)) {
+    pos_vec_add(mem, &w->local, to_mark_entry(obj));
+  } else {
+    __atomic_store_n(&mem->mark_stack_overflow, true, __ATOMIC_RELAXED); /* resolved by the sequential rescan */
+  }
+}
+
+static void par_blacken(struct silc_mem_gc_worker_t* w, silc_obj obj) {
+  struct silc_mem_t* mem = w->mem;
+
+  while (SILC_GET_TYPE(obj) == SILC_TYPE_CONS) {
+    silc_obj* t = silc_int_mem_get_contents(mem, obj);
+    par_shade(w, t[0]); /* cons.car */
+
+    silc_obj cdr = t[1];
+    if (SILC_GET_TYPE(cdr) != SILC_TYPE_CONS) {
+      par_shade(w, cdr);
+      return;
     }
 
-    /* paranoid check - this error shouldn't happen */
-    if (obj_size < 0) {
-      fputs(";; [FATAL] unable to calculate object size (unrecognized object type)\n", stderr);
-      abort();
+    if (!par_try_mark(mem, cdr)) {
       return;
     }
+    obj = cdr;
+  }
 
-    /* move memory starting from the object end to available index and update positions */
-    int mem_size = mem->avail_index - obj_index + obj_size;
-    memmove(obj_mem, obj_mem + obj_size, mem_size * sizeof(silc_obj));
-    update_positions(mem, i, obj_size);
-    mem->avail_index -= obj_size;
+  silc_obj* t = silc_int_mem_get_contents(mem, obj);
+  int size = get_traced_length(t);
+  int from = silc_int_mem_get_obj_header_size(t);
+  for (int i = 0; i < size; ++i) {
+    par_shade(w, t[i + from]);
   }
 }
 
-void silc_int_mem_calc_stats(struct silc_mem_t* mem, struct silc_mem_stats_t* stats) {
-  stats->total_memory = mem->last_pos_index + 1;
-  stats->pos_count = mem->pos_count;
-  stats->usable_memory = stats->total_memory - mem->pos_count - mem->avail_index;
+/** Moves up to count entries from the top of the source vector to the destination one */
+static void par_transfer(struct silc_mem_t* mem, struct silc_mem_pos_vec_t* from, struct silc_mem_pos_vec_t* to,
+                         int count) {
+  for (int i = 0; i < count && from->count > 0; ++i) {
+    pos_vec_add(mem, to, from->arr[--from->count]);
+  }
+}
 
-  /* calc free memory */
-  int free_pos_count = 0;
-  for (int i = 0; i < mem->pos_count; ++i) {
-    if (mem->buf[mem->last_pos_index - i] == SILC_INT_MEM_FREE_POS) {
-      ++free_pos_count;
+/** Takes a half of the victim's shared deque, returns false if there is nothing to take */
+static bool par_steal(struct silc_mem_gc_worker_t* w, struct silc_mem_gc_worker_t* victim) {
+  if (__atomic_load_n(&victim->shared.count, __ATOMIC_RELAXED) == 0) {
+    return false;
+  }
+
+  pthread_mutex_lock(&victim->lock);
+  par_transfer(w->mem, &victim->shared, &w->local, (victim->shared.count + 1) / 2);
+  pthread_mutex_unlock(&victim->lock);
+  return w->local.count > 0;
+}
+
+static bool par_has_shared_work(struct silc_mem_gc_pool_t* pool) {
+  for (int i = 0; i < pool->worker_count; ++i) {
+    if (__atomic_load_n(&pool->workers[i].shared.count, __ATOMIC_RELAXED) > 0) {
+      return true;
     }
   }
-  stats->free_memory = stats->usable_memory + free_pos_count;
-  stats->free_pos_count = free_pos_count;
+  return false;
 }
 
-silc_obj silc_int_mem_alloc(struct silc_mem_t* mem, int content_length, const void* content, int type, int subtype) {
-  int pos_index = -1;
-  silc_obj* p_layout;
+/** Wakes up parked workers, if any, should be called once work is published or all the workers are idle */
+static void par_unpark(struct silc_mem_gc_pool_t* pool) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST); /* orders publication before the check, see par_park */
+  if (__atomic_load_n(&pool->parked_count, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
 
-  switch (type) {
-    case SILC_TYPE_CONS:
-      SILC_ASSERT(content_length == 2 && subtype == SILC_INT_MEM_CONS_SUBTYPE);
-      pos_index = alloc_or_fail(mem, 2, type);
-      p_layout = mem->buf + (mem->buf[mem->last_pos_index - pos_index] >> SILC_INT_MEM_POS_SHIFT);
-      if (content != NULL) {
-        p_layout[0] = ((silc_obj *) content)[0]; /* car */
-        p_layout[1] = ((silc_obj *) content)[1]; /* cdr */
-      } else {
-        p_layout[0] = SILC_OBJ_NIL;
-        p_layout[1] = SILC_OBJ_NIL;
-      }
-      break;
+/** Waits until some work is published or all the workers are idle */
+static void par_park(struct silc_mem_gc_pool_t* pool) {
+  pthread_mutex_lock(&pool->lock);
+  __atomic_add_fetch(&pool->parked_count, 1, __ATOMIC_SEQ_CST); /* publishers see it before the check below */
+  if (__atomic_load_n(&pool->idle_count, __ATOMIC_SEQ_CST) < pool->worker_count && !par_has_shared_work(pool)) {
+    pthread_cond_wait(&pool->work_cond, &pool->lock);
+  }
+  __atomic_sub_fetch(&pool->parked_count, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&pool->lock);
+}
 
-    case SILC_TYPE_OREF:
-      SILC_ASSERT(content_length >= 0);
-      pos_index = alloc_or_fail(mem, 2 + content_length, type);
-      p_layout = mem->buf + (mem->buf[mem->last_pos_index - pos_index] >> SILC_INT_MEM_POS_SHIFT);
-      *p_layout++ = silc_int_to_obj(subtype);
-      *p_layout++ = silc_int_to_obj(content_length);
-      if (content_length > 0) {
-        if (content != NULL) {
-          memcpy(p_layout, content, content_length * sizeof(silc_obj));
-        } else {
-          memset(p_layout, 0, content_length * sizeof(silc_obj)); /* initializes contents with NILs */
-        }
+static void par_mark(struct silc_mem_gc_worker_t* w) {
+  struct silc_mem_t* mem = w->mem;
+  struct silc_mem_gc_pool_t* pool = mem->gc_pool;
+  int index = (int) (w - pool->workers);
+
+  for (;;) {
+    /* drain private stack, share some work if the own shared deque has been taken */
+    while (w->local.count > 0) {
+      par_blacken(w, from_mark_entry(w->local.arr[--w->local.count]));
+
+      if (w->local.count > SILC_INT_MEM_PAR_MARK_BATCH_SIZE && __atomic_load_n(&w->shared.count, __ATOMIC_RELAXED) == 0) {
+        pthread_mutex_lock(&w->lock);
+        par_transfer(mem, &w->local, &w->shared, SILC_INT_MEM_PAR_MARK_BATCH_SIZE);
+        pthread_mutex_unlock(&w->lock);
+        par_unpark(pool);
       }
-      break;
+    }
 
-    case SILC_TYPE_BREF:
-      SILC_ASSERT(content_length >= 0);
-      pos_index = alloc_or_fail(mem, 2 + silc_obj_count_from_byte_count(content_length), type);
-      p_layout = mem->buf + (mem->buf[mem->last_pos_index - pos_index] >> SILC_INT_MEM_POS_SHIFT);
-      *p_layout++ = silc_int_to_obj(subtype);
-      *p_layout++ = silc_int_to_obj(content_length);
-      if (content_length > 0) {
-        if (content != NULL) {
-          memcpy(p_layout, content, content_length);
-        } else {
-          memset(p_layout, 0, content_length); /* initializes contents with zeroes */
-        }
+    /* take work from the own shared deque first, then steal from the others */
+    bool found = false;
+    for (int i = 0; i < pool->worker_count && !found; ++i) {
+      found = par_steal(w, &pool->workers[(index + i) % pool->worker_count]);
+    }
+    if (found) {
+      continue;
+    }
+
+    /* terminate once all the workers are idle, i.e. no one can produce more work */
+    if (__atomic_add_fetch(&pool->idle_count, 1, __ATOMIC_SEQ_CST) == pool->worker_count) {
+      par_unpark(pool);
+      return;
+    }
+    for (int spin = 0;; ++spin) {
+      if (__atomic_load_n(&pool->idle_count, __ATOMIC_SEQ_CST) == pool->worker_count) {
+        return;
       }
-      break;
 
-    default:
-      SILC_ASSERT(!"Unknown object type");
-  }
+      if (par_has_shared_work(pool)) {
+        __atomic_sub_fetch(&pool->idle_count, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
 
-  silc_obj result;
-  if (pos_index >= 0) {
-    result = ((((silc_obj) pos_index) << SILC_INT_TYPE_SHIFT) | type);
-    if (mem->auto_mark_enabled) {
-      silc_int_mem_add_root(mem, result);
+      if (spin < SILC_INT_MEM_PAR_MARK_SPIN_COUNT) {
+        sched_yield();
+      } else {
+        par_park(pool);
+      }
+    }
+  }
+}
+
+static void* par_helper_thread(void* arg) {
+  struct silc_mem_gc_worker_t* w = arg;
+  struct silc_mem_gc_pool_t* pool = w->mem->gc_pool;
+  int seen_epoch = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->epoch == seen_epoch && !pool->shutdown) {
+      pthread_cond_wait(&pool->start_cond, &pool->lock);
+    }
+    if (pool->shutdown) {
+      break;
+    }
+    seen_epoch = pool->epoch;
+    pthread_mutex_unlock(&pool->lock);
+
+    par_mark(w);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->running_count == 0) {
+      pthread_cond_signal(&pool->done_cond);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+static void init_gc_pool(struct silc_mem_t* mem, int gc_threads) {
+  struct silc_mem_gc_pool_t* pool = mem->init->alloc_mem(sizeof(struct silc_mem_gc_pool_t));
+  pool->worker_count = gc_threads + 1;
+  pool->workers = mem->init->alloc_mem(sizeof(struct silc_mem_gc_worker_t) * pool->worker_count);
+  pool->idle_count = 0;
+  pool->parked_count = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start_cond, NULL);
+  pthread_cond_init(&pool->work_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+  pool->epoch = 0;
+  pool->running_count = 0;
+  pool->shutdown = false;
+  mem->gc_pool = pool;
+
+  for (int i = 0; i < pool->worker_count; ++i) {
+    struct silc_mem_gc_worker_t* w = pool->workers + i;
+    w->mem = mem;
+    w->local = (struct silc_mem_pos_vec_t) {0};
+    w->shared = (struct silc_mem_pos_vec_t) {0};
+    pthread_mutex_init(&w->lock, NULL);
+    if (i > 0 && pthread_create(&w->thread, NULL, par_helper_thread, w) != 0) {
+      fputs(";; [FATAL] unable to start GC thread\n", stderr);
+      abort();
+    }
+  }
+}
+
+static void free_gc_pool(struct silc_mem_t* mem) {
+  struct silc_mem_gc_pool_t* pool = mem->gc_pool;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->start_cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->worker_count; ++i) {
+    struct silc_mem_gc_worker_t* w = pool->workers + i;
+    if (i > 0) {
+      pthread_join(w->thread, NULL);
+    }
+    pthread_mutex_destroy(&w->lock);
+    pos_vec_free(mem, &w->local);
+    pos_vec_free(mem, &w->shared);
+  }
+
+  pthread_cond_destroy(&pool->done_cond);
+  pthread_cond_destroy(&pool->start_cond);
+  pthread_cond_destroy(&pool->work_cond);
+  pthread_mutex_destroy(&pool->lock);
+  mem->init->free_mem(pool->workers);
+  mem->init->free_mem(pool);
+  mem->gc_pool = NULL;
+}
+
+/** Marks objects, reachable from the root vector, by all the workers */
+static void par_mark_root_objects(struct silc_mem_t* mem) {
+  struct silc_mem_gc_pool_t* pool = mem->gc_pool;
+  struct silc_mem_gc_worker_t* w = pool->workers;
+
+  /* the collecting thread seeds the work, helper threads steal it once it is published */
+  pool->idle_count = 0;
+  par_try_mark(mem, mem->root_vector);
+  silc_obj* rv = silc_get_oref(mem, mem->root_vector, NULL);
+  int size = silc_obj_to_int(rv[1]);
+  for (int i = 0; i < size; ++i) {
+    par_shade(w, rv[2 + i]);
+  }
+  for (int i = 0; i < mem->handle_count; ++i) {
+    par_shade(w, mem->handles[i]);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  ++pool->epoch;
+  pool->running_count = pool->worker_count - 1;
+  pthread_cond_broadcast(&pool->start_cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  par_mark(w);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->running_count > 0) {
+    pthread_cond_wait(&pool->done_cond, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void mark_root_objects(struct silc_mem_t* mem) {
+  ensure_mark_bits(mem);
+  if (mem->gc_pool != NULL) {
+    par_mark_root_objects(mem);
+  } else {
+    gc_shade_roots(mem, SILC_INT_MEM_FULL_MARKING);
+  }
+
+  /* completes marking, rescans the heap if the mark stack has overflown */
+  gc_drain(mem, SILC_INT_MEM_FULL_MARKING, INT_MAX);
+}
+
+/** Returns object size in silc_obj units (including service information) */
+static int get_obj_size(silc_obj* obj_mem, int type) {
+  switch (type) {
+    case SILC_TYPE_CONS:
+      return 2;
+
+    case SILC_TYPE_OREF:
+    case SILC_TYPE_BREF:
+      return silc_int_mem_get_alloc_size(silc_int_mem_get_obj_length(obj_mem), type);
+  }
+
+  /* paranoid check - this error shouldn't happen */
+  fputs(";; [FATAL] unable to calculate object size (unrecognized object type)\n", stderr);
+  abort();
+  return -1;
+}
+
+#ifndef SILC_DIRECT_OBJ
+/** Returns zeroed GC bitmap of at least the given size (in words), the bitmap is reused between collections */
+static unsigned int* get_gc_bitmap(struct silc_mem_t* mem, int size) {
+  if (size > mem->gc_bitmap_size) {
+    if (mem->gc_bitmap != NULL) {
+      mem->init->free_mem(mem->gc_bitmap);
+    }
+    mem->gc_bitmap = mem->init->alloc_mem(sizeof(unsigned int) * size);
+    mem->gc_bitmap_size = size;
+  }
+
+  if (size > 0) {
+    memset(mem->gc_bitmap, 0, sizeof(unsigned int) * size);
+  }
+  return mem->gc_bitmap;
+}
+#endif
+
+/* Heap is grown once it is occupied above this threshold after full GC */
+#define SILC_INT_MEM_GROW_OCCUPANCY_PERCENT     (60)
+
+#define SILC_INT_MEM_DEFAULT_GROWTH_FACTOR      (2.0)
+
+/*
+ * Memory budget.
+ * Heap footprint is the heap buffer, the cons region, whose cell takes 2 units, and the large objects. Heap starts
+ * with the footprint of init_memory_size and its parts are only grown within the budget, that is left
+ * of max_memory_size by the others, get_free_budget is the only limit they check, so that footprint never exceeds
+ * max_memory_size. Collector side tables and the to-space of the semispace copier are not counted.
+ */
+
+static int get_max_memory_size(struct silc_mem_init_t* init) {
+  return init->max_memory_size > init->init_memory_size ? init->max_memory_size : init->init_memory_size;
+}
+
+/** Returns heap footprint in silc_obj units */
+static long long get_footprint(struct silc_mem_t* mem) {
+  return (long long) mem->last_pos_index + 1 + 2LL * mem->cons_capacity + mem->large_object_memory;
+}
+
+/** Returns memory, that heap buffer, cons region or large objects can take in addition to the current footprint */
+static long long get_free_budget(struct silc_mem_t* mem) {
+  long long budget = get_max_memory_size(mem->init) - get_footprint(mem);
+  SILC_ASSERT(budget >= 0);
+  return budget > 0 ? budget : 0;
+}
+
+/*
+ * Cons region.
+ * Cons cells are never moved: collector links unmarked cells into the free list and the region is grown once
+ * it gets crowded. Cons region starts with a quarter of the initial memory and grows within the memory budget.
+ */
+
+#define SILC_INT_MEM_MIN_CONS_CAPACITY          (64)
+
+/** Returns initial count of cells, they take a quarter of the initial memory, the rest is taken by the heap buffer */
+static int get_init_cons_capacity(struct silc_mem_init_t* init) {
+  return init->init_memory_size >= 8 ? init->init_memory_size / 8 : 1;
+}
+
+static int get_bitmap_size(int bit_count) {
+  return (bit_count + SILC_INT_MEM_BITMAP_WORD_BITS - 1) / SILC_INT_MEM_BITMAP_WORD_BITS;
+}
+
+/** Returns a copy of the given bitmap of the new size, the bitmap is freed */
+static unsigned int* resize_bitmap(struct silc_mem_t* mem, unsigned int* bits, int size, int new_size) {
+  unsigned int* new_bits = mem->init->alloc_mem(sizeof(unsigned int) * new_size);
+  memset(new_bits, 0, sizeof(unsigned int) * new_size);
+  if (bits != NULL) {
+    memcpy(new_bits, bits, sizeof(unsigned int) * (size < new_size ? size : new_size));
+    mem->init->free_mem(bits);
+  }
+  return new_bits;
+}
+
+static void resize_cons_region(struct silc_mem_t* mem, int new_capacity) {
+  SILC_ASSERT(new_capacity >= mem->cons_count);
+  silc_obj* new_buf = mem->init->alloc_mem(sizeof(silc_obj) * 2 * new_capacity);
+  if (mem->cons_buf != NULL) {
+    memcpy(new_buf, mem->cons_buf, sizeof(silc_obj) * 2 * mem->cons_count);
+    mem->init->free_mem(mem->cons_buf);
+  }
+  mem->cons_buf = new_buf;
+
+  int size = get_bitmap_size(mem->cons_capacity);
+  int new_size = get_bitmap_size(new_capacity);
+  mem->cons_mark_bits = resize_bitmap(mem, mem->cons_mark_bits, size, new_size);
+  mem->cons_young_bits = resize_bitmap(mem, mem->cons_young_bits, size, new_size);
+  mem->cons_remembered_bits = resize_bitmap(mem, mem->cons_remembered_bits, size, new_size);
+  mem->cons_capacity = new_capacity;
+}
+
+static void init_cons_region(struct silc_mem_t* mem, int capacity) {
+  mem->cons_buf = NULL;
+  mem->cons_capacity = 0;
+  mem->cons_count = 0;
+  mem->cons_free_head = -1;
+  mem->cons_free_count = 0;
+  mem->cons_mark_bits = NULL;
+  mem->cons_young_bits = NULL;
+  mem->cons_remembered_bits = NULL;
+  mem->young_cell_index = mem->init->nursery_size > 0 ? 0 : INT_MAX;
+  mem->young_cells = (struct silc_mem_pos_vec_t) {0};
+  mem->remembered_cells = (struct silc_mem_pos_vec_t) {0};
+  mem->last_gc_cons_used = 0;
+  resize_cons_region(mem, capacity);
+}
+
+static void free_cons_region(struct silc_mem_t* mem) {
+  mem->init->free_mem(mem->cons_buf);
+  mem->init->free_mem(mem->cons_mark_bits);
+  mem->init->free_mem(mem->cons_young_bits);
+  mem->init->free_mem(mem->cons_remembered_bits);
+  pos_vec_free(mem, &mem->young_cells);
+  pos_vec_free(mem, &mem->remembered_cells);
+}
+
+/** Grows cons region geometrically within the memory budget if it is too crowded to fit n more cells */
+static void adjust_cons_region_size(struct silc_mem_t* mem, int n) {
+  double growth_factor = mem->init->growth_factor > 1.0 ? mem->init->growth_factor : SILC_INT_MEM_DEFAULT_GROWTH_FACTOR;
+  long long budget_capacity = mem->cons_capacity + get_free_budget(mem) / 2;
+  int max_capacity = budget_capacity < SILC_INT_MEM_MAX_MEMORY_SIZE ? (int) budget_capacity :
+      SILC_INT_MEM_MAX_MEMORY_SIZE;
+  long long used = (long long) mem->cons_count - mem->cons_free_count + n;
+  int new_capacity = mem->cons_capacity;
+
+  while (new_capacity < max_capacity && used * 100 > (long long) new_capacity * SILC_INT_MEM_GROW_OCCUPANCY_PERCENT) {
+    double next_capacity = new_capacity > 0 ? new_capacity * growth_factor : SILC_INT_MEM_MIN_CONS_CAPACITY;
+    new_capacity = next_capacity < max_capacity ? (int) next_capacity : max_capacity;
+  }
+
+  if (new_capacity != mem->cons_capacity) {
+    resize_cons_region(mem, new_capacity);
+  }
+}
+
+/** Takes a vacant cell or a cell above cons_count, returns -1 if cons region is full */
+static int try_alloc_cons(struct silc_mem_t* mem) {
+  int cell = mem->cons_free_head;
+  if (cell >= 0) {
+    mem->cons_free_head = SILC_INT_MEM_NEXT_FREE_POS(mem->cons_buf[2 * cell]);
+    --mem->cons_free_count;
+    if (mem->init->nursery_size > 0) {
+      pos_vec_add(mem, &mem->young_cells, cell);
+      SILC_INT_MEM_SET_BIT(mem->cons_young_bits, cell);
+    }
+  } else if (mem->cons_count < mem->cons_capacity) {
+    cell = mem->cons_count++;
+  } else {
+    return -1;
+  }
+
+  return cell;
+}
+
+/**
+ * Links unmarked cells at or above the given one into the free list in ascending order and clears their marks,
+ * marking should be complete. Trailing vacant cells are cut off, so that they are allocated by bumping cons_count.
+ */
+static void sweep_cells(struct silc_mem_t* mem, int from) {
+  int new_cons_count = from;
+  int free_head = -1;
+  int free_tail = -1;
+
+  int size = get_bitmap_size(mem->cons_count);
+  unsigned int range = ~0U << (from % SILC_INT_MEM_BITMAP_WORD_BITS); /* first word may hold marks below from */
+  for (int w = from / SILC_INT_MEM_BITMAP_WORD_BITS; w < size; ++w, range = ~0U) {
+    unsigned int bits = mem->cons_mark_bits[w] & range;
+    mem->cons_mark_bits[w] &= ~range;
+
+    for (; bits != 0; bits &= bits - 1) {
+      int cell = w * SILC_INT_MEM_BITMAP_WORD_BITS + __builtin_ctz(bits);
+      for (int j = new_cons_count; j < cell; ++j) {
+        if (free_tail >= 0) {
+          mem->cons_buf[2 * free_tail] = SILC_INT_MEM_MAKE_FREE_POS(j);
+        } else {
+          free_head = j;
+        }
+        free_tail = j;
+        ++mem->cons_free_count;
+      }
+      new_cons_count = cell + 1;
+    }
+  }
+
+  /* vacant cells below the swept ones stay in the free list */
+  if (free_tail >= 0) {
+    mem->cons_buf[2 * free_tail] = SILC_INT_MEM_MAKE_FREE_POS(mem->cons_free_head);
+    mem->cons_free_head = free_head;
+  }
+  mem->cons_count = new_cons_count;
+}
+
+/** Sweeps the whole cons region, the free list is rebuilt */
+static void sweep_cons_region(struct silc_mem_t* mem) {
+  mem->cons_free_head = -1;
+  mem->cons_free_count = 0;
+  sweep_cells(mem, 0);
+  mem->last_gc_cons_used = mem->cons_count - mem->cons_free_count;
+}
+
+/*
+ * Heap buffer.
+ * Buffer is allocated by alloc_mem by default, so that resizing copies it. Heap with mmap_heap option reserves
+ * the address space of max_memory_size at once, aligned to the huge page size, so that it grows and shrinks in place:
+ * only position table is moved to the new top of the buffer. Pages of the freed heap tail are returned to the system.
+ */
+
+#define SILC_INT_MEM_HUGE_PAGE_SIZE             ((size_t) 2 * 1024 * 1024)
+
+/** Reserves huge page aligned address space of at least the given size, returns NULL if mapping has failed */
+static silc_obj* map_heap(size_t bytes) {
+  size_t map_bytes = bytes + SILC_INT_MEM_HUGE_PAGE_SIZE;
+  char* p = mmap(NULL, map_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+
+  /* unaligned head and spare tail are unmapped */
+  char* start = (char*) (((uintptr_t) p + SILC_INT_MEM_HUGE_PAGE_SIZE - 1) & ~(SILC_INT_MEM_HUGE_PAGE_SIZE - 1));
+  if (start > p) {
+    munmap(p, start - p);
+  }
+  munmap(start + bytes, (p + map_bytes) - (start + bytes));
+
+#ifdef MADV_HUGEPAGE
+  madvise(start, bytes, MADV_HUGEPAGE);
+#endif
+  return (silc_obj*) start;
+}
+
+/**
+ * Returns whole huge pages of the given range of the reserved buffer (heap buffer or to-space) to the system,
+ * they are zeroed once they are touched again.
+ */
+static void decommit_heap(silc_obj* buf, int from, int to) {
+  uintptr_t start = ((uintptr_t) (buf + from) + SILC_INT_MEM_HUGE_PAGE_SIZE - 1) & ~(SILC_INT_MEM_HUGE_PAGE_SIZE - 1);
+  uintptr_t end = ((uintptr_t) (buf + to)) & ~(SILC_INT_MEM_HUGE_PAGE_SIZE - 1);
+  if (start < end) {
+    madvise((void*) start, end - start, MADV_DONTNEED);
+  }
+}
+
+static void alloc_heap(struct silc_mem_t* mem, struct silc_mem_init_t* init, int heap_size) {
+  mem->heap_reserved_size = 0;
+  if (init->mmap_heap) {
+    size_t bytes = (sizeof(silc_obj) * (size_t) get_max_memory_size(init) + SILC_INT_MEM_HUGE_PAGE_SIZE - 1) &
+        ~(SILC_INT_MEM_HUGE_PAGE_SIZE - 1);
+    mem->buf = map_heap(bytes);
+    if (mem->buf != NULL) {
+      mem->heap_reserved_size = (int) (bytes / sizeof(silc_obj));
+      return;
+    }
+  }
+
+  /* heap falls back to alloc_mem if address space can not be reserved */
+  mem->buf = init->alloc_mem(sizeof(silc_obj) * heap_size);
+}
+
+static void free_to_space(struct silc_mem_t* mem) {
+  if (mem->to_space == NULL) {
+    return;
+  }
+
+  if (mem->heap_reserved_size > 0) {
+    munmap(mem->to_space, sizeof(silc_obj) * (size_t) mem->heap_reserved_size);
+  } else {
+    mem->init->free_mem(mem->to_space);
+  }
+  mem->to_space = NULL;
+}
+
+static void free_heap(struct silc_mem_t* mem) {
+  free_to_space(mem);
+  if (mem->heap_reserved_size > 0) {
+    munmap(mem->buf, sizeof(silc_obj) * (size_t) mem->heap_reserved_size);
+  } else {
+    mem->init->free_mem(mem->buf);
+  }
+}
+
+/** Initializes heap of the initial memory size, that is shared between the heap buffer and the given count of cells */
+static void init_heap(struct silc_mem_t* mem, struct silc_mem_init_t* init, int cons_capacity) {
+  int heap_size = init->init_memory_size - 2 * cons_capacity;
+  if (heap_size < 4) {
+    fputs(";; [FATAL] init memory size is too small\n", stderr);
+    abort();
+  }
+
+  alloc_heap(mem, init, heap_size);
+  mem->to_space = NULL;
+  mem->last_pos_index = heap_size - 1;
+  mem->avail_index = 0;
+  mem->pos_count = 0;
+  mem->free_pos_head = -1;
+  mem->free_pos_count = 0;
+  mem->gc_bitmap = NULL;
+  mem->gc_bitmap_size = 0;
+  mem->mark_bits = NULL;
+  mem->mark_bits_size = 0;
+  mem->young_index = 0;
+  mem->young_pos = (struct silc_mem_pos_vec_t) {0};
+  mem->remembered_pos = (struct silc_mem_pos_vec_t) {0};
+  mem->marking = false;
+  mem->mark_stack = (struct silc_mem_pos_vec_t) {0};
+  mem->mark_stack_overflow = false;
+  mem->alloc_since_slice = 0;
+  mem->low_occupancy_gc_count = 0;
+  mem->gc_alloc_base = 0;
+  mem->last_gc_live = 0;
+  mem->gc_trigger = init->init_memory_size / 4;
+  mem->survival_percent = 0;
+  mem->gc_pool = NULL;
+  mem->background_gc = NULL;
+  mem->last_gc_avail_index = 0;
+  mem->large_objs = NULL;
+  mem->large_obj_count = 0;
+  mem->large_obj_capacity = 0;
+  mem->large_obj_free_head = -1;
+  mem->large_object_memory = 0;
+  mem->large_alloc_since_gc = 0;
+  mem->gc_counters = (struct silc_mem_gc_counters_t) {0};
+  mem->alloc_by_subtype = init->alloc_mem(sizeof(struct silc_mem_alloc_counter_t) * SILC_MEM_TRACKED_SUBTYPE_COUNT);
+  memset(mem->alloc_by_subtype, 0, sizeof(struct silc_mem_alloc_counter_t) * SILC_MEM_TRACKED_SUBTYPE_COUNT);
+  mem->alloc_sample_countdown = (init->alloc_sample_interval > 0 && init->on_alloc_sample != NULL) ?
+      init->alloc_sample_interval : LLONG_MAX;
+  mem->alloc_samples = NULL;
+  mem->alloc_sample_count = 0;
+  mem->alloc_sample_capacity = 0;
+  mem->handles = NULL;
+  mem->handle_count = 0;
+  mem->handle_capacity = 0;
+  mem->weak_refs = (struct silc_mem_pos_vec_t) {0};
+  mem->region = NULL;
+  mem->region_free_pos_head = -1;
+  mem->region_cons_free_head = -1;
+  mem->shared = init->shared;
+  mem->frozen = false;
+  SILC_ASSERT(mem->shared == NULL || mem->shared->frozen);
+#ifdef SILC_DIRECT_OBJ
+  for (int i = 0; i < SILC_INT_MEM_FREE_LIST_COUNT; ++i) {
+    mem->free_heads[i] = -1;
+    mem->region_free_heads[i] = -1;
+  }
+  mem->free_memory = 0;
+  mem->bref_bits = resize_bitmap(mem, NULL, 0, get_bitmap_size(heap_size));
+#endif
+  init_cons_region(mem, cons_capacity);
+  update_alloc_limit(mem);
+}
+
+/* Heap is shrunk once it stays occupied below this threshold after several consecutive full GCs */
+#define SILC_INT_MEM_SHRINK_OCCUPANCY_PERCENT   (20)
+#define SILC_INT_MEM_SHRINK_GC_COUNT            (3)
+
+/**
+ * Resizes heap buffer, objects stay at the bottom of the buffer and position table is relocated to its top.
+ * Position numbers are counted from the top of the buffer, so references stay valid. Buffer is reallocated and copied
+ * unless its address space has been reserved.
+ */
+static void resize_heap(struct silc_mem_t* mem, int new_size) {
+  SILC_ASSERT(new_size >= mem->avail_index + get_pos_table_size(mem));
+  int size = mem->last_pos_index + 1;
+#ifdef SILC_DIRECT_OBJ
+  int bits_size = get_bitmap_size(mem->avail_index);
+  mem->bref_bits = resize_bitmap(mem, mem->bref_bits, bits_size, get_bitmap_size(new_size));
+#endif
+
+  if (mem->heap_reserved_size > 0) {
+    SILC_ASSERT(new_size <= mem->heap_reserved_size);
+#ifndef SILC_DIRECT_OBJ
+    memmove(mem->buf + new_size - mem->pos_count, mem->buf + size - mem->pos_count, sizeof(silc_obj) * mem->pos_count);
+#endif
+    if (new_size < size) {
+      decommit_heap(mem->buf, new_size, size);
+      if (mem->to_space != NULL) {
+        decommit_heap(mem->to_space, new_size, size);
+      }
+    }
+  } else {
+    silc_obj* new_buf = mem->init->alloc_mem(sizeof(silc_obj) * new_size);
+    memcpy(new_buf, mem->buf, sizeof(silc_obj) * mem->avail_index);
+#ifndef SILC_DIRECT_OBJ
+    memcpy(new_buf + new_size - mem->pos_count, mem->buf + size - mem->pos_count, sizeof(silc_obj) * mem->pos_count);
+#endif
+    mem->init->free_mem(mem->buf);
+    mem->buf = new_buf;
+    free_to_space(mem); /* to-space of the new size is allocated by the next copying collection */
+  }
+
+  mem->last_pos_index = new_size - 1;
+}
+
+/**
+ * Grows heap buffer geometrically within the memory budget if it is too crowded to fit n more silc_obj units,
+ * shrinks it down to its initial size if it stays mostly empty.
+ * Should be called after full garbage collection.
+ */
+static void adjust_heap_size(struct silc_mem_t* mem, int n) {
+  struct silc_mem_init_t* init = mem->init;
+  double growth_factor = init->growth_factor > 1.0 ? init->growth_factor : SILC_INT_MEM_DEFAULT_GROWTH_FACTOR;
+  int size = mem->last_pos_index + 1;
+  long long budget_size = size + get_free_budget(mem);
+  int max_size = budget_size < SILC_INT_MEM_MAX_MEMORY_SIZE ? (int) budget_size : SILC_INT_MEM_MAX_MEMORY_SIZE;
+  int min_size = init->init_memory_size - 2 * get_init_cons_capacity(init);
+  int new_size = size;
+  /* one more position might be needed by the next allocation, free chunks are not counted in the direct mode */
+  long long used = (long long) mem->avail_index + get_pos_table_size(mem) + n + 1;
+
+  if (used * 100 > (long long) size * SILC_INT_MEM_GROW_OCCUPANCY_PERCENT) {
+    mem->low_occupancy_gc_count = 0;
+    while (new_size < max_size && used * 100 > (long long) new_size * SILC_INT_MEM_GROW_OCCUPANCY_PERCENT) {
+      double next_size = new_size * growth_factor;
+      new_size = next_size < max_size ? (int) next_size : max_size;
+    }
+  } else if (used * 100 < (long long) size * SILC_INT_MEM_SHRINK_OCCUPANCY_PERCENT && size > min_size) {
+    if (++mem->low_occupancy_gc_count >= SILC_INT_MEM_SHRINK_GC_COUNT) {
+      mem->low_occupancy_gc_count = 0;
+      new_size = (int) (size / growth_factor);
+      if (new_size < min_size) {
+        new_size = min_size;
+      }
+      if (used * 100 > (long long) new_size * SILC_INT_MEM_GROW_OCCUPANCY_PERCENT) {
+        new_size = size; /* shrunk heap would have to be grown right away */
+      }
+    }
+  } else {
+    mem->low_occupancy_gc_count = 0;
+  }
+
+  if (new_size != size) {
+    resize_heap(mem, new_size);
+  }
+}
+
+/**
+ * Shrinks heap buffer, then cons region, if the memory budget has no room for n more units, they are kept large enough
+ * to stay below the growth threshold. Since conses never move, only vacant cells on top of the region are given up.
+ * Should be called after full garbage collection.
+ */
+static void release_budget(struct silc_mem_t* mem, long long n) {
+  long long shortage = n - get_free_budget(mem);
+  if (shortage <= 0) {
+    return;
+  }
+
+  int size = mem->last_pos_index + 1;
+  long long used = (long long) mem->avail_index + get_pos_table_size(mem) + 1;
+  long long min_size = used * 100 / SILC_INT_MEM_GROW_OCCUPANCY_PERCENT + 1;
+  long long new_size = size - shortage > min_size ? size - shortage : min_size;
+  if (new_size < size) {
+    resize_heap(mem, (int) new_size);
+  }
+
+  shortage = n - get_free_budget(mem);
+  if (shortage <= 0) {
+    return;
+  }
+
+  long long used_cells = mem->cons_count - mem->cons_free_count;
+  long long min_capacity = used_cells * 100 / SILC_INT_MEM_GROW_OCCUPANCY_PERCENT + 1;
+  if (min_capacity < mem->cons_count) {
+    min_capacity = mem->cons_count;
+  }
+  long long new_capacity = mem->cons_capacity - (shortage + 1) / 2;
+  if (new_capacity < min_capacity) {
+    new_capacity = min_capacity;
+  }
+  if (new_capacity < mem->cons_capacity) {
+    resize_cons_region(mem, (int) new_capacity);
+  }
+}
+
+#ifdef SILC_DIRECT_OBJ
+/*
+ * Free lists of the direct mode.
+ * Free chunk is [next chunk index][chunk size], chunks of up to the maximum inline allocation size are kept
+ * in the exact-size lists, so that the fast path pops them, bigger ones share the last list and are taken first-fit.
+ */
+
+static int get_free_list(int size) {
+  return size < SILC_INT_MEM_FREE_LIST_COUNT - 1 ? size : SILC_INT_MEM_FREE_LIST_COUNT - 1;
+}
+
+static void add_free_chunk(struct silc_mem_t* mem, int index, int size) {
+  int list = get_free_list(size);
+  mem->buf[index] = SILC_INT_MEM_MAKE_FREE_POS(mem->free_heads[list]);
+  mem->buf[index + 1] = (silc_obj) size;
+  mem->free_heads[list] = index;
+  mem->free_memory += size;
+}
+
+/** Appends chunk to the tail of its free list, tails are kept by the caller */
+static void append_free_chunk(struct silc_mem_t* mem, int* free_tails, int index, int size) {
+  int list = get_free_list(size);
+  mem->buf[index] = SILC_INT_MEM_MAKE_FREE_POS(-1);
+  mem->buf[index + 1] = (silc_obj) size;
+  if (free_tails[list] >= 0) {
+    mem->buf[free_tails[list]] = SILC_INT_MEM_MAKE_FREE_POS(index);
+  } else {
+    mem->free_heads[list] = index;
+  }
+  free_tails[list] = index;
+  mem->free_memory += size;
+}
+
+/**
+ * Takes a free chunk of at least n units, the remainder is returned to the free lists.
+ * Chunks, that would leave a single unit, are skipped, since the remainder could not hold a chunk header.
+ * Returns index of the chunk or -1 if there is no suitable one.
+ */
+static int take_free_chunk(struct silc_mem_t* mem, int n) {
+  for (int list = get_free_list(n); list < SILC_INT_MEM_FREE_LIST_COUNT; ++list) {
+    int prev = -1;
+    for (int index = mem->free_heads[list]; index >= 0; index = SILC_INT_MEM_NEXT_FREE_POS(mem->buf[index])) {
+      int size = (int) mem->buf[index + 1];
+      if (size == n || size >= n + 2) {
+        silc_obj next = mem->buf[index];
+        if (prev >= 0) {
+          mem->buf[prev] = next;
+        } else {
+          mem->free_heads[list] = SILC_INT_MEM_NEXT_FREE_POS(next);
+        }
+        mem->free_memory -= size;
+        if (size > n) {
+          add_free_chunk(mem, index + n, size - n);
+        }
+        return index;
+      }
+
+      if (list < SILC_INT_MEM_FREE_LIST_COUNT - 1) {
+        break; /* all the chunks of the exact-size list are equally unsuitable */
+      }
+      prev = index;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Tries to allocate n consecutive blocks (silc_obj[n]) in the heap, free chunks are reused before the heap top
+ * is bumped. Returns heap index of the allocated blocks, that is the object position, or -1 if heap is full.
+ */
+static int try_alloc(struct silc_mem_t * mem, int n, int type) {
+  int result = take_free_chunk(mem, n);
+  if (result < 0) {
+    if (mem->avail_index + n > mem->last_pos_index + 1) {
+      return -1;
+    }
+    result = mem->avail_index;
+    mem->avail_index += n;
+  }
+
+  if (type == SILC_TYPE_BREF) {
+    SILC_INT_MEM_SET_BIT(mem->bref_bits, result);
+  } else {
+    SILC_INT_MEM_CLEAR_BIT(mem->bref_bits, result);
+  }
+  ++mem->pos_count;
+  return result;
+}
+#else
+/**
+ * Tries to allocate n consecutive blocks (silc_obj[n]) in the heap.
+ * Total size of the allocated memory is <code>n * sizeof(silc_obj)</code> bytes.
+ * Returns index of position that contains index of the available sequence or -1 if heap is full.
+ *
+ * @param mem Managed memory context
+ * @param n Count of silc_obj units to be allocated
+ * @param type Type information to be propagated to pos (duplicates type info embedded into silc_obj)
+ * @return Index of position index or -1 if allocation failed
+ */
+static int try_alloc(struct silc_mem_t * mem, int n, int type) {
+  int new_pos_index;
+  int new_pos_count = mem->pos_count;
+
+  if (mem->free_pos_head >= 0) {
+    /* reuse vacant position */
+    new_pos_index = mem->free_pos_head;
+  } else {
+    /* no vacant position, addition of a new one is required */
+    new_pos_index = mem->pos_count;
+    ++new_pos_count;
+  }
+
+  /* calculate new available index */
+  int new_avail_index = mem->avail_index + n;
+  int result = -1;
+
+  /* allocation succeeds if heap is not empty */
+  if (new_avail_index <= (mem->last_pos_index - new_pos_count)) {
+    /* ok, the heap has enough space to place n blocks, update heap state */
+    result = new_pos_index;
+
+    if (new_pos_count == mem->pos_count) {
+      /* remove position from the free list */
+      mem->free_pos_head = SILC_INT_MEM_NEXT_FREE_POS(mem->buf[mem->last_pos_index - new_pos_index]);
+      --mem->free_pos_count;
+    }
+
+    /* record currently available index */
+    mem->buf[mem->last_pos_index - new_pos_index] = ((silc_obj) mem->avail_index << SILC_INT_MEM_POS_SHIFT) | type;
+
+    /* nothing is placed in the heap for the large objects, they are never young */
+    if (mem->init->nursery_size > 0 && n > 0) {
+      pos_vec_add(mem, &mem->young_pos, new_pos_index);
+    }
+
+    /* update position indexes counter */
+    mem->pos_count = new_pos_count;
+
+    /* update next available index */
+    mem->avail_index = new_avail_index;
+  }
+
+  return result;
+}
+#endif /* SILC_DIRECT_OBJ */
+
+/* Marking slice budget for the cycles, that have been started by the background collector */
+#define SILC_INT_MEM_DEFAULT_GC_SLICE_BUDGET      (1024)
+
+/** Does a marking slice or minor collection, if it is due, before n silc_obj units are allocated */
+static void prepare_alloc(struct silc_mem_t* mem, int n) {
+  int gc_slice_budget = mem->init->gc_slice_budget;
+
+  if (mem->marking) {
+    /* do marking work proportional to the allocated memory, complete the cycle once there is nothing to mark */
+    int budget = gc_slice_budget > 0 ? gc_slice_budget : SILC_INT_MEM_DEFAULT_GC_SLICE_BUDGET;
+    mem->alloc_since_slice += n;
+    if (mem->alloc_since_slice >= budget) {
+      mem->alloc_since_slice = 0;
+      if (gc_drain(mem, SILC_INT_MEM_FULL_MARKING, budget)) {
+        silc_int_mem_gc(mem);
+      }
+    }
+  } else if (get_alloc_until_gc(mem) == 0) {
+    /* allocation has reached the trigger, incremental marking is started instead of collection if it is enabled */
+    if (gc_slice_budget > 0) {
+      start_incremental_marking(mem);
+    } else {
+      silc_int_mem_gc(mem);
+    }
+  } else if (mem->init->nursery_size > 0 &&
+             (mem->avail_index - mem->young_index + 2 * silc_int_mem_get_young_cell_count(mem) + n) >
+             mem->init->nursery_size) {
+    /* collect young generation once it exceeds its maximum size */
+    silc_int_mem_minor_gc(mem);
+  }
+
+  /* start incremental marking once half of the heap is occupied, so that the cycle can complete before OOM */
+  if (gc_slice_budget > 0 && !mem->marking &&
+      (2 * (silc_int_mem_get_alloc_index(mem) + get_pos_table_size(mem)) > mem->last_pos_index ||
+                                               2 * (mem->cons_count - mem->cons_free_count) > mem->cons_capacity)) {
+    start_incremental_marking(mem);
+  }
+}
+
+static int alloc_or_fail(struct silc_mem_t * mem, int n, int type) {
+  prepare_alloc(mem, n);
+
+  int result = try_alloc(mem, n, type);
+  if (result < 0 && mem->young_pos.count > 0 && !mem->marking) {
+    silc_int_mem_minor_gc(mem);
+    result = try_alloc(mem, n, type);
+  }
+
+  if (result < 0) {
+    silc_int_mem_gc(mem);
+    result = try_alloc(mem, n, type);
+    if (result < 0) {
+      adjust_heap_size(mem, n);
+      result = try_alloc(mem, n, type);
+    }
+    if (result < 0) {
+      mem->init->oom_abort(mem->init);
+    }
+  }
+
+  SILC_INT_MEM_ASSERT_INDEX(result);
+  update_alloc_limit(mem);
+  return result;
+}
+
+static int alloc_cons_or_fail(struct silc_mem_t* mem) {
+  prepare_alloc(mem, 2);
+
+  int result = try_alloc_cons(mem);
+  if (result < 0 && silc_int_mem_get_young_cell_count(mem) > 0 && !mem->marking) {
+    silc_int_mem_minor_gc(mem);
+    result = try_alloc_cons(mem);
+  }
+
+  if (result < 0) {
+    silc_int_mem_gc(mem);
+    result = try_alloc_cons(mem);
+    if (result < 0) {
+      /* heap buffer gives up its unused part of the budget, if cons region can't grow otherwise */
+      release_budget(mem, 2LL * (mem->cons_capacity > 0 ? mem->cons_capacity : SILC_INT_MEM_MIN_CONS_CAPACITY));
+      adjust_cons_region_size(mem, 1);
+      result = try_alloc_cons(mem);
+    }
+    if (result < 0) {
+      mem->init->oom_abort(mem->init);
+    }
+  }
+
+  SILC_INT_MEM_ASSERT_INDEX(result);
+  update_alloc_limit(mem);
+  return result;
+}
+
+/*
+ * Large object space.
+ * Objects of at least large_object_size units are mapped by anonymous mmap, so that they are page aligned and their
+ * pages are returned to the system once they are released, and never move, so that compaction does not copy them.
+ * Position of the large object holds its slot number. Large objects are charged against the memory budget.
+ * Unreachable large objects are released by the full collection, the minor one treats them as old.
+ */
+
+/** Maps page aligned contents of the large object of n silc_obj units, returns NULL if mapping has failed */
+static silc_obj* map_large_object(int n) {
+  void* p = mmap(NULL, sizeof(silc_obj) * (size_t) n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return p != MAP_FAILED ? p : NULL;
+}
+
+static void unmap_large_object(struct silc_mem_large_obj_t* lo) {
+  munmap(lo->contents, sizeof(silc_obj) * (size_t) lo->size);
+}
+
+static bool is_large_object_size(struct silc_mem_t* mem, int n) {
+  return mem->init->large_object_size > 0 && n >= mem->init->large_object_size;
+}
+
+static int alloc_large_obj_slot(struct silc_mem_t* mem) {
+  int slot = mem->large_obj_free_head;
+  if (slot >= 0) {
+    mem->large_obj_free_head = mem->large_objs[slot].pos;
+    return slot;
+  }
+
+  if (mem->large_obj_count == mem->large_obj_capacity) {
+    int new_capacity = mem->large_obj_capacity * 2 + 16;
+    struct silc_mem_large_obj_t* new_objs = mem->init->alloc_mem(sizeof(struct silc_mem_large_obj_t) * new_capacity);
+    if (mem->large_objs != NULL) {
+      memcpy(new_objs, mem->large_objs, sizeof(struct silc_mem_large_obj_t) * mem->large_obj_count);
+      mem->init->free_mem(mem->large_objs);
+    }
+    mem->large_objs = new_objs;
+    mem->large_obj_capacity = new_capacity;
+  }
+
+  return mem->large_obj_count++;
+}
+
+/** Takes a position and allocates n silc_obj units outside of the heap, returns index of the position */
+static int alloc_large_or_fail(struct silc_mem_t* mem, int n, int type) {
+  abandon_regions(mem); /* large object takes a position, but it does not reside on top of the heap */
+
+  /* large object space is collected once it grows by the heap size since the last full collection */
+  if (mem->large_alloc_since_gc + n > mem->last_pos_index + 1) {
+    silc_int_mem_gc(mem);
+  }
+
+  /* collected heap buffer and cons region give up their unused part of the budget, if it has no room for the object */
+  if (get_free_budget(mem) < n) {
+    silc_int_mem_gc(mem);
+    release_budget(mem, n);
+  }
+
+  if (mem->marking) {
+    mem->alloc_since_slice += n; /* large allocation is accounted by the next marking slice */
+  }
+  int pos_index = alloc_or_fail(mem, 0, type);
+
+  silc_obj* contents = get_free_budget(mem) >= n ? map_large_object(n) : NULL;
+  if (contents == NULL) {
+    mem->init->oom_abort(mem->init);
+  }
+
+  int slot = alloc_large_obj_slot(mem);
+  SILC_INT_MEM_ASSERT_INDEX(slot);
+  struct silc_mem_large_obj_t* lo = mem->large_objs + slot;
+  lo->contents = contents;
+  lo->pos = pos_index;
+  lo->size = n;
+
+  mem->buf[mem->last_pos_index - pos_index] = (((silc_obj) slot) << SILC_INT_MEM_POS_SHIFT) |
+      SILC_INT_MEM_POS_LARGE_BIT | type;
+  mem->large_object_memory += n;
+  mem->large_alloc_since_gc += n;
+  return pos_index;
+}
+
+/** Releases unmarked large objects, their positions are freed by the caller, marking should be complete */
+static void sweep_large_objects(struct silc_mem_t* mem) {
+  for (int i = 0; i < mem->large_obj_count; ++i) {
+    struct silc_mem_large_obj_t* lo = mem->large_objs + i;
+    if (lo->contents == NULL || silc_int_mem_is_pos_marked(mem, lo->pos)) {
+      continue;
+    }
+
+    unmap_large_object(lo);
+    mem->large_object_memory -= lo->size;
+    lo->contents = NULL;
+    lo->pos = mem->large_obj_free_head;
+    mem->large_obj_free_head = i;
+  }
+}
+
+static void free_large_objects(struct silc_mem_t* mem) {
+  for (int i = 0; i < mem->large_obj_count; ++i) {
+    if (mem->large_objs[i].contents != NULL) {
+      unmap_large_object(mem->large_objs + i);
+    }
+  }
+
+  if (mem->large_objs != NULL) {
+    mem->init->free_mem(mem->large_objs);
+  }
+}
+
+/** Returns true if the given object has been allocated since the last collection */
+static bool is_young(struct silc_mem_t* mem, silc_obj obj) {
+  if (SILC_GET_TYPE(obj) == SILC_TYPE_CONS) {
+    int cell = (int) (obj >> SILC_INT_TYPE_SHIFT);
+    return cell >= mem->young_cell_index || SILC_INT_MEM_TEST_BIT(mem->cons_young_bits, cell);
+  }
+
+  silc_obj pos_fval = mem->buf[silc_int_mem_get_pos_index(mem, obj)];
+  return (pos_fval & SILC_INT_MEM_POS_LARGE_BIT) == 0 && (int) (pos_fval >> SILC_INT_MEM_POS_SHIFT) >= mem->young_index;
+}
+
+/** Adds old object to the remembered set, since it may reference young objects */
+static void remember(struct silc_mem_t* mem, int pos) {
+  mem->buf[mem->last_pos_index - pos] |= SILC_INT_MEM_POS_REMEMBERED_BIT;
+  pos_vec_add(mem, &mem->remembered_pos, pos);
+}
+
+/**
+ * Returns true if the given object survives the collection, that has completed its marking. Minor collection
+ * (min_index is not SILC_INT_MEM_FULL_MARKING) only marks young objects, so the old ones survive.
+ */
+static bool survives(struct silc_mem_t* mem, silc_obj obj, int min_index) {
+  if (silc_int_mem_is_shared(obj)) {
+    return true;
+  }
+
+  int index = (int) (obj >> SILC_INT_TYPE_SHIFT);
+  bool marked = SILC_GET_TYPE(obj) == SILC_TYPE_CONS ? SILC_INT_MEM_TEST_BIT(mem->cons_mark_bits, index) :
+      silc_int_mem_is_pos_marked(mem, index);
+  return marked || (min_index >= 0 && !is_young(mem, obj));
+}
+
+/** Drops sampled objects, that do not survive the collection */
+static void sweep_alloc_samples(struct silc_mem_t* mem, int min_index) {
+  int count = 0;
+  for (int i = 0; i < mem->alloc_sample_count; ++i) {
+    if (survives(mem, mem->alloc_samples[i].obj, min_index)) {
+      mem->alloc_samples[count++] = mem->alloc_samples[i];
+    }
+  }
+  mem->alloc_sample_count = count;
+}
+
+/**
+ * Drops weak references, that do not survive the collection, and clears the surviving ones, whose targets die.
+ * Should be called once marking is complete and before the dead positions are freed.
+ */
+static void sweep_weak_refs(struct silc_mem_t* mem, int min_index) {
+  int count = 0;
+  for (int i = 0; i < mem->weak_refs.count; ++i) {
+    int pos = mem->weak_refs.arr[i];
+    silc_obj weak_ref = (((silc_obj) pos) << SILC_INT_TYPE_SHIFT) | SILC_TYPE_OREF;
+    if (!survives(mem, weak_ref, min_index)) {
+      continue;
+    }
+
+    silc_obj* t = silc_int_mem_get_ref(mem, weak_ref, NULL, NULL);
+    if (SILC_GET_TYPE(t[0]) != SILC_TYPE_INL && !survives(mem, t[0], min_index)) {
+      t[0] = SILC_OBJ_NIL;
+    }
+    if (t[0] != SILC_OBJ_NIL) {
+      mem->weak_refs.arr[count++] = pos; /* cleared references need no further processing */
+    }
+  }
+  mem->weak_refs.count = count;
+}
+
+/**
+ * Marks the open regions escaped, that hold the written value, but not its holder. Stack slots are popped and cleared
+ * before the regions, that have been opened after they were pushed, are closed, so stack writes are not recorded.
+ */
+static void record_region_write(struct silc_mem_t* mem, silc_obj holder, silc_obj value) {
+  if (SILC_GET_TYPE(holder) != SILC_TYPE_CONS &&
+      silc_int_mem_get_obj_subtype(silc_int_mem_get_contents(mem, holder)) == SILC_OREF_STACK_SUBTYPE) {
+    return;
+  }
+
+  /* regions are nested, so the outer ones hold the objects of the inner ones */
+  for (struct silc_region_t* region = mem->region; region != NULL && !region->abandoned; region = region->prev) {
+    if (is_in_region(region, holder)) {
+      break;
+    }
+    if (is_in_region(region, value)) {
+      region->escaped = true;
+    }
+  }
+}
+
+/** Returns true if some objects of the region are referenced from the older objects or from the handles */
+static bool region_escapes(struct silc_mem_t* mem, struct silc_region_t* region) {
+  if (region->escaped) {
+    return true;
+  }
+
+  /* only the handles, that have been registered in the region and are still open, are checked */
+  for (int i = region->handle_count; i < mem->handle_count; ++i) {
+    if (is_in_region(region, mem->handles[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Releases region objects by restoring the allocation state, that has been saved once the region was opened */
+static void release_region(struct silc_mem_t* mem, struct silc_region_t* region) {
+  mem->avail_index = region->avail_index;
+  mem->pos_count = region->pos_count;
+  mem->cons_count = region->cons_count;
+  mem->young_pos.count = region->young_pos_count;
+  mem->alloc_sample_count = region->alloc_sample_count;
+  mem->weak_refs.count = region->weak_ref_count;
+  update_alloc_limit(mem);
+}
+
+#define SILC_INT_MEM_INITIAL_ROOT_VECTOR_SIZE     (1000)
+
+#define SILC_INT_MEM_INITIAL_HANDLE_STACK_SIZE    (256)
+
+static silc_obj create_root_vector(struct silc_mem_t* mem, int size) {
+  silc_obj root_vector = silc_int_mem_alloc(mem, size + 2, NULL, SILC_TYPE_OREF, SILC_OREF_ROOT_VECTOR_SUBTYPE);
+
+  silc_obj* rv = silc_get_oref(mem, root_vector, NULL);
+
+  rv[0] = silc_int_to_obj(size); /* total capacity */
+  rv[1] = SILC_OBJ_ZERO; /* current size */
+
+  return root_vector;
+}
+
+#ifdef SILC_DIRECT_OBJ
+/** Links gaps between the marked objects into the free lists and clears mark bitmap, marking should be complete */
+static void sweep_heap(struct silc_mem_t* mem) {
+  int free_tails[SILC_INT_MEM_FREE_LIST_COUNT];
+  for (int i = 0; i < SILC_INT_MEM_FREE_LIST_COUNT; ++i) {
+    mem->free_heads[i] = -1;
+    free_tails[i] = -1;
+  }
+  mem->free_memory = 0;
+  mem->pos_count = 0;
+
+  /* free lists are rebuilt in ascending order, so that allocation fills the heap bottom first */
+  int free_start = 0;
+  int mark_bits_size = get_bitmap_size(mem->avail_index);
+  for (int w = 0; w < mark_bits_size; ++w) {
+    unsigned int bits = mem->mark_bits[w];
+    mem->mark_bits[w] = 0; /* mark bitmap is cleared along the way */
+
+    for (; bits != 0; bits &= bits - 1) {
+      int obj_index = w * SILC_INT_MEM_BITMAP_WORD_BITS + __builtin_ctz(bits);
+      if (obj_index > free_start) {
+        SILC_ASSERT(obj_index - free_start >= 2); /* objects and free chunks take at least two units */
+        append_free_chunk(mem, free_tails, free_start, obj_index - free_start);
+      }
+      free_start = obj_index + get_obj_size(mem->buf + obj_index, get_pos_type(mem, obj_index));
+      ++mem->pos_count;
+    }
+  }
+
+  /* trailing gap is given back to the bump allocator */
+  mem->avail_index = free_start;
+}
+#else
+/** Links positions from..to-1 into the free list in ascending order, free list tail is kept by the caller */
+static void free_positions(struct silc_mem_t* mem, int from, int to, int* free_pos_tail) {
+  for (int j = from; j < to; ++j) {
+    /* vacant position or object is not referenced from GC roots and thus it is eligible for garbage collection */
+    mem->buf[mem->last_pos_index - j] = SILC_INT_MEM_MAKE_FREE_POS(-1);
+    if (*free_pos_tail >= 0) {
+      mem->buf[mem->last_pos_index - *free_pos_tail] = SILC_INT_MEM_MAKE_FREE_POS(j);
+    } else {
+      mem->free_pos_head = j;
+    }
+    *free_pos_tail = j;
+    ++mem->free_pos_count;
+  }
+}
+
+/** Frees positions of unreachable objects and slides live objects towards the heap start, marking should be complete */
+static void compact_heap(struct silc_mem_t* mem) {
+  /* prepare bitmap of live object starts, so that compaction could walk the heap in address order */
+  int bitmap_size = (mem->avail_index + SILC_INT_MEM_BITMAP_WORD_BITS - 1) / SILC_INT_MEM_BITMAP_WORD_BITS;
+  unsigned int* live_starts = get_gc_bitmap(mem, bitmap_size);
+
+  /*
+   * Sweep position table: walk the marked positions and thread the live objects, i.e. swap the first content word
+   * of every live object with its position entry so that object knows its own position during the slide.
+   * Unmarked positions between the live ones are linked into the free list in ascending order, trailing ones are
+   * cut off from the position table.
+   */
+  int new_pos_count = 0;
+  int free_pos_tail = -1;
+  mem->free_pos_head = -1;
+  mem->free_pos_count = 0;
+  int mark_bits_size = (mem->pos_count + SILC_INT_MEM_BITMAP_WORD_BITS - 1) / SILC_INT_MEM_BITMAP_WORD_BITS;
+  for (int w = 0; w < mark_bits_size; ++w) {
+    unsigned int bits = mem->mark_bits[w];
+    mem->mark_bits[w] = 0; /* mark bitmap is cleared along the way */
+
+    for (; bits != 0; bits &= bits - 1) {
+      int i = w * SILC_INT_MEM_BITMAP_WORD_BITS + __builtin_ctz(bits);
+      free_positions(mem, new_pos_count, i, &free_pos_tail);
+      new_pos_count = i + 1;
+      int index_pos = mem->last_pos_index - i;
+      silc_obj pos_fval = mem->buf[index_pos];
+      if (pos_fval & SILC_INT_MEM_POS_LARGE_BIT) {
+        mem->buf[index_pos] = pos_fval & ~SILC_INT_MEM_POS_REMEMBERED_BIT; /* large objects stay in place */
+        continue;
+      }
+
+      int obj_index = pos_fval >> SILC_INT_MEM_POS_SHIFT;
+      live_starts[obj_index / SILC_INT_MEM_BITMAP_WORD_BITS] |= 1U << (obj_index % SILC_INT_MEM_BITMAP_WORD_BITS);
+      mem->buf[index_pos] = mem->buf[obj_index];
+      mem->buf[obj_index] = (((silc_obj) i) << SILC_INT_TYPE_SHIFT) | (pos_fval & SILC_INT_TYPE_MASK);
+    }
+  }
+
+  /* slide live objects towards the heap start, every object is moved at most once */
+  int dest_index = 0;
+  for (int w = 0; w < bitmap_size; ++w) {
+    for (unsigned int bits = live_starts[w]; bits != 0; bits &= bits - 1) {
+      int obj_index = w * SILC_INT_MEM_BITMAP_WORD_BITS + __builtin_ctz(bits);
+      silc_obj thread = mem->buf[obj_index];
+      int index_pos = mem->last_pos_index - (int) (thread >> SILC_INT_TYPE_SHIFT);
+      int type = thread & SILC_INT_TYPE_MASK;
+
+      /* unthread: restore the first content word, then the object size can be calculated */
+      mem->buf[obj_index] = mem->buf[index_pos];
+      int obj_size = get_obj_size(mem->buf + obj_index, type);
+
+      if (dest_index != obj_index) {
+        memmove(mem->buf + dest_index, mem->buf + obj_index, obj_size * sizeof(silc_obj));
+        mem->gc_counters.moved_bytes += obj_size * (long long) sizeof(silc_obj);
+      }
+      mem->buf[index_pos] = ((silc_obj) dest_index << SILC_INT_MEM_POS_SHIFT) | type;
+      dest_index += obj_size;
+    }
+  }
+
+  mem->avail_index = dest_index;
+  mem->pos_count = new_pos_count;
+}
+
+/*
+ * Semispace copier.
+ * Full collection of the semispace strategy traces live objects by copying them to the to-space (Cheney's algorithm)
+ * and then swaps the to-space with the heap buffer. References hold positions, so an object is forwarded by updating
+ * its position word and its mark bit tells that it has been copied. Copied objects are scanned breadth-first
+ * in address order, object layout does not tell byte references apart, so they are flagged in the GC bitmap.
+ * Cells and large objects are never moved, they are scanned from the mark stack.
+ */
+
+/** Returns to-space of the heap size, see silc_mem_t.to_space, it is kept between the collections */
+static silc_obj* get_to_space(struct silc_mem_t* mem) {
+  if (mem->to_space == NULL) {
+    if (mem->heap_reserved_size > 0) {
+      mem->to_space = map_heap(sizeof(silc_obj) * (size_t) mem->heap_reserved_size);
+      if (mem->to_space == NULL) {
+        mem->init->oom_abort(mem->init);
+      }
+    } else {
+      mem->to_space = mem->init->alloc_mem(sizeof(silc_obj) * (mem->last_pos_index + 1));
+    }
+  }
+  return mem->to_space;
+}
+
+/** Copies the object to the to-space unless it has already been reached, unmoved objects are pushed to mark stack */
+static void copy_object(struct silc_mem_t* mem, silc_obj obj, unsigned int* bref_starts, int* free_index) {
+  if (!gc_try_mark(mem, obj, SILC_INT_MEM_FULL_MARKING)) {
+    return;
+  }
+
+  if (SILC_GET_TYPE(obj) == SILC_TYPE_CONS) {
+    pos_vec_add(mem, &mem->mark_stack, to_mark_entry(obj));
+    return;
+  }
+
+  int index_pos = silc_int_mem_get_pos_index(mem, obj);
+  silc_obj pos_fval = mem->buf[index_pos];
+  int type = pos_fval & SILC_INT_TYPE_MASK;
+  if (pos_fval & SILC_INT_MEM_POS_LARGE_BIT) {
+    mem->buf[index_pos] = pos_fval & ~SILC_INT_MEM_POS_REMEMBERED_BIT; /* large objects stay in place */
+    if (type == SILC_TYPE_OREF) {
+      pos_vec_add(mem, &mem->mark_stack, to_mark_entry(obj));
+    }
+    return;
+  }
+
+  int obj_index = (int) (pos_fval >> SILC_INT_MEM_POS_SHIFT);
+  int obj_size = get_obj_size(mem->buf + obj_index, type);
+  memcpy(mem->to_space + *free_index, mem->buf + obj_index, obj_size * sizeof(silc_obj));
+  if (type == SILC_TYPE_BREF) {
+    SILC_INT_MEM_SET_BIT(bref_starts, *free_index);
+  }
+  mem->buf[index_pos] = ((silc_obj) *free_index << SILC_INT_MEM_POS_SHIFT) | type;
+  mem->gc_counters.moved_bytes += obj_size * (long long) sizeof(silc_obj);
+  *free_index += obj_size;
+}
+
+/** Returns contents of the object, that has been reached by the ongoing copying collection */
+static silc_obj* get_copied_contents(struct silc_mem_t* mem, silc_obj obj) {
+  silc_obj pos_fval = mem->buf[silc_int_mem_get_pos_index(mem, obj)];
+  if (pos_fval & SILC_INT_MEM_POS_LARGE_BIT) {
+    return silc_int_mem_get_contents(mem, obj);
+  }
+  return mem->to_space + (int) (pos_fval >> SILC_INT_MEM_POS_SHIFT);
+}
+
+/**
+ * Copies objects, reachable from the roots, to the to-space and swaps it with the heap buffer.
+ * Reached objects and cells stay marked, so that the rest of the heap is swept as after marking.
+ */
+static void copy_live_objects(struct silc_mem_t* mem) {
+  ensure_mark_bits(mem);
+  silc_obj* to_space = get_to_space(mem);
+  unsigned int* bref_starts = get_gc_bitmap(mem, get_bitmap_size(mem->avail_index));
+  int free_index = 0;
+
+  /* root vector entries are copied up to its size rather than its capacity, so root vector is not scanned */
+  copy_object(mem, mem->root_vector, bref_starts, &free_index);
+  mem->mark_stack.count = 0;
+  int scan_index = free_index;
+
+  silc_obj* rv = get_copied_contents(mem, mem->root_vector);
+  rv += silc_int_mem_get_obj_header_size(rv);
+  int size = silc_obj_to_int(rv[1]);
+  for (int i = 0; i < size; ++i) {
+    copy_object(mem, rv[2 + i], bref_starts, &free_index);
+  }
+  for (int i = 0; i < mem->handle_count; ++i) {
+    copy_object(mem, mem->handles[i], bref_starts, &free_index);
+  }
+
+  /* scan copied objects in their copying order, unmoved ones are scanned once the to-space scan catches up */
+  for (;;) {
+    silc_obj* t;
+    int from = 0;
+    int to = 0;
+    if (scan_index < free_index) {
+      t = to_space + scan_index;
+      bool bref = SILC_INT_MEM_TEST_BIT(bref_starts, scan_index);
+      scan_index += get_obj_size(t, bref ? SILC_TYPE_BREF : SILC_TYPE_OREF);
+      if (!bref) {
+        from = silc_int_mem_get_obj_header_size(t);
+        to = from + get_traced_length(t);
+      }
+    } else if (mem->mark_stack.count > 0) {
+      silc_obj obj = from_mark_entry(mem->mark_stack.arr[--mem->mark_stack.count]);
+      t = silc_int_mem_get_contents(mem, obj);
+      if (SILC_GET_TYPE(obj) == SILC_TYPE_CONS) {
+        to = 2;
+      } else {
+        from = silc_int_mem_get_obj_header_size(t);
+        to = from + get_traced_length(t);
+      }
+    } else {
+      break;
+    }
+
+    for (int i = from; i < to; ++i) {
+      copy_object(mem, t[i], bref_starts, &free_index);
+    }
+  }
+
+  /* position table is moved along with the objects */
+  int heap_size = mem->last_pos_index + 1;
+  memcpy(to_space + heap_size - mem->pos_count, mem->buf + heap_size - mem->pos_count,
+         mem->pos_count * sizeof(silc_obj));
+  mem->to_space = mem->buf;
+  mem->buf = to_space;
+  mem->avail_index = free_index;
+}
+
+/** Frees positions of unreachable objects and clears position marks, live objects should have been copied */
+static void sweep_positions(struct silc_mem_t* mem) {
+  int new_pos_count = 0;
+  int free_pos_tail = -1;
+  mem->free_pos_head = -1;
+  mem->free_pos_count = 0;
+  int mark_bits_size = (mem->pos_count + SILC_INT_MEM_BITMAP_WORD_BITS - 1) / SILC_INT_MEM_BITMAP_WORD_BITS;
+  for (int w = 0; w < mark_bits_size; ++w) {
+    unsigned int bits = mem->mark_bits[w];
+    mem->mark_bits[w] = 0;
+
+    for (; bits != 0; bits &= bits - 1) {
+      int i = w * SILC_INT_MEM_BITMAP_WORD_BITS + __builtin_ctz(bits);
+      free_positions(mem, new_pos_count, i, &free_pos_tail);
+      new_pos_count = i + 1;
+    }
+  }
+
+  mem->pos_count = new_pos_count;
+}
+#endif /* SILC_DIRECT_OBJ */
+
+/*
+ * Background collection.
+ * Background thread collects garbage while the heap is parked, i.e. while the mutator is idle and holds no pointers
+ * to the object contents. Work is done in chunks and the heap is consistent after each of them, so unparking only
+ * waits for the current chunk. A cycle consists of:
+ * <ul>
+ *  <li>incremental marking, it is carried on by allocation slices if the heap gets unparked in the middle of it</li>
+ *  <li>sweep, that frees positions of the dead objects and plans evacuation of the live ones</li>
+ *  <li>evacuation, that slides live objects one by one towards the heap start</li>
+ * </ul>
+ * Evacuated object is found at its new address once its position word is updated. Position words and the plan are
+ * written by plain stores: unparking takes bg->lock and waits for the chunk to complete, which orders the stores
+ * before the next access of the mutator. Objects, that the mutator places on top of the heap between the chunks,
+ * are evacuated after the planned ones, so that the evacuated area is not left as a hole below them.
+ * Full collection cancels pending evacuation.
+ */
+
+/* Amount of silc_obj units, that background thread marks or moves before checking whether heap is unparked */
+#define SILC_INT_MEM_BACKGROUND_CHUNK_SIZE        (4096)
+
+/* Background cycle is started once heap grows by this percent of its size since the last collection */
+#define SILC_INT_MEM_BACKGROUND_GC_GROWTH_PERCENT (10)
+
+struct silc_mem_background_gc_t {
+  pthread_t                 thread;
+  pthread_mutex_t           lock;
+  pthread_cond_t            work_cond;
+  pthread_cond_t            idle_cond;
+
+  bool                      parked;
+  bool                      busy;
+  bool                      shutdown;
+
+  /** Evacuation plan: live objects as (heap index << 32 | position) pairs, ordered by heap index */
+  unsigned long long*       evac;
+  int                       evac_count;
+  int                       evac_next;
+
+  /** Heap index, where the next evacuated object is placed */
+  int                       evac_dest_index;
+
+  /** Heap index, that ends evacuated area */
+  int                       evac_end_index;
+};
+
+#ifndef SILC_DIRECT_OBJ
+static int compare_evac_entries(const void* lhs, const void* rhs) {
+  unsigned long long l = *(const unsigned long long*) lhs;
+  unsigned long long r = *(const unsigned long long*) rhs;
+  return l < r ? -1 : (l > r ? 1 : 0);
+}
+#endif
+
+static void cancel_evacuation(struct silc_mem_t* mem) {
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+  if (bg != NULL && bg->evac != NULL) {
+    mem->init->free_mem(bg->evac);
+    bg->evac = NULL;
+    bg->evac_count = 0;
+    bg->evac_next = 0;
+  }
+}
+
+/** Frees positions of unreachable objects and plans evacuation of the live ones, marking should be complete */
+static void sweep_and_plan_evacuation(struct silc_mem_t* mem) {
+#ifdef SILC_DIRECT_OBJ
+  /* objects never move in the direct mode, so the cycle is completed by the sweep */
+  sweep_alloc_samples(mem, SILC_INT_MEM_FULL_MARKING);
+  sweep_weak_refs(mem, SILC_INT_MEM_FULL_MARKING);
+  sweep_cons_region(mem);
+  sweep_heap(mem);
+  reset_young_generation(mem);
+  mem->last_gc_avail_index = silc_int_mem_get_alloc_index(mem);
+  update_gc_trigger(mem);
+#else
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+  int live_count = mem->pos_count - mem->free_pos_count;
+  bg->evac = mem->init->alloc_mem(sizeof(unsigned long long) * (live_count > 0 ? live_count : 1));
+  bg->evac_count = 0;
+  bg->evac_next = 0;
+
+  sweep_alloc_samples(mem, SILC_INT_MEM_FULL_MARKING);
+  sweep_weak_refs(mem, SILC_INT_MEM_FULL_MARKING);
+  sweep_large_objects(mem);
+  sweep_cons_region(mem);
+
+  /* rebuild free position list in ascending order */
+  int free_pos_tail = -1;
+  mem->free_pos_head = -1;
+  mem->free_pos_count = 0;
+  for (int i = 0; i < mem->pos_count; ++i) {
+    int index_pos = mem->last_pos_index - i;
+    if (!silc_int_mem_is_pos_marked(mem, i)) {
+      mem->buf[index_pos] = SILC_INT_MEM_MAKE_FREE_POS(-1);
+      if (free_pos_tail >= 0) {
+        mem->buf[mem->last_pos_index - free_pos_tail] = SILC_INT_MEM_MAKE_FREE_POS(i);
+      } else {
+        mem->free_pos_head = i;
+      }
+      free_pos_tail = i;
+      ++mem->free_pos_count;
+      continue;
+    }
+
+    /* all the live objects become old, so remembered set is no longer needed */
+    silc_obj pos_fval = mem->buf[index_pos] & ~SILC_INT_MEM_POS_REMEMBERED_BIT;
+    mem->buf[index_pos] = pos_fval;
+    if ((pos_fval & SILC_INT_MEM_POS_LARGE_BIT) == 0) {
+      bg->evac[bg->evac_count++] = (((unsigned long long) (pos_fval >> SILC_INT_MEM_POS_SHIFT)) << 32) | i;
+    }
+  }
+  clear_mark_bits(mem);
+
+  qsort(bg->evac, bg->evac_count, sizeof(unsigned long long), compare_evac_entries);
+  bg->evac_dest_index = 0;
+  bg->evac_end_index = mem->avail_index;
+  reset_young_generation(mem);
+#endif
+}
+
+#ifndef SILC_DIRECT_OBJ
+/**
+ * Plans evacuation of the objects between the evacuated area and the given heap index, they have been allocated
+ * or promoted since the previous plan.
+ */
+static void plan_evacuation_above(struct silc_mem_t* mem, int top_index) {
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+  int live_count = mem->pos_count - mem->free_pos_count;
+  mem->init->free_mem(bg->evac);
+  bg->evac = mem->init->alloc_mem(sizeof(unsigned long long) * (live_count > 0 ? live_count : 1));
+  bg->evac_count = 0;
+  bg->evac_next = 0;
+
+  for (int i = 0; i < mem->pos_count; ++i) {
+    silc_obj pos_fval = mem->buf[mem->last_pos_index - i];
+    if (SILC_INT_MEM_IS_FREE_POS(pos_fval) || (pos_fval & SILC_INT_MEM_POS_LARGE_BIT) != 0) {
+      continue;
+    }
+
+    int obj_index = (int) (pos_fval >> SILC_INT_MEM_POS_SHIFT);
+    if (obj_index >= bg->evac_end_index && obj_index < top_index) {
+      bg->evac[bg->evac_count++] = (((unsigned long long) obj_index) << 32) | i;
+    }
+  }
+
+  qsort(bg->evac, bg->evac_count, sizeof(unsigned long long), compare_evac_entries);
+  bg->evac_end_index = top_index;
+}
+#endif
+
+/** Slides planned objects towards the heap start until the given amount of memory is moved */
+static void evacuate(struct silc_mem_t* mem, int budget) {
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+  int moved = 0;
+
+  while (moved < budget && bg->evac_next < bg->evac_count) {
+    unsigned long long entry = bg->evac[bg->evac_next++];
+    int obj_index = (int) (entry >> 32);
+    int index_pos = mem->last_pos_index - (int) (entry & 0xffffffffULL);
+    silc_obj pos_fval = mem->buf[index_pos];
+    int obj_size = get_obj_size(mem->buf + obj_index, pos_fval & SILC_INT_TYPE_MASK);
+
+    if (bg->evac_dest_index != obj_index) {
+      memmove(mem->buf + bg->evac_dest_index, mem->buf + obj_index, obj_size * sizeof(silc_obj));
+      moved += obj_size;
+      mem->gc_counters.moved_bytes += obj_size * (long long) sizeof(silc_obj);
+    }
+
+    /* publish new address, service bits set by the mutator since the sweep are preserved */
+    silc_obj new_fval = (((silc_obj) bg->evac_dest_index) << SILC_INT_MEM_POS_SHIFT) |
+        (pos_fval & ((1 << SILC_INT_MEM_POS_SHIFT) - 1));
+    mem->buf[index_pos] = new_fval;
+    bg->evac_dest_index += obj_size;
+  }
+
+  if (bg->evac_next == bg->evac_count) {
+#ifndef SILC_DIRECT_OBJ
+    /* old objects, that have been placed on top of the evacuated area, are evacuated as well */
+    int top_index = mem->young_pos.count > 0 ? mem->young_index : mem->avail_index;
+    if (top_index > bg->evac_end_index) {
+      plan_evacuation_above(mem, top_index);
+      return;
+    }
+#endif
+
+    if (mem->avail_index == bg->evac_end_index) {
+      if (mem->heap_reserved_size > 0) {
+        decommit_heap(mem->buf, bg->evac_dest_index, bg->evac_end_index);
+      }
+      mem->avail_index = bg->evac_dest_index;
+    }
+    /* young objects stay in place, the next minor collection slides them down over the evacuated area */
+    mem->young_index = bg->evac_dest_index;
+    update_alloc_limit(mem);
+    mem->last_gc_avail_index = mem->avail_index;
+    update_gc_trigger(mem);
+    cancel_evacuation(mem);
+  }
+}
+
+static bool has_background_gc_work(struct silc_mem_t* mem) {
+  long long growth = (long long) silc_int_mem_get_alloc_index(mem) - mem->last_gc_avail_index +
+      2LL * (mem->cons_count - mem->cons_free_count - mem->last_gc_cons_used);
+  return mem->background_gc->evac != NULL || mem->marking ||
+      growth * 100 > (long long) (mem->last_pos_index + 1) * SILC_INT_MEM_BACKGROUND_GC_GROWTH_PERCENT;
+}
+
+/** Does a chunk of background collection work, the heap should be parked */
+static void do_background_gc_chunk(struct silc_mem_t* mem) {
+  if (mem->background_gc->evac != NULL) {
+    evacuate(mem, SILC_INT_MEM_BACKGROUND_CHUNK_SIZE);
+    return;
+  }
+
+  if (!mem->marking) {
+    start_incremental_marking(mem);
+  }
+
+  if (gc_drain(mem, SILC_INT_MEM_FULL_MARKING, SILC_INT_MEM_BACKGROUND_CHUNK_SIZE)) {
+    finish_incremental_marking(mem);
+    sweep_and_plan_evacuation(mem);
+    update_alloc_limit(mem);
+  }
+}
+
+static void* background_gc_thread(void* arg) {
+  struct silc_mem_t* mem = arg;
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+
+  pthread_mutex_lock(&bg->lock);
+  for (;;) {
+    while (!bg->shutdown && !(bg->parked && has_background_gc_work(mem))) {
+      pthread_cond_wait(&bg->work_cond, &bg->lock);
+    }
+    if (bg->shutdown) {
+      break;
+    }
+
+    bg->busy = true;
+    pthread_mutex_unlock(&bg->lock);
+
+    do_background_gc_chunk(mem);
+
+    pthread_mutex_lock(&bg->lock);
+    bg->busy = false;
+    pthread_cond_broadcast(&bg->idle_cond);
+  }
+  pthread_mutex_unlock(&bg->lock);
+
+  return NULL;
+}
+
+static void init_background_gc(struct silc_mem_t* mem) {
+  struct silc_mem_background_gc_t* bg = mem->init->alloc_mem(sizeof(struct silc_mem_background_gc_t));
+  pthread_mutex_init(&bg->lock, NULL);
+  pthread_cond_init(&bg->work_cond, NULL);
+  pthread_cond_init(&bg->idle_cond, NULL);
+  bg->parked = false;
+  bg->busy = false;
+  bg->shutdown = false;
+  bg->evac = NULL;
+  bg->evac_count = 0;
+  bg->evac_next = 0;
+  mem->background_gc = bg;
+
+  if (pthread_create(&bg->thread, NULL, background_gc_thread, mem) != 0) {
+    fputs(";; [FATAL] unable to start background GC thread\n", stderr);
+    abort();
+  }
+}
+
+static void free_background_gc(struct silc_mem_t* mem) {
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+
+  pthread_mutex_lock(&bg->lock);
+  bg->shutdown = true;
+  pthread_cond_signal(&bg->work_cond);
+  pthread_mutex_unlock(&bg->lock);
+  pthread_join(bg->thread, NULL);
+
+  cancel_evacuation(mem);
+  pthread_cond_destroy(&bg->idle_cond);
+  pthread_cond_destroy(&bg->work_cond);
+  pthread_mutex_destroy(&bg->lock);
+  mem->init->free_mem(bg);
+  mem->background_gc = NULL;
+}
+
+/** Adjusts heap settings before the heap is initialized */
+static void prepare_init(struct silc_mem_init_t* init) {
+#ifdef SILC_DIRECT_OBJ
+  /* young and large objects are told apart by the position table, see SILC_DIRECT_OBJ */
+  init->nursery_size = 0;
+  init->large_object_size = 0;
+  init->gc_strategy = SILC_MEM_GC_MARK_COMPACT; /* objects never move, so the heap is swept */
+#endif
+
+  /* objects, that can be allocated by the inline fast path, are never large */
+  if (init->large_object_size > 0 && init->large_object_size <= SILC_INT_MEM_MAX_INLINE_ALLOC_SIZE) {
+    init->large_object_size = SILC_INT_MEM_MAX_INLINE_ALLOC_SIZE + 1;
+  }
+
+  /* positions, heap indexes and cells should be encodable in the object references */
+  if (init->init_memory_size > SILC_INT_MEM_MAX_MEMORY_SIZE) {
+    init->init_memory_size = SILC_INT_MEM_MAX_MEMORY_SIZE;
+  }
+  if (init->max_memory_size > SILC_INT_MEM_MAX_MEMORY_SIZE) {
+    init->max_memory_size = SILC_INT_MEM_MAX_MEMORY_SIZE;
+  }
+
+  if (init->init_root_vector_size <= 0) {
+    init->init_root_vector_size = SILC_INT_MEM_INITIAL_ROOT_VECTOR_SIZE;
+  }
+}
+
+/** Starts collector threads, the heap should be initialized */
+static void start_gc_threads(struct silc_mem_t* mem) {
+  if (mem->init->gc_threads > 0) {
+    init_gc_pool(mem, mem->init->gc_threads);
+  }
+
+  if (mem->init->background_gc) {
+    init_background_gc(mem);
+  }
+}
+
+/*
+ * Heap image.
+ * Image is written right after the full collection: the heap is compact, there is no young generation and marking
+ * is not in progress. Image consists of the header and the sections, that are copied back as is on restore, since
+ * positions and cells are preserved: objects, position table, cons cells, weak reference positions and large
+ * object slots. Every large object slot is followed by the object contents unless the slot is vacant.
+ * Direct mode image has type bitmap and free list heads in place of the position table.
+ */
+
+#ifdef SILC_DIRECT_OBJ
+#define SILC_INT_MEM_IMAGE_DIRECT       (1)
+#else
+#define SILC_INT_MEM_IMAGE_DIRECT       (0)
+#endif
+
+#ifdef SILC_OBJ64
+#define SILC_INT_MEM_IMAGE_OBJ64        (1)
+#else
+#define SILC_INT_MEM_IMAGE_OBJ64        (0)
+#endif
+
+/* Image format version, it changes along with the object layout, see SILC_INT_MEM_SUBTYPE_BITS, and the header */
+#define SILC_INT_MEM_IMAGE_VERSION      (3)
+
+struct silc_mem_image_header_t {
+  int                       version;
+  /** Representation, see SILC_DIRECT_OBJ, image is restored by the builds of the same representation only */
+  int                       direct;
+  /** Object word, see SILC_OBJ64, these fields precede the first silc_obj one, so that they are read by any build */
+  int                       obj64;
+  int                       obj_size;
+  int                       avail_index;
+  int                       pos_count;
+  int                       free_pos_head;
+  int                       free_pos_count;
+  int                       cons_count;
+  int                       cons_free_head;
+  int                       cons_free_count;
+  int                       weak_ref_count;
+  int                       large_obj_count;
+  int                       large_obj_free_head;
+  silc_obj                  root_vector;
+};
+
+/** Large object slot, size is -1 for the vacant one and then pos is the next vacant slot */
+struct silc_mem_image_large_obj_t {
+  int                       pos;
+  int                       size;
+};
+
+/** Image reader, that is positioned at the next section */
+struct silc_mem_image_reader_t {
+  const char*               image;
+  size_t                    size;
+  size_t                    offset;
+};
+
+/** Copies the next section of the given size to dest (unless it is NULL), returns false if image is truncated */
+static bool read_image_section(struct silc_mem_image_reader_t* r, void* dest, size_t size) {
+  if (size > r->size - r->offset) {
+    return false;
+  }
+
+  if (dest != NULL) {
+    memcpy(dest, r->image + r->offset, size);
+  }
+  r->offset += size;
+  return true;
+}
+
+/**
+ * Checks image header and section sizes, returns false if image is malformed.
+ * Counts are checked against the image size before heap is sized by them, so that they can't overflow it.
+ */
+static bool check_image(struct silc_mem_image_reader_t r, const struct silc_mem_image_header_t* h) {
+  if (h->version != SILC_INT_MEM_IMAGE_VERSION || h->direct != SILC_INT_MEM_IMAGE_DIRECT ||
+      h->obj64 != SILC_INT_MEM_IMAGE_OBJ64 || h->obj_size != (int) sizeof(silc_obj) || h->avail_index < 0 ||
+      h->pos_count < 0 || h->cons_count < 0 || h->weak_ref_count < 0 || h->large_obj_count < 0 ||
+      h->free_pos_count > h->pos_count || h->cons_free_count > h->cons_count ||
+      h->pos_count > INT_MAX / 2 - h->avail_index || h->cons_count > INT_MAX / 3 ||
+      h->cons_free_head < -1 || h->cons_free_head >= h->cons_count ||
+      h->large_obj_free_head < -1 || h->large_obj_free_head >= h->large_obj_count) {
+    return false;
+  }
+
+#ifdef SILC_DIRECT_OBJ
+  bool ok = read_image_section(&r, NULL, sizeof(silc_obj) * (size_t) h->avail_index) &&
+      read_image_section(&r, NULL, sizeof(unsigned int) * (size_t) get_bitmap_size(h->avail_index)) &&
+      read_image_section(&r, NULL, sizeof(int) * SILC_INT_MEM_FREE_LIST_COUNT) &&
+#else
+  bool ok = read_image_section(&r, NULL, sizeof(silc_obj) * ((size_t) h->avail_index + h->pos_count)) &&
+#endif
+      read_image_section(&r, NULL, sizeof(silc_obj) * 2 * (size_t) h->cons_count);
+  for (int i = 0; ok && i < h->weak_ref_count; ++i) {
+    int pos = 0;
+    ok = read_image_section(&r, &pos, sizeof(pos)) && pos >= 0 &&
+        pos < (SILC_INT_MEM_IMAGE_DIRECT ? h->avail_index : h->pos_count); /* heap index in the direct mode */
+  }
+
+  /* every large object slot takes at least its header */
+  ok = ok && (size_t) h->large_obj_count <= (r.size - r.offset) / sizeof(struct silc_mem_image_large_obj_t);
+  for (int i = 0; ok && i < h->large_obj_count; ++i) {
+    struct silc_mem_image_large_obj_t lo = {0};
+    ok = read_image_section(&r, &lo, sizeof(lo)) && (lo.size == -1 || lo.size > 0) &&
+        read_image_section(&r, NULL, sizeof(silc_obj) * (size_t) (lo.size > 0 ? lo.size : 0));
+  }
+  return ok;
+}
+
+/*
+ * Shared heap.
+ * Frozen heap is read by the heaps, that share it, through the shared references, see SILC_INT_MEM_SHARED_BIT.
+ * References between the frozen objects are turned into the shared ones in place, so that their contents are read
+ * by the sharing heaps as is. Sharing heaps never mark shared objects, so that frozen heap is never written to
+ * and it can be read by any count of threads.
+ */
+
+/** Turns references of the marked objects and cells into the shared ones and clears their marks */
+static void share_marked_objects(struct silc_mem_t* mem) {
+  for (int w = 0; w < mem->mark_bits_size; ++w) {
+    for (unsigned int bits = mem->mark_bits[w]; bits != 0; bits &= bits - 1) {
+      int pos = w * SILC_INT_MEM_BITMAP_WORD_BITS + __builtin_ctz(bits);
+      if (get_pos_type(mem, pos) != SILC_TYPE_OREF) {
+        continue; /* byte references hold no references */
+      }
+
+      int len = 0;
+      silc_obj* contents = silc_get_oref(mem, (((silc_obj) pos) << SILC_INT_TYPE_SHIFT) | SILC_TYPE_OREF, &len);
+      for (int i = 0; i < len; ++i) {
+        contents[i] = silc_int_mem_make_shared(contents[i]);
+      }
+    }
+    mem->mark_bits[w] = 0;
+  }
+
+  int cons_bits_size = get_bitmap_size(mem->cons_capacity);
+  for (int w = 0; w < cons_bits_size; ++w) {
+    for (unsigned int bits = mem->cons_mark_bits[w]; bits != 0; bits &= bits - 1) {
+      silc_obj* contents = mem->cons_buf + 2 * (w * SILC_INT_MEM_BITMAP_WORD_BITS + __builtin_ctz(bits));
+      contents[0] = silc_int_mem_make_shared(contents[0]);
+      contents[1] = silc_int_mem_make_shared(contents[1]);
+    }
+    mem->cons_mark_bits[w] = 0;
+  }
+}
+
+/* External functions */
+
+void silc_int_mem_init(struct silc_mem_t* new_mem, struct silc_mem_init_t* init) {
+  new_mem->init = init;
+  prepare_init(init);
+  init_heap(new_mem, init, get_init_cons_capacity(init));
+
+  /* Alloc root vector */
+  new_mem->root_vector = create_root_vector(new_mem, init->init_root_vector_size);
+
+  start_gc_threads(new_mem);
+}
+
+size_t silc_int_mem_init_from_image(struct silc_mem_t* new_mem, struct silc_mem_init_t* init, const char* image,
+                                    size_t size) {
+  struct silc_mem_image_header_t h;
+  struct silc_mem_image_reader_t r = { .image = image, .size = size, .offset = 0 };
+  if (!read_image_section(&r, &h, sizeof(h)) || !check_image(r, &h)) {
+    return 0;
+  }
+
+  /* heap buffer is sized to fit the image twice, so that restored context does not start with collection */
+  int image_memory_size = h.avail_index + (SILC_INT_MEM_IMAGE_DIRECT ? 0 : h.pos_count);
+  int cons_capacity = h.cons_count + h.cons_count / 2;
+  if (cons_capacity < get_init_cons_capacity(init)) {
+    cons_capacity = get_init_cons_capacity(init);
+  }
+  long long memory_size = 2LL * image_memory_size + 2LL * cons_capacity;
+  if (memory_size > SILC_INT_MEM_MAX_MEMORY_SIZE) {
+    return 0; /* image does not fit the largest heap */
+  }
+  if (init->init_memory_size < memory_size) {
+    init->init_memory_size = (int) memory_size;
+  }
+  if (init->max_memory_size < init->init_memory_size) {
+    init->max_memory_size = init->init_memory_size;
+  }
+
+  prepare_init(init);
+  new_mem->init = init;
+  init_heap(new_mem, init, cons_capacity);
+
+  /* objects and positions */
+  read_image_section(&r, new_mem->buf, sizeof(silc_obj) * h.avail_index);
+#ifdef SILC_DIRECT_OBJ
+  read_image_section(&r, new_mem->bref_bits, sizeof(unsigned int) * get_bitmap_size(h.avail_index));
+  read_image_section(&r, new_mem->free_heads, sizeof(int) * SILC_INT_MEM_FREE_LIST_COUNT);
+  for (int i = 0; i < SILC_INT_MEM_FREE_LIST_COUNT; ++i) {
+    for (int index = new_mem->free_heads[i]; index >= 0; index = SILC_INT_MEM_NEXT_FREE_POS(new_mem->buf[index])) {
+      new_mem->free_memory += (int) new_mem->buf[index + 1];
+    }
+  }
+#else
+  read_image_section(&r, new_mem->buf + new_mem->last_pos_index + 1 - h.pos_count, sizeof(silc_obj) * h.pos_count);
+#endif
+  new_mem->avail_index = h.avail_index;
+  new_mem->pos_count = h.pos_count;
+  new_mem->free_pos_head = h.free_pos_head;
+  new_mem->free_pos_count = h.free_pos_count;
+  new_mem->last_gc_avail_index = silc_int_mem_get_alloc_index(new_mem);
+  new_mem->root_vector = h.root_vector;
+
+  /* cons cells */
+  read_image_section(&r, new_mem->cons_buf, sizeof(silc_obj) * 2 * h.cons_count);
+  new_mem->cons_count = h.cons_count;
+  new_mem->cons_free_head = h.cons_free_head;
+  new_mem->cons_free_count = h.cons_free_count;
+  new_mem->last_gc_cons_used = h.cons_count - h.cons_free_count;
+
+  /* weak references */
+  for (int i = 0; i < h.weak_ref_count; ++i) {
+    int pos = 0;
+    read_image_section(&r, &pos, sizeof(pos));
+    pos_vec_add(new_mem, &new_mem->weak_refs, pos);
+  }
+
+  /* large objects keep their slots, since positions refer to them */
+  for (int i = 0; i < h.large_obj_count; ++i) {
+    struct silc_mem_image_large_obj_t image_lo = {0};
+    read_image_section(&r, &image_lo, sizeof(image_lo));
+    int slot = alloc_large_obj_slot(new_mem);
+    struct silc_mem_large_obj_t* lo = new_mem->large_objs + slot;
+    lo->pos = image_lo.pos;
+    lo->size = image_lo.size > 0 ? image_lo.size : 0;
+    lo->contents = NULL;
+    if (image_lo.size >= 0) {
+      lo->contents = map_large_object(image_lo.size);
+      if (lo->contents == NULL) {
+        init->oom_abort(init);
+      }
+      read_image_section(&r, lo->contents, sizeof(silc_obj) * image_lo.size);
+      new_mem->large_object_memory += image_lo.size;
+    }
+  }
+  new_mem->large_obj_free_head = h.large_obj_free_head;
+
+  /* budget is raised to fit the restored large objects, as it is for the heap buffer */
+  long long footprint = get_footprint(new_mem);
+  if (init->max_memory_size < footprint) {
+    init->max_memory_size = footprint < SILC_INT_MEM_MAX_MEMORY_SIZE ? (int) footprint : SILC_INT_MEM_MAX_MEMORY_SIZE;
+  }
+
+  /* image holds the live objects of the collected heap, so the next collection is paced by them */
+  reset_young_generation(new_mem);
+  update_gc_trigger(new_mem);
+  update_alloc_limit(new_mem);
+  start_gc_threads(new_mem);
+  return r.offset;
+}
+
+bool silc_int_mem_save_image(struct silc_mem_t* mem, FILE* out) {
+  if (mem->shared != NULL) {
+    return false; /* shared references would be dangling in the restored heap */
+  }
+  silc_int_mem_gc(mem);
+
+  struct silc_mem_image_header_t h = {
+    .version = SILC_INT_MEM_IMAGE_VERSION,
+    .direct = SILC_INT_MEM_IMAGE_DIRECT,
+    .obj64 = SILC_INT_MEM_IMAGE_OBJ64,
+    .obj_size = (int) sizeof(silc_obj),
+    .avail_index = mem->avail_index,
+    .pos_count = mem->pos_count,
+    .free_pos_head = mem->free_pos_head,
+    .free_pos_count = mem->free_pos_count,
+    .cons_count = mem->cons_count,
+    .cons_free_head = mem->cons_free_head,
+    .cons_free_count = mem->cons_free_count,
+    .weak_ref_count = mem->weak_refs.count,
+    .large_obj_count = mem->large_obj_count,
+    .large_obj_free_head = mem->large_obj_free_head,
+    .root_vector = mem->root_vector
+  };
+
+  bool ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+      fwrite(mem->buf, sizeof(silc_obj), h.avail_index, out) == (size_t) h.avail_index &&
+#ifdef SILC_DIRECT_OBJ
+      fwrite(mem->bref_bits, sizeof(unsigned int), get_bitmap_size(h.avail_index), out) ==
+          (size_t) get_bitmap_size(h.avail_index) &&
+      fwrite(mem->free_heads, sizeof(int), SILC_INT_MEM_FREE_LIST_COUNT, out) == SILC_INT_MEM_FREE_LIST_COUNT &&
+#else
+      fwrite(mem->buf + mem->last_pos_index + 1 - h.pos_count, sizeof(silc_obj), h.pos_count, out) ==
+          (size_t) h.pos_count &&
+#endif
+      fwrite(mem->cons_buf, sizeof(silc_obj) * 2, h.cons_count, out) == (size_t) h.cons_count &&
+      fwrite(mem->weak_refs.arr, sizeof(int), h.weak_ref_count, out) == (size_t) h.weak_ref_count;
+
+  for (int i = 0; ok && i < h.large_obj_count; ++i) {
+    struct silc_mem_large_obj_t* lo = mem->large_objs + i;
+    struct silc_mem_image_large_obj_t image_lo = { .pos = lo->pos, .size = lo->contents != NULL ? lo->size : -1 };
+    ok = fwrite(&image_lo, sizeof(image_lo), 1, out) == 1 && (lo->contents == NULL ||
+        fwrite(lo->contents, sizeof(silc_obj), lo->size, out) == (size_t) lo->size);
+  }
+  return ok;
+}
+
+void silc_int_mem_free(struct silc_mem_t * mem) {
+  if (mem->background_gc != NULL) {
+    free_background_gc(mem);
+  }
+  if (mem->gc_pool != NULL) {
+    free_gc_pool(mem);
+  }
+  if (mem->gc_bitmap != NULL) {
+    mem->init->free_mem(mem->gc_bitmap);
+  }
+  if (mem->mark_bits != NULL) {
+    mem->init->free_mem(mem->mark_bits);
+  }
+#ifdef SILC_DIRECT_OBJ
+  mem->init->free_mem(mem->bref_bits);
+#endif
+  free_large_objects(mem);
+  free_cons_region(mem);
+  pos_vec_free(mem, &mem->young_pos);
+  pos_vec_free(mem, &mem->remembered_pos);
+  pos_vec_free(mem, &mem->mark_stack);
+  pos_vec_free(mem, &mem->weak_refs);
+  if (mem->handles != NULL) {
+    mem->init->free_mem(mem->handles);
+  }
+  mem->init->free_mem(mem->alloc_by_subtype);
+  if (mem->alloc_samples != NULL) {
+    mem->init->free_mem(mem->alloc_samples);
+  }
+  free_heap(mem);
+}
+
+void silc_int_mem_add_root(struct silc_mem_t* mem, silc_obj o) {
+  abandon_regions(mem); /* roots are added without write barrier */
+
+  /* unfold root vector */
+  silc_obj* rv = silc_get_oref(mem, mem->root_vector, NULL);
+  int capacity = silc_obj_to_int(rv[0]);
+  int size = silc_obj_to_int(rv[1]);
+  silc_obj* arr = rv + 2;
+  SILC_ASSERT(size < capacity);
+
+  /* add an object and update size */
+  arr[size] = o;
+  rv[1] = silc_int_to_obj(++size);
+
+  /* resize root vector once it is full, the object is already added so it survives GC triggered by the resize */
+  if (size == capacity) {
+    silc_obj new_root_vector = create_root_vector(mem, capacity * 2);
+
+    /* copy size and contents, old root vector might have been moved by garbage collector */
+    rv = silc_get_oref(mem, mem->root_vector, NULL);
+    silc_obj* new_rv = silc_get_oref(mem, new_root_vector, NULL);
+    memcpy(new_rv + 1, rv + 1, sizeof(silc_obj) * (size + 1));
+
+    /* update root vector pointer */
+    mem->root_vector = new_root_vector;
+  }
+}
+
+silc_obj silc_int_mem_alloc_weak_ref(struct silc_mem_t* mem, silc_obj target) {
+  /* keep target alive while weak reference is being allocated */
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(mem, &scope);
+  silc_int_mem_handle(mem, target);
+  silc_obj result = silc_int_mem_alloc(mem, 1, &target, SILC_TYPE_OREF, SILC_OREF_WEAK_REF_SUBTYPE);
+  silc_int_mem_close_handle_scope(mem, &scope);
+
+  if (SILC_GET_TYPE(target) != SILC_TYPE_INL) {
+    pos_vec_add(mem, &mem->weak_refs, (int) (result >> SILC_INT_TYPE_SHIFT));
+  }
+  return result;
+}
+
+void silc_int_mem_freeze(struct silc_mem_t* mem, silc_obj* roots, int root_count) {
+  SILC_ASSERT(mem->region == NULL && mem->shared == NULL && !mem->frozen);
+  /* handles would reference unshared objects, and scopes, closed afterwards, would restore them */
+  SILC_ASSERT(mem->handle_count == 0);
+
+  /* frozen heap is never collected, so that collector threads are stopped first */
+  if (mem->background_gc != NULL) {
+    free_background_gc(mem);
+  }
+  if (mem->gc_pool != NULL) {
+    free_gc_pool(mem);
+  }
+
+  /* only the objects, reachable from the given roots, survive, stale entries would be scanned by gc_rescan */
+  silc_obj* rv = silc_get_oref(mem, mem->root_vector, NULL);
+  memset(rv + 2, 0, silc_obj_to_int(rv[1]) * sizeof(silc_obj));
+  rv[1] = SILC_OBJ_ZERO;
+  for (int i = 0; i < root_count; ++i) {
+    silc_int_mem_handle(mem, roots[i]);
+  }
+  silc_int_mem_gc(mem);
+
+  /* survivors are marked once more, so that their references are found without walking the heap */
+  mark_root_objects(mem);
+  share_marked_objects(mem);
+  mem->handle_count = 0;
+  for (int i = 0; i < root_count; ++i) {
+    roots[i] = silc_int_mem_make_shared(roots[i]);
+  }
+
+  /* free space and to-space are given back, since nothing is allocated afterwards */
+  resize_heap(mem, mem->avail_index + get_pos_table_size(mem));
+  free_to_space(mem);
+  mem->frozen = true;
+  mem->alloc_limit_index = -1;
+}
+
+void silc_int_mem_begin_region(struct silc_mem_t* mem, struct silc_region_t* region) {
+  cancel_evacuation(mem); /* completed evacuation could reclaim the heap top, that region objects occupy */
+
+  region->prev = mem->region;
+  region->abandoned = mem->marking; /* objects are allocated black, so they are left to the ongoing cycle */
+  region->avail_index = mem->avail_index;
+  region->pos_limit = get_pos_limit(mem);
+  region->pos_count = mem->pos_count;
+  region->cons_count = mem->cons_count;
+  region->young_pos_count = mem->young_pos.count;
+  region->alloc_sample_count = mem->alloc_sample_count;
+  region->weak_ref_count = mem->weak_refs.count;
+  region->handle_count = mem->handle_count;
+  region->escaped = false;
+
+  if (!region->abandoned && !has_live_regions(mem)) {
+    swap_region_free_lists(mem);
+  }
+  mem->region = region;
+}
+
+bool silc_int_mem_end_region(struct silc_mem_t* mem, struct silc_region_t* region) {
+  SILC_ASSERT(mem->region == region && mem->handle_count >= region->handle_count);
+  mem->region = region->prev;
+  if (region->abandoned) {
+    return false;
+  }
+
+  bool released = !region_escapes(mem, region);
+  if (!has_live_regions(mem)) {
+    swap_region_free_lists(mem);
+  }
+
+  if (released) {
+    release_region(mem, region);
+  }
+  return released;
+}
+
+void silc_int_mem_grow_handles(struct silc_mem_t* mem) {
+  int new_capacity = mem->handle_capacity > 0 ? mem->handle_capacity * 2 : SILC_INT_MEM_INITIAL_HANDLE_STACK_SIZE;
+  silc_obj* new_handles = mem->init->alloc_mem(sizeof(silc_obj) * new_capacity);
+  if (mem->handles != NULL) {
+    memcpy(new_handles, mem->handles, sizeof(silc_obj) * mem->handle_count);
+    mem->init->free_mem(mem->handles);
+  }
+  mem->handles = new_handles;
+  mem->handle_capacity = new_capacity;
+}
+
+static void full_gc(struct silc_mem_t* mem) {
+  cancel_evacuation(mem);
+
+#ifndef SILC_DIRECT_OBJ
+  /* copier can not reuse the marks of the incremental cycle, so the cycle is completed by compaction */
+  bool copying = mem->init->gc_strategy == SILC_MEM_GC_SEMISPACE && !mem->marking;
+#endif
+  if (mem->marking) {
+    finish_incremental_marking(mem);
+#ifndef SILC_DIRECT_OBJ
+  } else if (copying) {
+    copy_live_objects(mem);
+#endif
+  } else {
+    mark_root_objects(mem);
+  }
+
+  sweep_alloc_samples(mem, SILC_INT_MEM_FULL_MARKING);
+  sweep_weak_refs(mem, SILC_INT_MEM_FULL_MARKING);
+  sweep_large_objects(mem);
+  mem->large_alloc_since_gc = 0;
+  sweep_cons_region(mem);
+
+  int prev_avail_index = mem->avail_index;
+#ifdef SILC_DIRECT_OBJ
+  sweep_heap(mem);
+#else
+  if (copying) {
+    sweep_positions(mem);
+  } else {
+    compact_heap(mem);
+  }
+#endif
+  if (mem->heap_reserved_size > 0) {
+    decommit_heap(mem->buf, mem->avail_index, prev_avail_index);
+  }
+  reset_young_generation(mem);
+  adjust_heap_size(mem, 0);
+  adjust_cons_region_size(mem, 0);
+  mem->last_gc_avail_index = silc_int_mem_get_alloc_index(mem);
+  update_gc_trigger(mem);
+  update_alloc_limit(mem);
+}
+
+static void minor_gc(struct silc_mem_t* mem) {
+  /* mark young objects, reachable from the roots */
+  ensure_mark_bits(mem);
+  gc_shade_roots(mem, mem->young_index);
+
+  /* mark young objects, reachable from the remembered old objects */
+  for (int i = 0; i < mem->remembered_pos.count; ++i) {
+    int pos = mem->remembered_pos.arr[i];
+    mem->buf[mem->last_pos_index - pos] &= ~SILC_INT_MEM_POS_REMEMBERED_BIT;
+    gc_scan(mem, (((silc_obj) pos) << SILC_INT_TYPE_SHIFT) | (mem->buf[mem->last_pos_index - pos] & SILC_INT_TYPE_MASK),
+            mem->young_index);
+  }
+  for (int i = 0; i < mem->remembered_cells.count; ++i) {
+    int cell = mem->remembered_cells.arr[i];
+    SILC_INT_MEM_CLEAR_BIT(mem->cons_remembered_bits, cell);
+    gc_scan(mem, (((silc_obj) cell) << SILC_INT_TYPE_SHIFT) | SILC_TYPE_CONS, mem->young_index);
+  }
+  gc_drain(mem, mem->young_index, INT_MAX);
+  sweep_alloc_samples(mem, mem->young_index);
+  sweep_weak_refs(mem, mem->young_index);
+
+  /* young positions are ordered by object address, so survivors can be slid in a single pass */
+  int dest_index = mem->young_index;
+  for (int i = 0; i < mem->young_pos.count; ++i) {
+    int pos = mem->young_pos.arr[i];
+    int index_pos = mem->last_pos_index - pos;
+    silc_obj pos_fval = mem->buf[index_pos];
+
+    if (!silc_int_mem_is_pos_marked(mem, pos)) {
+      /* unreachable young object, return its position to the free list */
+      mem->buf[index_pos] = SILC_INT_MEM_MAKE_FREE_POS(mem->free_pos_head);
+      mem->free_pos_head = pos;
+      ++mem->free_pos_count;
+      continue;
+    }
+
+    /* only young objects are marked, so the bitmap gets clear once their marks are reset */
+    mem->mark_bits[pos / SILC_INT_MEM_BITMAP_WORD_BITS] &= ~(1U << (pos % SILC_INT_MEM_BITMAP_WORD_BITS));
+
+    int obj_index = pos_fval >> SILC_INT_MEM_POS_SHIFT;
+    int type = pos_fval & SILC_INT_TYPE_MASK;
+    int obj_size = get_obj_size(mem->buf + obj_index, type);
+    if (dest_index != obj_index) {
+      memmove(mem->buf + dest_index, mem->buf + obj_index, obj_size * sizeof(silc_obj));
+      mem->gc_counters.moved_bytes += obj_size * (long long) sizeof(silc_obj);
+    }
+    mem->buf[index_pos] = ((silc_obj) dest_index << SILC_INT_MEM_POS_SHIFT) | type;
+    dest_index += obj_size;
+  }
+
+  /* young cells stay in place, unreachable reused ones are returned to the free list */
+  for (int i = mem->young_cells.count - 1; i >= 0; --i) {
+    int cell = mem->young_cells.arr[i];
+    if (SILC_INT_MEM_TEST_BIT(mem->cons_mark_bits, cell)) {
+      SILC_INT_MEM_CLEAR_BIT(mem->cons_mark_bits, cell);
+      continue;
+    }
+
+    mem->cons_buf[2 * cell] = SILC_INT_MEM_MAKE_FREE_POS(mem->cons_free_head);
+    mem->cons_free_head = cell;
+    ++mem->cons_free_count;
+  }
+  if (mem->young_cell_index < mem->cons_count) {
+    sweep_cells(mem, mem->young_cell_index);
+  }
+
+  /* promote survivors */
+  mem->avail_index = dest_index;
+  reset_young_generation(mem);
+  update_alloc_limit(mem);
+}
+
+/*
+ * GC telemetry.
+ * Every stop-the-world collection is timed and reported to the on_gc_event callback, cumulative counters are kept
+ * in the heap, so that they are read without walking it.
+ */
+
+static long long get_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int get_object_count(struct silc_mem_t* mem) {
+  return mem->pos_count - mem->free_pos_count + mem->cons_count - mem->cons_free_count;
+}
+
+static int get_pause_histogram_bucket(long long pause_ns) {
+  unsigned long long us = (unsigned long long) (pause_ns / 1000);
+  int bucket = us > 0 ? 64 - __builtin_clzll(us) : 0;
+  return bucket < SILC_MEM_PAUSE_HISTOGRAM_SIZE ? bucket : SILC_MEM_PAUSE_HISTOGRAM_SIZE - 1;
+}
+
+/** Does the given collection, updates GC counters and reports start and end events */
+static void run_gc(struct silc_mem_t* mem, int kind, void (* collect)(struct silc_mem_t* mem)) {
+  SILC_ASSERT(!mem->frozen);
+  abandon_regions(mem);
+
+  silc_internal_gc_event_pfn on_gc_event = mem->init->on_gc_event;
+  struct silc_mem_gc_event_t event = { .kind = kind, .end = false, .pos_count = mem->pos_count };
+  if (on_gc_event != NULL) {
+    on_gc_event(mem->init, &event);
+  }
+
+  long long used = get_used_memory(mem);
+  int object_count = get_object_count(mem);
+  long long moved_bytes = mem->gc_counters.moved_bytes;
+  long long start = get_time_ns();
+
+  collect(mem);
+
+  event.end = true;
+  event.pause_ns = get_time_ns() - start;
+  event.reclaimed_bytes = (used - get_used_memory(mem)) * (long long) sizeof(silc_obj);
+  event.reclaimed_objects = object_count - get_object_count(mem);
+  event.moved_bytes = mem->gc_counters.moved_bytes - moved_bytes;
+  event.pos_count = mem->pos_count;
+
+  struct silc_mem_gc_counters_t* counters = &mem->gc_counters;
+  if (kind == SILC_MEM_GC_FULL) {
+    ++counters->gc_count;
+  } else {
+    ++counters->minor_gc_count;
+  }
+  counters->total_pause_ns += event.pause_ns;
+  if (event.pause_ns > counters->max_pause_ns) {
+    counters->max_pause_ns = event.pause_ns;
+  }
+  ++counters->pause_histogram[get_pause_histogram_bucket(event.pause_ns)];
+  counters->reclaimed_bytes += event.reclaimed_bytes;
+  counters->reclaimed_objects += event.reclaimed_objects;
+
+  if (on_gc_event != NULL) {
+    on_gc_event(mem->init, &event);
+  }
+}
+
+void silc_int_mem_gc(struct silc_mem_t* mem) {
+  run_gc(mem, SILC_MEM_GC_FULL, full_gc);
+}
+
+void silc_int_mem_minor_gc(struct silc_mem_t* mem) {
+  if ((mem->young_pos.count == 0 && silc_int_mem_get_young_cell_count(mem) == 0) || mem->marking) {
+    return; /* nothing to collect or young objects are being marked by the incremental cycle */
+  }
+
+  run_gc(mem, SILC_MEM_GC_MINOR, minor_gc);
+}
+
+int silc_int_mem_gc_hint(struct silc_mem_t* mem) {
+  /* collection is due if half of the trigger is used up or either heap or cons region is half full */
+  long long allocated = get_total_alloc(mem) - mem->gc_alloc_base;
+  bool crowded = 2 * (silc_int_mem_get_alloc_index(mem) + get_pos_table_size(mem)) > mem->last_pos_index ||
+      2 * (mem->cons_count - mem->cons_free_count) > mem->cons_capacity;
+  if (mem->marking || crowded || (mem->gc_trigger < LLONG_MAX && 2 * allocated >= mem->gc_trigger)) {
+    silc_int_mem_gc(mem);
+    return SILC_MEM_GC_FULL;
+  }
+
+  if (mem->young_pos.count > 0 || silc_int_mem_get_young_cell_count(mem) > 0) {
+    silc_int_mem_minor_gc(mem);
+    return SILC_MEM_GC_MINOR;
+  }
+  return -1;
+}
+
+void silc_int_mem_park(struct silc_mem_t* mem) {
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+  if (bg == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&bg->lock);
+  bg->parked = true;
+  pthread_cond_signal(&bg->work_cond);
+  pthread_mutex_unlock(&bg->lock);
+}
+
+void silc_int_mem_unpark(struct silc_mem_t* mem) {
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+  if (bg == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&bg->lock);
+  bg->parked = false;
+  while (bg->busy) {
+    pthread_cond_wait(&bg->idle_cond, &bg->lock);
+  }
+  pthread_mutex_unlock(&bg->lock);
+}
+
+bool silc_int_mem_wait_background_gc(struct silc_mem_t* mem) {
+  struct silc_mem_background_gc_t* bg = mem->background_gc;
+  if (bg == NULL) {
+    return false;
+  }
+
+  pthread_mutex_lock(&bg->lock);
+  bool parked = bg->parked;
+  while (parked && (bg->busy || has_background_gc_work(mem))) {
+    pthread_cond_wait(&bg->idle_cond, &bg->lock);
+  }
+  pthread_mutex_unlock(&bg->lock);
+  return parked;
+}
+
+void silc_int_mem_record_write(struct silc_mem_t* mem, silc_obj holder, silc_obj value) {
+  SILC_ASSERT(!silc_int_mem_is_shared(holder)); /* shared objects are read-only */
+  if (silc_int_mem_is_shared(value)) {
+    return; /* shared objects are neither collected nor released by the regions */
+  }
+
+  if (has_live_regions(mem)) {
+    record_region_write(mem, holder, value);
+  }
+
+  if (mem->marking) {
+    /* preserve tri-color invariant: black object may never reference white one */
+    gc_shade(mem, value, SILC_INT_MEM_FULL_MARKING);
+  }
+
+  if (mem->young_pos.count == 0 && silc_int_mem_get_young_cell_count(mem) == 0) {
+    return; /* no young objects */
+  }
+
+  if (is_young(mem, holder) || !is_young(mem, value)) {
+    return; /* holder is young or it is an old-to-old reference */
+  }
+
+  int pos = (int) (holder >> SILC_INT_TYPE_SHIFT);
+  if (SILC_GET_TYPE(holder) == SILC_TYPE_CONS) {
+    if (!SILC_INT_MEM_TEST_BIT(mem->cons_remembered_bits, pos)) {
+      SILC_INT_MEM_SET_BIT(mem->cons_remembered_bits, pos);
+      pos_vec_add(mem, &mem->remembered_cells, pos);
+    }
+  } else if ((mem->buf[silc_int_mem_get_pos_index(mem, holder)] & SILC_INT_MEM_POS_REMEMBERED_BIT) == 0) {
+    remember(mem, pos);
+  }
+}
+
+void silc_int_mem_sample_alloc(struct silc_mem_t* mem, silc_obj obj, int type, int subtype) {
+  /* sample stands for every interval, that has been passed by this allocation */
+  int interval = mem->init->alloc_sample_interval;
+  long long intervals = 1 + (-mem->alloc_sample_countdown) / interval;
+  mem->alloc_sample_countdown += intervals * interval;
+
+  int site = mem->init->on_alloc_sample(mem->init, obj, type, subtype, intervals * interval);
+  if (site < 0) {
+    return;
+  }
+
+  if (mem->alloc_sample_count == mem->alloc_sample_capacity) {
+    int new_capacity = mem->alloc_sample_capacity > 0 ? mem->alloc_sample_capacity * 2 : 64;
+    struct silc_mem_alloc_sample_t* new_samples = mem->init->alloc_mem(sizeof(struct silc_mem_alloc_sample_t) *
+                                                                       new_capacity);
+    if (mem->alloc_samples != NULL) {
+      memcpy(new_samples, mem->alloc_samples, sizeof(struct silc_mem_alloc_sample_t) * mem->alloc_sample_count);
+      mem->init->free_mem(mem->alloc_samples);
     }
+    mem->alloc_samples = new_samples;
+    mem->alloc_sample_capacity = new_capacity;
+  }
+
+  struct silc_mem_alloc_sample_t* sample = mem->alloc_samples + mem->alloc_sample_count++;
+  sample->obj = obj;
+  sample->site = site;
+  sample->bytes = intervals * interval;
+}
+
+void silc_int_mem_calc_stats(struct silc_mem_t* mem, struct silc_mem_stats_t* stats) {
+  stats->total_memory = (int) get_footprint(mem);
+  stats->heap_memory = mem->last_pos_index + 1;
+  stats->pos_count = mem->pos_count;
+#ifdef SILC_DIRECT_OBJ
+  stats->usable_memory = stats->heap_memory - silc_int_mem_get_alloc_index(mem);
+#else
+  stats->usable_memory = stats->heap_memory - mem->pos_count - mem->avail_index;
+#endif
+  stats->free_memory = stats->usable_memory + mem->free_pos_count;
+  stats->free_pos_count = mem->free_pos_count;
+  stats->large_object_memory = mem->large_object_memory;
+  stats->cons_capacity = mem->cons_capacity;
+  stats->cons_count = mem->cons_count - mem->cons_free_count;
+}
+
+silc_obj silc_int_mem_alloc_slow(struct silc_mem_t* mem, int content_length, const void* content, int type,
+                                 int subtype) {
+  SILC_ASSERT(!mem->frozen);
+  silc_obj result;
+  bool large = false;
+  if (type == SILC_TYPE_CONS) {
+    result = (((silc_obj) alloc_cons_or_fail(mem)) << SILC_INT_TYPE_SHIFT) | type;
   } else {
-    result = SILC_OBJ_NIL;
+    int n = silc_int_mem_get_alloc_size(content_length, type);
+    large = is_large_object_size(mem, n);
+    int pos_index = large ? alloc_large_or_fail(mem, n, type) : alloc_or_fail(mem, n, type);
+    result = (((silc_obj) pos_index) << SILC_INT_TYPE_SHIFT) | type;
+  }
+  silc_int_mem_init_object(silc_int_mem_get_contents(mem, result), content_length, content, type, subtype);
+  silc_int_mem_count_alloc(mem, result, silc_int_mem_get_alloc_size(content_length, type), type, subtype);
+
+  int index = (int) (result >> SILC_INT_TYPE_SHIFT);
+  if (large && type == SILC_TYPE_OREF && mem->young_pos.count + silc_int_mem_get_young_cell_count(mem) > 0) {
+    remember(mem, index); /* initial contents may reference young objects */
+  }
+
+  if (mem->marking) {
+    /* allocate black, so that the cycle converges, initial contents are shaded instead */
+    if (type == SILC_TYPE_CONS) {
+      SILC_INT_MEM_SET_BIT(mem->cons_mark_bits, index);
+    } else {
+      ensure_mark_bits(mem);
+      SILC_INT_MEM_SET_BIT(mem->mark_bits, index);
+    }
+    if (type != SILC_TYPE_BREF) {
+      gc_scan(mem, result, SILC_INT_MEM_FULL_MARKING);
+    }
   }
   return result;
 }
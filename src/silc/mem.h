@@ -16,37 +16,243 @@
 
 #include "silc.h"
 
+#include <limits.h>
 #include <stdbool.h>
+#include <string.h>
 
 struct silc_mem_init_t;
+struct silc_mem_t;
+struct silc_mem_gc_pool_t;
+struct silc_mem_background_gc_t;
+struct silc_mem_gc_event_t;
 
 typedef void (* silc_internal_oom_abort_pfn)(struct silc_mem_init_t* mem_init);
 
+typedef void (* silc_internal_gc_event_pfn)(struct silc_mem_init_t* mem_init, const struct silc_mem_gc_event_t* event);
+
+typedef int (* silc_internal_alloc_sample_pfn)(struct silc_mem_init_t* mem_init, silc_obj obj, int type, int subtype,
+                                               long long bytes);
+
 struct silc_mem_init_t {
   void*                   context; /* custom context, for callback purposes */
 
+  /* heap footprint in silc_obj units, i.e. the total of the heap buffer, the cons region and the large objects */
   int                     init_memory_size; /* initial memory size */
-  int                     max_memory_size; /* maximum memory size */
+  int                     max_memory_size; /* maximum memory size, allocation, that does not fit it, calls oom_abort */
+
+  double                  growth_factor; /* heap growth factor, 0 means default one */
 
   int                     init_root_vector_size; /* initial size of the root vector */
 
+  int                     nursery_size; /* max size of the young generation, 0 disables generational collection */
+
+  int                     gc_slice_budget; /* max marking work per slice in silc_obj units, 0 disables incremental GC */
+
+  int                     max_mark_stack_size; /* max count of the GC mark stack entries, 0 means default size */
+
+  /* count of helper threads for parallel marking, 0 (default) disables it, parallel marking is experimental:
+   * its speedup has not been measured on a multi-core host yet */
+  int                     gc_threads;
+
+  bool                    background_gc; /* collect garbage by the background thread while the heap is parked */
+
+  /* objects of at least this size (in silc_obj units) are mapped page aligned to the non-moving large object space,
+   * 0 disables it */
+  int                     large_object_size;
+
+  /* reserve address space of max_memory_size by anonymous mmap, so that heap is resized in place and its freed pages
+   * are returned to the system, heap buffer is allocated by alloc_mem otherwise */
+  bool                    mmap_heap;
+
+  /* strategy of the full collection, either SILC_MEM_GC_MARK_COMPACT (default) or SILC_MEM_GC_SEMISPACE */
+  int                     gc_strategy;
+
+  /* share of the live objects in the memory, used by the time of the full collection, in percent, non-zero value
+   * makes full collection start once memory, allocated since the last one, reaches the trigger, that is adapted
+   * to the observed survival rate, rather than once the heap is full, see silc_int_mem_gc_hint */
+  int                     gc_target_occupancy;
+
+  /* frozen heap, whose objects are referenced by this heap as shared ones, see silc_int_mem_freeze, or NULL */
+  struct silc_mem_t*      shared;
+
   /* function, that should be called on OOM and gracefully abort execution */
   silc_internal_oom_abort_pfn               oom_abort;
 
-  /* custom mem alloc functions, malloc should never return null */
+  /* optional function, that is called at the start and at the end of every stop-the-world collection,
+   * it must not allocate objects */
+  silc_internal_gc_event_pfn                on_gc_event;
+
+  /* allocated bytes between the allocation samples, 0 disables sampling */
+  int                     alloc_sample_interval;
+
+  /* function, that is called for the sampled allocation with the amount of bytes the sample stands for, returns
+   * allocation site, that is kept along with the object until it dies, or -1 if object should not be tracked,
+   * it must not allocate objects */
+  silc_internal_alloc_sample_pfn            on_alloc_sample;
+
+  /* custom mem alloc functions, malloc should never return null, both should be thread safe if gc_threads > 0 or
+   * background_gc is set */
   void* (* alloc_mem)(size_t size);
   void (* free_mem)(void* p);
 };
 
+/** Collection kinds, reported by the GC events */
+#define SILC_MEM_GC_MINOR                 (0)
+#define SILC_MEM_GC_FULL                  (1)
+
+/**
+ * Full collection strategies. Mark-compact marks live objects and slides them towards the heap start in place.
+ * Semispace copier evacuates live objects breadth-first into the to-space of the heap size and swaps it with the heap
+ * buffer, so that its work is proportional to the live objects rather than to the heap. Strategy is ignored
+ * in the direct mode, since its objects never move.
+ */
+#define SILC_MEM_GC_MARK_COMPACT          (0)
+#define SILC_MEM_GC_SEMISPACE             (1)
+
+/**
+ * Count of the pause histogram buckets. Bucket 0 counts pauses shorter than 1 microsecond, bucket i counts pauses
+ * from 2^(i-1) to 2^i microseconds and the last bucket counts the longer ones.
+ */
+#define SILC_MEM_PAUSE_HISTOGRAM_SIZE     (24)
+
+/** Allocations are counted per subtype below this number, the greater and negative subtypes share the last counter */
+#define SILC_MEM_TRACKED_SUBTYPE_COUNT    (1024)
+
+/** GC event, passed to silc_mem_init_t.on_gc_event */
+struct silc_mem_gc_event_t {
+  /** Collection kind, either SILC_MEM_GC_MINOR or SILC_MEM_GC_FULL */
+  int                       kind;
+
+  /** Indicates whether collection has been completed, the fields below are only set at the end of collection */
+  bool                      end;
+
+  /** Stop-the-world pause of this collection in nanoseconds */
+  long long                 pause_ns;
+
+  /** Memory of the objects, released by this collection, in bytes */
+  long long                 reclaimed_bytes;
+
+  /** Count of the objects, released by this collection */
+  int                       reclaimed_objects;
+
+  /** Memory of the objects, moved by this collection, in bytes */
+  long long                 moved_bytes;
+
+  /**
+   * Size of the position table (both vacant and occupied positions) at the time of the event,
+   * count of the heap objects in the direct mode
+   */
+  int                       pos_count;
+};
+
+/** Allocation counter of an object type or subtype */
+struct silc_mem_alloc_counter_t {
+  long long                 count;
+  long long                 bytes;
+};
+
+/** Cumulative GC counters, maintained since the heap initialization */
+struct silc_mem_gc_counters_t {
+  /** Count of the full collections, including completed incremental cycles */
+  long long                 gc_count;
+
+  /** Count of the minor collections */
+  long long                 minor_gc_count;
+
+  /** Total and max stop-the-world pauses in nanoseconds */
+  long long                 total_pause_ns;
+  long long                 max_pause_ns;
+
+  /** Pauses of the stop-the-world collections, see SILC_MEM_PAUSE_HISTOGRAM_SIZE */
+  long long                 pause_histogram[SILC_MEM_PAUSE_HISTOGRAM_SIZE];
+
+  /** Memory and count of the objects, released by the stop-the-world collections */
+  long long                 reclaimed_bytes;
+  long long                 reclaimed_objects;
+
+  /** Memory of the objects, moved by all the collections, including the background one */
+  long long                 moved_bytes;
+
+  /** Allocations per object type, indexed by SILC_TYPE_CONS, SILC_TYPE_OREF and SILC_TYPE_BREF */
+  struct silc_mem_alloc_counter_t alloc_by_type[4];
+};
+
+/** Sampled object, that has survived all the collections since its allocation */
+struct silc_mem_alloc_sample_t {
+  silc_obj                  obj;
+
+  /** Allocation site, returned by silc_mem_init_t.on_alloc_sample */
+  int                       site;
+
+  /** Amount of allocated bytes, this sample stands for */
+  long long                 bytes;
+};
+
+/** Large object, allocated outside of the heap buffer, its position refers to it by the slot number */
+struct silc_mem_large_obj_t {
+  /** Object layout, the same as the one of the heap objects, NULL for the vacant slot */
+  silc_obj*                 contents;
+
+  /** Position of the object or the next vacant slot (-1 if there are no more), if this slot is vacant */
+  int                       pos;
+
+  /** Object size in silc_obj units */
+  int                       size;
+};
+
+/** Growable vector of position numbers, allocated outside of the heap */
+struct silc_mem_pos_vec_t {
+  int*                      arr;
+  int                       count;
+  int                       capacity;
+};
+
+/* Max content length of OREF and BREF objects (in silc_obj units), that can be allocated by the inline fast path */
+#define SILC_INT_MEM_MAX_INLINE_ALLOC_LENGTH    (16)
+
+/* Max size of the objects (in silc_obj units, including the header), that can be allocated by the inline fast path */
+#define SILC_INT_MEM_MAX_INLINE_ALLOC_SIZE      (1 + SILC_INT_MEM_MAX_INLINE_ALLOC_LENGTH)
+
+/*
+ * Object representation.
+ * By default object references and byte references hold position numbers, position table maps them to the heap
+ * indexes, so that compaction moves objects without updating references to them.
+ * SILC_DIRECT_OBJ build option (see configure --direct) makes them hold heap indexes instead, so that contents are
+ * reached without the position table lookup. Objects never move in this mode, since native code keeps objects
+ * in the local variables: collector sweeps the heap and links the gaps between the live objects into the free lists.
+ * Generational collection, large object space and background evacuation depend on the position table and thus
+ * they are disabled in the direct mode. Positions are heap indexes of the objects in this mode.
+ */
+
+#ifdef SILC_DIRECT_OBJ
+/**
+ * Count of the free chunk lists. Chunks, that fit the objects of the inline allocation fast path, are kept
+ * in the exact-size lists indexed by chunk size, so that small objects are allocated without search,
+ * the last list keeps the bigger ones.
+ */
+#define SILC_INT_MEM_FREE_LIST_COUNT      (SILC_INT_MEM_MAX_INLINE_ALLOC_SIZE + 2)
+#endif
+
 struct silc_mem_t {
   struct silc_mem_init_t* init;
   
   /**
    * Heap memory.
    * Layout: is as follows [{object1}{object2}{objectN}...free space...{posN}{pos2}{pos1}]
+   * Direct mode layout: [{object1}{free chunk}{object2}...{objectN}...free space...], there is no position table.
    */
   silc_obj*                 buf;
 
+  /** Size of the address space, reserved for the heap buffer, in silc_obj units, 0 if buffer is allocated by alloc_mem */
+  int                       heap_reserved_size;
+
+  /**
+   * To-space of the semispace copier, it takes the place of the heap buffer once live objects are copied into it.
+   * Allocated by the first copying collection and released once the heap buffer is reallocated, address space
+   * of the same size is reserved for it if heap_reserved_size is set. NULL for the mark-compact strategy.
+   */
+  silc_obj*                 to_space;
+
   /**
    * index of the last element in this buffer, matches first moveable reference index
    * Total size of this buffer in bytes == (last_pos_index + 1)*sizeof(silc_obj)
@@ -57,100 +263,464 @@ struct silc_mem_t {
   int                       avail_index;
 
   /**
-   * count positions (moveable references)
+   * count positions (moveable references), count of the objects in the direct mode
    */
   int                       pos_count;
 
   /**
-   * Used for optimization purposes only.
-   * This index allows to skip positions that are not vacant and every search updates this index with
-   * the next unoccupied index, so that the next allocation will be the fastest possible.
+   * Index of the first vacant position or -1 if there are no vacant positions.
+   * Vacant positions are threaded into the list, each of them holds an index of the next vacant position,
+   * see also SILC_INT_MEM_MAKE_FREE_POS.
    */
-  int                       cached_last_occupied_pos_index;
+  int                       free_pos_head;
+
+  /** Count of vacant positions, i.e. length of the free position list */
+  int                       free_pos_count;
 
   /*
    * Root objects marker. This object serves as a marker for object roots.
    */
   silc_obj                  root_vector;
 
-  /** Indicates whether or not auto mark enabled (disabled by default) */
-  bool                      auto_mark_enabled;
+  /** Handle stack: temporary roots, registered in the open handle scopes, see silc_int_mem_handle */
+  silc_obj*                 handles;
+  int                       handle_count;
+  int                       handle_capacity;
+
+  /**
+   * Scratch bitmap, used by garbage collector to mark starts of the live objects in the heap.
+   * Allocated on demand and reused between collections.
+   */
+  unsigned int*             gc_bitmap;
+
+  /** Size of the GC bitmap in words */
+  int                       gc_bitmap_size;
+
+  /**
+   * Mark bitmap, indexed by position number. Marks are kept aside of the position table, so that marking does not
+   * dirty it. The bitmap covers all the positions and it is clear outside of the collection.
+   */
+  unsigned int*             mark_bits;
+
+  /** Size of the mark bitmap in words */
+  int                       mark_bits_size;
+
+  /**
+   * Heap index, where young generation starts.
+   * Objects allocated since the last collection reside between this index and avail_index.
+   */
+  int                       young_index;
+
+  /** Positions of the young objects in their allocation order, which is also their order in the heap */
+  struct silc_mem_pos_vec_t young_pos;
+
+  /** Positions of the old objects, that may reference young objects (remembered set) */
+  struct silc_mem_pos_vec_t remembered_pos;
+
+  /** Indicates whether or not incremental marking is in progress */
+  bool                      marking;
+
+  /** Mark stack: gray objects, i.e. marked objects whose contents have not been scanned yet */
+  struct silc_mem_pos_vec_t mark_stack;
+
+  /** Indicates whether or not some gray objects have not been pushed to the mark stack because it was full */
+  bool                      mark_stack_overflow;
+
+  /** Amount of memory (in silc_obj units) allocated since the last marking slice */
+  int                       alloc_since_slice;
+
+  /** Count of consecutive full collections, that left heap mostly empty */
+  int                       low_occupancy_gc_count;
+
+  /**
+   * Collection pacing: total allocation (in silc_obj units) and memory of the live objects at the end of the last
+   * full collection, allocation since then, that triggers the next one (LLONG_MAX if it would not pay off), and
+   * smoothed share of the allocation in percent, that survives full collections. Trigger only starts collection
+   * if silc_mem_init_t.gc_target_occupancy is set, silc_int_mem_gc_hint relies on it either way.
+   */
+  long long                 gc_alloc_base;
+  long long                 last_gc_live;
+  long long                 gc_trigger;
+  int                       survival_percent;
+
+  /** Parallel marking threads or NULL if parallel marking is disabled */
+  struct silc_mem_gc_pool_t* gc_pool;
+
+  /** Background collector state or NULL if background collection is disabled */
+  struct silc_mem_background_gc_t* background_gc;
+
+  /** Value of avail_index right after the last full collection */
+  int                       last_gc_avail_index;
+
+  /**
+   * Heap index, up to which objects can be allocated by the inline fast path, see silc_int_mem_alloc.
+   * Accounts for the nursery size and incremental marking, -1 means that every allocation takes the slow path.
+   */
+  int                       alloc_limit_index;
+
+  /**
+   * Large object space: objects, that are never moved by the collector. Unreachable objects are released
+   * right away instead of being compacted.
+   */
+  struct silc_mem_large_obj_t* large_objs;
+  int                       large_obj_count;
+  int                       large_obj_capacity;
+
+  /** Index of the first vacant large object slot or -1 */
+  int                       large_obj_free_head;
+
+  /** Total size of the large objects in silc_obj units */
+  int                       large_object_memory;
+
+  /** Size of the large objects allocated since the last full collection */
+  int                       large_alloc_since_gc;
+
+  /**
+   * Cons region: fixed size cells of the cons objects. Cons object holds its cell number, so that conses take
+   * no positions and car and cdr are reached without the position table lookup. Cells never move,
+   * vacant ones are threaded into the free list through their cars, see SILC_INT_MEM_MAKE_FREE_POS.
+   * Layout: [{car0}{cdr0}{car1}{cdr1}...{free space}]
+   */
+  silc_obj*                 cons_buf;
+
+  /** Count of cells in the cons region */
+  int                       cons_capacity;
+
+  /** Count of cells, that have been taken from the cons region, cells above it are allocated by bumping it */
+  int                       cons_count;
+
+  /** Index of the first vacant cell below cons_count or -1 if there are no vacant cells */
+  int                       cons_free_head;
+
+  /** Count of vacant cells below cons_count */
+  int                       cons_free_count;
+
+  /** Cell bitmaps: marks of the ongoing collection, young vacant cells and remembered cells, each covers the region */
+  unsigned int*             cons_mark_bits;
+  unsigned int*             cons_young_bits;
+  unsigned int*             cons_remembered_bits;
+
+  /**
+   * Cell, where young cells taken by bumping cons_count start, it is INT_MAX if there is no young generation.
+   * Cells at or above it need no young bits and log entries, so that they are swept a bitmap word at a time.
+   */
+  int                       young_cell_index;
+
+  /** Vacant cells below young_cell_index, that have been reused since the last collection, in allocation order */
+  struct silc_mem_pos_vec_t young_cells;
+
+  /** Old cells, that may reference young objects */
+  struct silc_mem_pos_vec_t remembered_cells;
+
+  /** Count of occupied cells right after the last full collection */
+  int                       last_gc_cons_used;
+
+  /** Cumulative GC counters */
+  struct silc_mem_gc_counters_t gc_counters;
+
+  /** Allocations per subtype, see SILC_MEM_TRACKED_SUBTYPE_COUNT */
+  struct silc_mem_alloc_counter_t* alloc_by_subtype;
+
+  /** Bytes left to allocate before the next sample, it is never reached if sampling is disabled */
+  long long                 alloc_sample_countdown;
+
+  /** Live sampled objects, dead ones are dropped by the collections */
+  struct silc_mem_alloc_sample_t* alloc_samples;
+  int                       alloc_sample_count;
+  int                       alloc_sample_capacity;
+
+  /** Positions of the live weak references, dead ones are dropped by the collections */
+  struct silc_mem_pos_vec_t weak_refs;
+
+  /** Innermost open allocation region or NULL, see silc_int_mem_begin_region */
+  struct silc_region_t*     region;
+
+  /** Free list heads, that are put aside while the regions are open, so that region objects are bump allocated */
+  int                       region_free_pos_head;
+  int                       region_cons_free_head;
+#ifdef SILC_DIRECT_OBJ
+  int                       region_free_heads[SILC_INT_MEM_FREE_LIST_COUNT];
+#endif
+
+#ifdef SILC_DIRECT_OBJ
+  /**
+   * Heads of the free chunk lists, see SILC_INT_MEM_FREE_LIST_COUNT, -1 stands for the empty list.
+   * Free chunk layout: [{next chunk, see SILC_INT_MEM_MAKE_FREE_POS}{chunk size}...]
+   */
+  int                       free_heads[SILC_INT_MEM_FREE_LIST_COUNT];
+
+  /** Total size of the free chunks below avail_index */
+  int                       free_memory;
+
+  /** Type bitmap, indexed by heap index: bit is set at the start of every byte reference, covers the whole heap */
+  unsigned int*             bref_bits;
+#endif
+
+  /** Frozen heap, whose objects are referenced as shared ones, or NULL, see silc_mem_init_t.shared */
+  struct silc_mem_t*        shared;
+
+  /** Indicates whether or not this heap has been frozen, see silc_int_mem_freeze */
+  bool                      frozen;
 };
 
 struct silc_mem_stats_t {
   /**
-   * Total allocated memory, here and below memory measured in silc_obj,
-   * i.e. in order to get size in bytes this number should be multiplied to sizeof(silc_obj):
+   * Total allocated memory, i.e. heap footprint: heap buffer, cons region and large objects, here and below memory
+   * measured in silc_obj, i.e. in order to get size in bytes this number should be multiplied to sizeof(silc_obj):
    * <code>stats.total_memory * sizeof(silc_obj)</code>
    */
   int                       total_memory;
 
+  /** Size of the heap buffer, that holds the objects (except conses and large objects) and positions */
+  int                       heap_memory;
+
   /** Available memory, that can be used to store useful content (excluding service GC information) */
   int                       usable_memory;
 
   /** Total available memory (includes usable_memory and spare service information) */
   int                       free_memory;
 
-  /** Count of positions (both vacant and occupied) */
+  /** Count of positions (both vacant and occupied), count of the heap objects in the direct mode */
   int                       pos_count;
 
-  /** Count of free positions */
+  /** Count of free positions, i.e. length of the free position list */
   int                       free_pos_count;
+
+  /** Memory, occupied by the large objects */
+  int                       large_object_memory;
+
+  /** Count of cells in the cons region, each cell takes 2 units */
+  int                       cons_capacity;
+
+  /** Count of occupied cells */
+  int                       cons_count;
 };
 
 void silc_int_mem_init(struct silc_mem_t* new_mem, struct silc_mem_init_t* init);
 
+/**
+ * Initializes heap from the image, written by silc_int_mem_save_image, heap is sized to fit the image.
+ * Returns amount of consumed image bytes or 0 if image is malformed, heap is not initialized in the latter case.
+ */
+size_t silc_int_mem_init_from_image(struct silc_mem_t* new_mem, struct silc_mem_init_t* init, const char* image,
+                                    size_t size);
+
+/**
+ * Collects garbage and writes heap image to the given stream, returns false if write has failed or heap references
+ * the shared heap.
+ */
+bool silc_int_mem_save_image(struct silc_mem_t* mem, FILE* out);
+
 void silc_int_mem_free(struct silc_mem_t* mem);
 
-/** Triggers garbage collection */
+/**
+ * Triggers garbage collection, completes incremental marking if it is in progress.
+ * Heap might be grown or shrunk afterwards, which relocates heap buffer unless it is mmap heap.
+ */
 void silc_int_mem_gc(struct silc_mem_t* mem);
 
+/**
+ * Collects garbage if it pays off, meant to be called while the host is idle, e.g. between the requests:
+ * completes incremental marking or does full collection once half of the memory, that triggers it, has been allocated
+ * or heap or cons region is half full, collects the young generation otherwise. Returns kind of the collection or -1
+ * if nothing has been done.
+ */
+int silc_int_mem_gc_hint(struct silc_mem_t* mem);
+
+/**
+ * Triggers collection of the young generation only, survivors are promoted to the old generation.
+ * Does nothing if generational collection is disabled or incremental marking is in progress.
+ */
+void silc_int_mem_minor_gc(struct silc_mem_t* mem);
+
+/**
+ * Parks the heap, i.e. lets background collector work on it. Heap must not be accessed until it is unparked,
+ * pointers to object contents, that have been obtained before parking, become invalid.
+ * Does nothing if background collection is disabled.
+ */
+void silc_int_mem_park(struct silc_mem_t* mem);
+
+/** Unparks the heap, waits for the background collector to complete its current chunk of work */
+void silc_int_mem_unpark(struct silc_mem_t* mem);
+
+/**
+ * Waits until background collector runs out of work for the parked heap.
+ * Returns false if the heap is not parked or background collection is disabled.
+ */
+bool silc_int_mem_wait_background_gc(struct silc_mem_t* mem);
+
 void silc_int_mem_calc_stats(struct silc_mem_t* mem, struct silc_mem_stats_t* stats);
 
+/** Returns cumulative GC counters, they are updated by the subsequent allocations and collections */
+static inline const struct silc_mem_gc_counters_t* silc_int_mem_get_gc_counters(struct silc_mem_t* mem) {
+  return &mem->gc_counters;
+}
+
+/** Returns allocation counter of the given subtype, see SILC_MEM_TRACKED_SUBTYPE_COUNT */
+static inline struct silc_mem_alloc_counter_t* silc_int_mem_get_subtype_alloc_counter(struct silc_mem_t* mem,
+                                                                                      int subtype) {
+  bool tracked = subtype >= 0 && subtype < SILC_MEM_TRACKED_SUBTYPE_COUNT - 1;
+  return mem->alloc_by_subtype + (tracked ? subtype : SILC_MEM_TRACKED_SUBTYPE_COUNT - 1);
+}
+
+/** Returns live sampled objects, the array is valid until the next allocation or collection */
+static inline const struct silc_mem_alloc_sample_t* silc_int_mem_get_alloc_samples(struct silc_mem_t* mem,
+                                                                                   int* count) {
+  *count = mem->alloc_sample_count;
+  return mem->alloc_samples;
+}
+
+/**
+ * Samples allocation, that has exhausted the sample countdown.
+ * This function should not be called directly, see silc_int_mem_count_alloc.
+ */
+void silc_int_mem_sample_alloc(struct silc_mem_t* mem, silc_obj obj, int type, int subtype);
+
+/** Counts allocation of the object, that takes n silc_obj units */
+static inline void silc_int_mem_count_alloc(struct silc_mem_t* mem, silc_obj obj, int n, int type, int subtype) {
+  long long bytes = n * (long long) sizeof(silc_obj);
+  struct silc_mem_alloc_counter_t* type_counter = mem->gc_counters.alloc_by_type + type;
+  struct silc_mem_alloc_counter_t* subtype_counter = silc_int_mem_get_subtype_alloc_counter(mem, subtype);
+  ++type_counter->count;
+  type_counter->bytes += bytes;
+  ++subtype_counter->count;
+  subtype_counter->bytes += bytes;
+
+  mem->alloc_sample_countdown -= bytes;
+  if (mem->alloc_sample_countdown <= 0) {
+    silc_int_mem_sample_alloc(mem, obj, type, subtype);
+  }
+}
+
 /** Special subtype code for cons pointer */
 #define SILC_INT_MEM_CONS_SUBTYPE      (0)
 
 /**
- * Allocates n silc_obj units in the context memory and initializes it if content pointer is not null.
- *
- * @param mem             Pointer to memory context
- * @param content_length  Allocated object content length; should always be 2 for CONS objects
- * @param content         Pointer to silc_obj for CONS and OREF, pointer to char for BREF objects
- * @param type            Object type, can be SILC_TYPE_OREF, SILC_TYPE_CONS and SILC_TYPE_BREF
- * @param subtype         Object subtype. Should always be SILC_INT_MEM_CONS_SUBTYPE for CONS objects
+ * Allocation slow path, might trigger garbage collection, should not be called directly, see silc_int_mem_alloc.
  */
-silc_obj silc_int_mem_alloc(struct silc_mem_t* mem, int content_length, const void* content, int type, int subtype);
+silc_obj silc_int_mem_alloc_slow(struct silc_mem_t* mem, int content_length, const void* content, int type,
+                                 int subtype);
 
 /**
  * Marks an object as a root
  */
 void silc_int_mem_add_root(struct silc_mem_t* mem, silc_obj o);
 
-struct silc_int_alloc_mode_t {
-  bool auto_mark_enabled;
-  int prev_size;
-};
+/**
+ * Opens handle scope. Handles are temporary roots, that are kept in the native handle stack outside of the heap,
+ * so that intermediate objects survive allocations. Handles, registered after the scope has been opened,
+ * are dropped once it is closed, scopes should be closed in the reverse order.
+ */
+static inline void silc_int_mem_open_handle_scope(struct silc_mem_t* mem, struct silc_handle_scope_t* scope) {
+  scope->prev_count = mem->handle_count;
+}
+
+/** Closes handle scope, see silc_int_mem_open_handle_scope */
+static inline void silc_int_mem_close_handle_scope(struct silc_mem_t* mem, struct silc_handle_scope_t* scope) {
+  SILC_ASSERT(scope->prev_count <= mem->handle_count);
+  mem->handle_count = scope->prev_count;
+}
+
+/** Grows handle stack, should not be called directly, see silc_int_mem_handle */
+void silc_int_mem_grow_handles(struct silc_mem_t* mem);
+
+/** Registers handle of the given object in the innermost handle scope and returns that object */
+static inline silc_obj silc_int_mem_handle(struct silc_mem_t* mem, silc_obj o) {
+  if (SILC_GET_TYPE(o) != SILC_TYPE_INL) {
+    if (mem->handle_count == mem->handle_capacity) {
+      silc_int_mem_grow_handles(mem);
+    }
+    mem->handles[mem->handle_count++] = o;
+  }
+  return o;
+}
+
+/**
+ * Opens allocation region, see silc_region_t. Vacant positions, cells and free chunks are not reused until
+ * the outermost region is closed, so that region objects occupy the top of the heap and the cons region.
+ * Collection, large object allocation and root addition abandon the open regions.
+ */
+void silc_int_mem_begin_region(struct silc_mem_t* mem, struct silc_region_t* region);
 
 /**
- * Enables auto mark and saves previous state of root vector and auto_mark_enabled to the provided mode variable.
- * This tricky function is needed for evaluation: in order to simplify code and not mark every intermediate object
- * as being referenced from certain root, every new object will be automatically marked as root whenever evaluation
- * occurs. Once evaluation is done, the automarked objects are wiped out from the root vector and garbage collector
- * will be able to collect them (unless they are referenced from somewhere else which is perfectly valid).
+ * Closes allocation region, returns true if its objects have been released. Region objects must not be
+ * dereferenced afterwards unless they escape the region. Release takes constant time, apart from the check
+ * of the handles, that have been registered in the region and are still open.
  */
-void silc_int_mem_set_auto_mark_roots(struct silc_mem_t* mem, struct silc_int_alloc_mode_t* prev_mode);
+bool silc_int_mem_end_region(struct silc_mem_t* mem, struct silc_region_t* region);
 
 /**
- * Restores heap state, modified in {@code silc_int_mem_set_auto_mark_roots}.
+ * Freezes the heap, so that other heaps could share its objects, see silc_mem_init_t.shared. Roots are replaced
+ * with the given ones, garbage is collected, collector threads are stopped and references between the surviving
+ * objects are turned into the shared ones. Roots are updated in place with their shared references.
+ * Frozen heap is never collected, written to or allocated in, it should be freed after the heaps, that share it.
+ * Heap should hold no handles, i.e. it is frozen outside of the handle scopes, that have registered any.
  */
-void silc_int_mem_restore_roots(struct silc_mem_t* mem, struct silc_int_alloc_mode_t* prev_mode);
+void silc_int_mem_freeze(struct silc_mem_t* mem, silc_obj* roots, int root_count);
+
+/**
+ * Allocates weak reference to the given object. Weak reference does not keep its target alive, collection clears it
+ * once the target is found unreachable, see SILC_OREF_WEAK_REF_SUBTYPE.
+ */
+silc_obj silc_int_mem_alloc_weak_ref(struct silc_mem_t* mem, silc_obj target);
 
 /* General purpose memory allocators */
 
-/* Position layout: [...index...{gc_bit}{type_bits}] */
-#define SILC_INT_MEM_POS_GC_BIT           (1 << SILC_INT_TYPE_SHIFT)
-#define SILC_INT_MEM_POS_SHIFT            (SILC_INT_TYPE_SHIFT + 1)
-#define SILC_INT_MEM_FREE_POS             (-1)
+/*
+ * Position layout: [...index...{large_bit}{remembered_bit}{type_bits}], mark bits are kept in the separate bitmap.
+ * Index is a large object slot number if large bit is set and heap index otherwise.
+ */
+#define SILC_INT_MEM_POS_REMEMBERED_BIT   (1 << SILC_INT_TYPE_SHIFT)
+#define SILC_INT_MEM_POS_LARGE_BIT        (1 << (SILC_INT_TYPE_SHIFT + 1))
+#define SILC_INT_MEM_POS_SHIFT            (SILC_INT_TYPE_SHIFT + 2)
+
+/*
+ * Vacant position layout: [...next vacant position index + 1...{0}{0}], inline type bits are never used
+ * by the occupied positions.
+ */
+#define SILC_INT_MEM_MAKE_FREE_POS(next)  (((silc_obj) ((next) + 1)) << SILC_INT_MEM_POS_SHIFT)
+#define SILC_INT_MEM_IS_FREE_POS(fpos)    (((fpos) & SILC_INT_TYPE_MASK) == SILC_TYPE_INL)
+#define SILC_INT_MEM_NEXT_FREE_POS(fpos)  (((int) ((fpos) >> SILC_INT_MEM_POS_SHIFT)) - 1)
+
+/*
+ * Shared references: references and cells of the frozen heap, see silc_int_mem_freeze, have the highest bit set.
+ * Positions, heap indexes and cells never reach that bit, since heap size is limited by SILC_INT_MEM_MAX_MEMORY_SIZE.
+ */
+#define SILC_INT_MEM_SHARED_BIT           ((silc_obj) 1 << (sizeof(silc_obj) * CHAR_BIT - 1))
+
+/*
+ * Maximum heap size in silc_obj units, init and max memory sizes are clamped to it.
+ * Heap indexes are kept in the positions above SILC_INT_MEM_POS_SHIFT bits, so that with 32-bit objects they are
+ * limited to 28 bits (1G heap). Positions and cells are less than heap size, so that their references stay below
+ * SILC_INT_MEM_SHARED_BIT.
+ */
+#ifdef SILC_OBJ64
+#define SILC_INT_MEM_MAX_MEMORY_SIZE      (INT_MAX)
+#else
+#define SILC_INT_MEM_MAX_MEMORY_SIZE      (1 << (sizeof(silc_obj) * CHAR_BIT - SILC_INT_MEM_POS_SHIFT))
+#endif
+
+/** Asserts, that the allocated position, heap index or cell can be encoded in the object reference */
+#define SILC_INT_MEM_ASSERT_INDEX(index)  SILC_ASSERT((index) >= 0 && (index) < SILC_INT_MEM_MAX_MEMORY_SIZE)
+
+/** Returns true if the given object resides in the shared heap */
+static inline bool silc_int_mem_is_shared(silc_obj obj) {
+  return (obj & SILC_INT_MEM_SHARED_BIT) != 0 && SILC_GET_TYPE(obj) != SILC_TYPE_INL;
+}
+
+/** Returns shared reference to the given object of the frozen heap */
+static inline silc_obj silc_int_mem_make_shared(silc_obj obj) {
+  return SILC_GET_TYPE(obj) != SILC_TYPE_INL ? (obj | SILC_INT_MEM_SHARED_BIT) : obj;
+}
+
+/** Returns heap, that holds the given object, shared bit is stripped from the object */
+static inline struct silc_mem_t* silc_int_mem_resolve(struct silc_mem_t* mem, silc_obj* obj) {
+  if (*obj & SILC_INT_MEM_SHARED_BIT) {
+    *obj &= ~SILC_INT_MEM_SHARED_BIT;
+    return mem->shared;
+  }
+  return mem;
+}
 
 static inline int silc_int_mem_get_pos_index(struct silc_mem_t* mem, silc_obj obj) {
   int index_offset = (int) (obj >> SILC_INT_TYPE_SHIFT);
@@ -158,25 +728,121 @@ static inline int silc_int_mem_get_pos_index(struct silc_mem_t* mem, silc_obj ob
   return mem->last_pos_index - index_offset;
 }
 
+#define SILC_INT_MEM_BITMAP_WORD_BITS     ((int) (sizeof(unsigned int) * CHAR_BIT))
+
+#define SILC_INT_MEM_TEST_BIT(bits, i)    ((((bits)[(i) / SILC_INT_MEM_BITMAP_WORD_BITS] >> \
+                                             ((i) % SILC_INT_MEM_BITMAP_WORD_BITS)) & 1) != 0)
+#define SILC_INT_MEM_SET_BIT(bits, i)     ((bits)[(i) / SILC_INT_MEM_BITMAP_WORD_BITS] |= \
+                                             1U << ((i) % SILC_INT_MEM_BITMAP_WORD_BITS))
+#define SILC_INT_MEM_CLEAR_BIT(bits, i)   ((bits)[(i) / SILC_INT_MEM_BITMAP_WORD_BITS] &= \
+                                             ~(1U << ((i) % SILC_INT_MEM_BITMAP_WORD_BITS)))
+
+/** Returns true if the object at the given position has been marked by the ongoing collection */
+static inline bool silc_int_mem_is_pos_marked(struct silc_mem_t* mem, int pos) {
+  return pos / SILC_INT_MEM_BITMAP_WORD_BITS < mem->mark_bits_size && SILC_INT_MEM_TEST_BIT(mem->mark_bits, pos);
+}
+
+/** Returns true if the given object has been marked by the ongoing collection */
+static inline bool silc_int_mem_is_marked(struct silc_mem_t* mem, silc_obj obj) {
+  if (silc_int_mem_is_shared(obj)) {
+    return true; /* shared objects are never collected */
+  }
+  int index = (int) (obj >> SILC_INT_TYPE_SHIFT);
+  return SILC_GET_TYPE(obj) == SILC_TYPE_CONS ? SILC_INT_MEM_TEST_BIT(mem->cons_mark_bits, index) :
+      silc_int_mem_is_pos_marked(mem, index);
+}
+
+static inline silc_obj* silc_int_mem_get_cons_contents(struct silc_mem_t* mem, silc_obj obj) {
+  mem = silc_int_mem_resolve(mem, &obj);
+  int cell = (int) (obj >> SILC_INT_TYPE_SHIFT);
+  SILC_ASSERT(SILC_GET_TYPE(obj) == SILC_TYPE_CONS && cell >= 0 && cell < mem->cons_count);
+  return mem->cons_buf + 2 * cell;
+}
+
 static inline silc_obj* silc_int_mem_get_contents(struct silc_mem_t* mem, silc_obj obj) {
-  int pos = (int) (mem->buf[silc_int_mem_get_pos_index(mem, obj)] >> SILC_INT_MEM_POS_SHIFT);
-  SILC_ASSERT(pos >= 0 && pos < mem->avail_index);
-  return mem->buf + pos;
+  mem = silc_int_mem_resolve(mem, &obj);
+  if (SILC_GET_TYPE(obj) == SILC_TYPE_CONS) {
+    return silc_int_mem_get_cons_contents(mem, obj);
+  }
+
+#ifdef SILC_DIRECT_OBJ
+  int index = (int) (obj >> SILC_INT_TYPE_SHIFT);
+  SILC_ASSERT(index >= 0 && index < mem->avail_index);
+  return mem->buf + index;
+#else
+  silc_obj pos_fval = mem->buf[silc_int_mem_get_pos_index(mem, obj)];
+  int index = (int) (pos_fval >> SILC_INT_MEM_POS_SHIFT);
+  if (pos_fval & SILC_INT_MEM_POS_LARGE_BIT) {
+    SILC_ASSERT(index >= 0 && index < mem->large_obj_count);
+    return mem->large_objs[index].contents;
+  }
+
+  SILC_ASSERT(index >= 0 && index < mem->avail_index);
+  return mem->buf + index;
+#endif
 }
 
+/*
+ * Object header layout: [...content length...{subtype bits}], content length is counted in silc_obj units for OREF
+ * and in bytes for BREF objects. Length, that does not fit the header, is kept in the extra word, that follows
+ * the header with all the length bits set: [{SILC_INT_MEM_HUGE_LENGTH}{subtype bits}][length][contents...].
+ */
+#define SILC_INT_MEM_SUBTYPE_BITS         (13)
+#define SILC_INT_MEM_MAX_SUBTYPE          ((1 << SILC_INT_MEM_SUBTYPE_BITS) - 1)
+#define SILC_INT_MEM_HUGE_LENGTH          (~(silc_obj) 0 >> SILC_INT_MEM_SUBTYPE_BITS)
+
+/** Returns header size of the object with the given content length in silc_obj units */
+static inline int silc_int_mem_get_header_size(int content_length) {
+  return (silc_obj) content_length < SILC_INT_MEM_HUGE_LENGTH ? 1 : 2;
+}
+
+/** Returns header size of the given OREF or BREF object in silc_obj units */
+static inline int silc_int_mem_get_obj_header_size(const silc_obj* obj_mem) {
+  return (obj_mem[0] >> SILC_INT_MEM_SUBTYPE_BITS) != SILC_INT_MEM_HUGE_LENGTH ? 1 : 2;
+}
+
+static inline int silc_int_mem_get_obj_subtype(const silc_obj* obj_mem) {
+  return (int) (obj_mem[0] & SILC_INT_MEM_MAX_SUBTYPE);
+}
+
+static inline int silc_int_mem_get_obj_length(const silc_obj* obj_mem) {
+  silc_obj len = obj_mem[0] >> SILC_INT_MEM_SUBTYPE_BITS;
+  return (int) (len != SILC_INT_MEM_HUGE_LENGTH ? len : obj_mem[1]);
+}
+
+/** Writes header of the newly allocated object and returns its size in silc_obj units */
+static inline int silc_int_mem_init_header(silc_obj* obj_mem, int subtype, int content_length) {
+  SILC_ASSERT(subtype >= 0 && subtype <= SILC_INT_MEM_MAX_SUBTYPE && content_length >= 0);
+  if (silc_int_mem_get_header_size(content_length) == 1) {
+    obj_mem[0] = ((silc_obj) content_length << SILC_INT_MEM_SUBTYPE_BITS) | (silc_obj) subtype;
+    return 1;
+  }
+
+  obj_mem[0] = (SILC_INT_MEM_HUGE_LENGTH << SILC_INT_MEM_SUBTYPE_BITS) | (silc_obj) subtype;
+  obj_mem[1] = (silc_obj) content_length;
+  return 2;
+}
+
+/** Returns target of the given weak reference or SILC_OBJ_NIL if it has been cleared */
+static inline silc_obj silc_int_mem_get_weak_ref_target(struct silc_mem_t* mem, silc_obj weak_ref) {
+  silc_obj* obj_mem = silc_int_mem_get_contents(mem, weak_ref);
+  SILC_ASSERT(silc_int_mem_get_obj_subtype(obj_mem) == SILC_OREF_WEAK_REF_SUBTYPE);
+  return obj_mem[silc_int_mem_get_obj_header_size(obj_mem)];
+}
+
+/** Returns contents of the given OREF or BREF object, that follow its header */
 static inline silc_obj* silc_int_mem_get_ref(struct silc_mem_t* mem, silc_obj obj, int* subtype, int* len) {
-  silc_obj* contents = silc_int_mem_get_contents(mem, obj);
+  silc_obj* obj_mem = silc_int_mem_get_contents(mem, obj);
 
   if (subtype != NULL) {
-    *subtype = silc_obj_to_int(contents[0]);
-    SILC_ASSERT(*subtype >= 0);
+    *subtype = silc_int_mem_get_obj_subtype(obj_mem);
   }
 
   if (len != NULL) {
-    *len = silc_obj_to_int(contents[1]);
+    *len = silc_int_mem_get_obj_length(obj_mem);
   }
 
-  return contents;
+  return obj_mem + silc_int_mem_get_obj_header_size(obj_mem);
 }
 
 /**
@@ -196,17 +862,17 @@ static inline int silc_int_mem_parse_ref(struct silc_mem_t* mem, silc_obj obj, i
 
   switch (SILC_GET_TYPE(obj)) {
     case SILC_TYPE_CONS:
-      po = silc_int_mem_get_contents(mem, obj);
+      po = silc_int_mem_get_cons_contents(mem, obj);
       *content_len = 2;
       subtype = SILC_INT_MEM_CONS_SUBTYPE;
       break;
 
     case SILC_TYPE_OREF:
-      po = silc_int_mem_get_ref(mem, obj, &subtype, content_len) + 2;
+      po = silc_int_mem_get_ref(mem, obj, &subtype, content_len);
       break;
 
     case SILC_TYPE_BREF:
-      pch = (char*) (silc_int_mem_get_ref(mem, obj, &subtype, content_len) + 2);
+      pch = (char*) silc_int_mem_get_ref(mem, obj, &subtype, content_len);
       break;
 
     default:
@@ -238,3 +904,252 @@ static inline silc_obj* silc_get_oref(struct silc_mem_t* mem, silc_obj obj, int*
   SILC_ASSERT(result != NULL && subtype >= 0);
   return result;
 }
+
+/** Returns count of the cells allocated since the last collection */
+static inline int silc_int_mem_get_young_cell_count(struct silc_mem_t* mem) {
+  int bumped = mem->cons_count - mem->young_cell_index;
+  return (bumped > 0 ? bumped : 0) + mem->young_cells.count;
+}
+
+/**
+ * Records a reference store for the garbage collector: shades the value if incremental marking is in progress,
+ * remembers the holder if it is an old object that references young one and marks the regions, that the value escapes.
+ * This function should not be called directly, see silc_int_mem_write_barrier.
+ */
+void silc_int_mem_record_write(struct silc_mem_t* mem, silc_obj holder, silc_obj value);
+
+/**
+ * Write barrier, should be called whenever a reference to the value is stored into an existing holder object.
+ * Newly allocated objects can be initialized through the content argument of silc_int_mem_alloc without calling
+ * write barrier.
+ */
+static inline void silc_int_mem_write_barrier(struct silc_mem_t* mem, silc_obj holder, silc_obj value) {
+  /* no young objects means no old-to-young references, no marking means no black-to-white ones */
+  if ((mem->young_pos.count > 0 || silc_int_mem_get_young_cell_count(mem) > 0 || mem->marking ||
+       (mem->region != NULL && !mem->region->abandoned)) && SILC_GET_TYPE(value) != SILC_TYPE_INL) {
+    silc_int_mem_record_write(mem, holder, value);
+  }
+}
+
+/* Allocation */
+
+/** How big silc_obj array should be to fit byte_count bytes? */
+static inline int silc_obj_count_from_byte_count(int byte_count) {
+  SILC_ASSERT(byte_count >= 0);
+  return ((byte_count + sizeof(silc_obj) - 1) / sizeof(silc_obj));
+}
+
+/** Min size of the object in silc_obj units, so that the place of the dead object could hold a free chunk */
+#define SILC_INT_MEM_MIN_OBJECT_SIZE      (2)
+
+/** Returns size of the object being allocated in silc_obj units (including service information) */
+static inline int silc_int_mem_get_alloc_size(int content_length, int type) {
+  int size;
+  switch (type) {
+    case SILC_TYPE_CONS:
+      return 2;
+
+    case SILC_TYPE_OREF:
+      SILC_ASSERT(content_length >= 0);
+      size = silc_int_mem_get_header_size(content_length) + content_length;
+      break;
+
+    case SILC_TYPE_BREF:
+      size = silc_int_mem_get_header_size(content_length) + silc_obj_count_from_byte_count(content_length);
+      break;
+
+    default:
+      SILC_ASSERT(!"Unknown object type");
+      return -1;
+  }
+
+  return size > SILC_INT_MEM_MIN_OBJECT_SIZE ? size : SILC_INT_MEM_MIN_OBJECT_SIZE;
+}
+
+/** Initializes layout of the newly allocated object, see silc_int_mem_alloc */
+static inline void silc_int_mem_init_object(silc_obj* p_layout, int content_length, const void* content, int type,
+                                            int subtype) {
+  switch (type) {
+    case SILC_TYPE_CONS:
+      SILC_ASSERT(content_length == 2 && subtype == SILC_INT_MEM_CONS_SUBTYPE);
+      if (content != NULL) {
+        p_layout[0] = ((silc_obj *) content)[0]; /* car */
+        p_layout[1] = ((silc_obj *) content)[1]; /* cdr */
+      } else {
+        p_layout[0] = SILC_OBJ_NIL;
+        p_layout[1] = SILC_OBJ_NIL;
+      }
+      break;
+
+    case SILC_TYPE_OREF:
+      p_layout += silc_int_mem_init_header(p_layout, subtype, content_length);
+      if (content_length > 0) {
+        if (content != NULL) {
+          memcpy(p_layout, content, content_length * sizeof(silc_obj));
+        } else {
+          memset(p_layout, 0, content_length * sizeof(silc_obj)); /* initializes contents with NILs */
+        }
+      }
+      break;
+
+    case SILC_TYPE_BREF:
+      p_layout += silc_int_mem_init_header(p_layout, subtype, content_length);
+      if (content_length > 0) {
+        if (content != NULL) {
+          memcpy(p_layout, content, content_length);
+        } else {
+          memset(p_layout, 0, content_length); /* initializes contents with zeroes */
+        }
+      }
+      break;
+  }
+}
+
+/**
+ * Returns amount of the heap memory, that is taken by the objects, in silc_obj units.
+ * Inline allocation proceeds until it reaches alloc_limit_index.
+ */
+static inline int silc_int_mem_get_alloc_index(struct silc_mem_t* mem) {
+#ifdef SILC_DIRECT_OBJ
+  return mem->avail_index - mem->free_memory;
+#else
+  return mem->avail_index;
+#endif
+}
+
+#ifdef SILC_DIRECT_OBJ
+/**
+ * Direct mode allocation fast path: takes a free chunk of the exact size or bumps available index.
+ * Returns heap index of the allocated object or -1 if allocation should take the slow path.
+ */
+static inline int silc_int_mem_try_bump_alloc(struct silc_mem_t* mem, int n, int type) {
+  int index = mem->free_heads[n];
+  if (silc_int_mem_get_alloc_index(mem) + n > mem->alloc_limit_index) {
+    return -1;
+  }
+
+  if (index >= 0) {
+    mem->free_heads[n] = SILC_INT_MEM_NEXT_FREE_POS(mem->buf[index]);
+    mem->free_memory -= n;
+  } else if (mem->avail_index + n <= mem->last_pos_index + 1) {
+    index = mem->avail_index;
+    mem->avail_index += n;
+  } else {
+    return -1;
+  }
+
+  if (type == SILC_TYPE_BREF) {
+    SILC_INT_MEM_SET_BIT(mem->bref_bits, index);
+  } else {
+    SILC_INT_MEM_CLEAR_BIT(mem->bref_bits, index);
+  }
+  ++mem->pos_count;
+  return index;
+}
+#else
+/**
+ * Allocation fast path: bumps available index and takes a vacant position.
+ * Returns position of the allocated object or -1 if allocation should take the slow path.
+ */
+static inline int silc_int_mem_try_bump_alloc(struct silc_mem_t* mem, int n, int type) {
+  int new_avail_index = mem->avail_index + n;
+  int pos = mem->free_pos_head;
+  int new_pos_count = pos < 0 ? mem->pos_count + 1 : mem->pos_count;
+  bool young_log_enabled = mem->init->nursery_size > 0;
+
+  if (new_avail_index > mem->alloc_limit_index || new_avail_index > mem->last_pos_index - new_pos_count ||
+      (young_log_enabled && mem->young_pos.count == mem->young_pos.capacity)) {
+    return -1;
+  }
+
+  if (pos < 0) {
+    pos = mem->pos_count;
+    mem->pos_count = new_pos_count;
+  } else {
+    mem->free_pos_head = SILC_INT_MEM_NEXT_FREE_POS(mem->buf[mem->last_pos_index - pos]);
+    --mem->free_pos_count;
+  }
+
+  mem->buf[mem->last_pos_index - pos] = ((silc_obj) mem->avail_index << SILC_INT_MEM_POS_SHIFT) | type;
+  if (young_log_enabled) {
+    mem->young_pos.arr[mem->young_pos.count++] = pos;
+  }
+  mem->avail_index = new_avail_index;
+  return pos;
+}
+#endif
+
+/**
+ * Cons allocation fast path: takes a vacant cell or bumps the count of cells, young cons consumes 2 units
+ * of the inline allocation limit. Returns cell number or -1 if allocation should take the slow path.
+ */
+static inline int silc_int_mem_try_alloc_cons(struct silc_mem_t* mem) {
+  int cell = mem->cons_free_head;
+  bool young_log_enabled = mem->init->nursery_size > 0;
+
+  if (silc_int_mem_get_alloc_index(mem) + 2 > mem->alloc_limit_index) {
+    return -1;
+  }
+
+  if (cell < 0) {
+    if (mem->cons_count == mem->cons_capacity) {
+      return -1;
+    }
+    cell = mem->cons_count++;
+  } else {
+    if (young_log_enabled) {
+      if (mem->young_cells.count == mem->young_cells.capacity) {
+        return -1;
+      }
+      mem->young_cells.arr[mem->young_cells.count++] = cell;
+      SILC_INT_MEM_SET_BIT(mem->cons_young_bits, cell);
+    }
+    mem->cons_free_head = SILC_INT_MEM_NEXT_FREE_POS(mem->cons_buf[2 * cell]);
+    --mem->cons_free_count;
+  }
+
+  mem->alloc_limit_index -= 2;
+  return cell;
+}
+
+/**
+ * Allocates n silc_obj units in the context memory and initializes it if content pointer is not null.
+ * Small objects are allocated inline unless garbage collection is needed, see silc_int_mem_alloc_slow.
+ *
+ * @param mem             Pointer to memory context
+ * @param content_length  Allocated object content length; should always be 2 for CONS objects
+ * @param content         Pointer to silc_obj for CONS and OREF, pointer to char for BREF objects
+ * @param type            Object type, can be SILC_TYPE_OREF, SILC_TYPE_CONS and SILC_TYPE_BREF
+ * @param subtype         Object subtype. Should always be SILC_INT_MEM_CONS_SUBTYPE for CONS objects
+ */
+static inline silc_obj silc_int_mem_alloc(struct silc_mem_t* mem, int content_length, const void* content, int type,
+                                          int subtype) {
+  int n = silc_int_mem_get_alloc_size(content_length, type);
+
+  silc_obj result;
+  if (type == SILC_TYPE_CONS) {
+    int cell = silc_int_mem_try_alloc_cons(mem);
+    if (cell < 0) {
+      return silc_int_mem_alloc_slow(mem, content_length, content, type, subtype);
+    }
+
+    silc_int_mem_init_object(mem->cons_buf + 2 * cell, content_length, content, type, subtype);
+    SILC_INT_MEM_ASSERT_INDEX(cell);
+    result = (((silc_obj) cell) << SILC_INT_TYPE_SHIFT) | type;
+  } else {
+    int pos = n <= SILC_INT_MEM_MAX_INLINE_ALLOC_SIZE ? silc_int_mem_try_bump_alloc(mem, n, type) : -1;
+    if (pos < 0) {
+      return silc_int_mem_alloc_slow(mem, content_length, content, type, subtype);
+    }
+
+#ifdef SILC_DIRECT_OBJ
+    silc_int_mem_init_object(mem->buf + pos, content_length, content, type, subtype);
+#else
+    silc_int_mem_init_object(mem->buf + mem->avail_index - n, content_length, content, type, subtype);
+#endif
+    SILC_INT_MEM_ASSERT_INDEX(pos);
+    result = (((silc_obj) pos) << SILC_INT_TYPE_SHIFT) | type;
+  }
+  silc_int_mem_count_alloc(mem, result, n, type, subtype);
+  return result;
+}
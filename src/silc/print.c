@@ -15,7 +15,7 @@
 #include "silc.h"
 
 static void print_unknown(struct silc_ctx_t* c, silc_obj o, FILE* out) {
-  fprintf(out, "#<Unknown-%X>", o);
+  fprintf(out, "#<Unknown-%llX>", (unsigned long long) o);
 }
 
 static void print_inl(struct silc_ctx_t* c, silc_obj o, FILE* out) {
@@ -41,8 +41,8 @@ static void print_inl(struct silc_ctx_t* c, silc_obj o, FILE* out) {
 
     case SILC_INL_SUBTYPE_INT:
       {
-        int val = silc_obj_to_int(o);
-        fprintf(out, "%d", val);
+        long long val = silc_obj_to_int(o);
+        fprintf(out, "%lld", val);
       }
       break;
 
@@ -103,7 +103,7 @@ static void print_oref(struct silc_ctx_t* c, silc_obj o, FILE* out) {
       break;
 
     case SILC_OREF_FUNCTION_SUBTYPE:
-      fprintf(out, "#<CLOSURE-%X>", o);
+      fprintf(out, "#<CLOSURE-%llX>", (unsigned long long) o);
       break;
 
     default:
@@ -27,7 +27,7 @@ static silc_obj read_obj(struct silc_ctx_t * c, FILE * f);
 /* Helper */
 
 struct read_buf_t {
-  char* buf;
+  silc_obj buf; /* byte buffer, its contents can be moved by garbage collector */
   int len;
   int capacity;
 };
@@ -35,20 +35,26 @@ struct read_buf_t {
 static void add_char(struct silc_ctx_t* c, struct read_buf_t* read_buf, char ch) {
   int pos = read_buf->len;
   int new_len = pos + 1;
+  char* buf = NULL;
   if (new_len > read_buf->capacity) {
     int new_capacity = read_buf->capacity + read_buf->capacity / 2 + 4; /* x * 1.5 + 4 */
+    silc_handle(c, read_buf->buf); /* previous buffer is copied after allocation */
     silc_obj ob = silc_byte_buf(c, new_capacity);
     read_buf->capacity = new_capacity;
-    char* new_buf = NULL;
-    int actual_cap = silc_byte_buf_get(c, ob, &new_buf);
-    SILC_ASSERT(new_buf != NULL && actual_cap == new_capacity);
-    if (read_buf->buf != NULL) {
-      memcpy(new_buf, read_buf->buf, read_buf->len);
+    int actual_cap = silc_byte_buf_get(c, ob, &buf);
+    SILC_ASSERT(buf != NULL && actual_cap == new_capacity);
+    (void) actual_cap;
+    if (read_buf->len > 0) {
+      char* prev_buf = NULL;
+      silc_byte_buf_get(c, read_buf->buf, &prev_buf);
+      memcpy(buf, prev_buf, read_buf->len);
     }
-    read_buf->buf = new_buf;
+    read_buf->buf = ob;
+  } else {
+    silc_byte_buf_get(c, read_buf->buf, &buf);
   }
 
-  read_buf->buf[pos] = ch;
+  buf[pos] = ch;
   read_buf->len = new_len;
 }
 
@@ -104,14 +110,16 @@ static silc_obj read_list(struct silc_ctx_t* c, FILE * f) {
   silc_obj car;
   SILC_CHECKED_SET(car, read_obj(c, f));
 
-  /* take first element and recursively read the rest of this list */
-  return silc_cons(c, car, read_list(c, f));
+  /* take first element and recursively read the rest of this list, that is kept alive while the list is being read */
+  silc_handle(c, car);
+  silc_obj cdr = silc_handle(c, read_list(c, f));
+  return silc_cons(c, car, cdr);
 }
 
 static silc_obj read_number_or_symbol(struct silc_ctx_t* c, FILE * f) {
   int ch = fgetc(f);
   int sign;
-  int absval;
+  silc_fixnum absval;
   bool first_char_met;
 
   /* first character */
@@ -197,7 +205,7 @@ static silc_obj read_symbol_or_special(struct silc_ctx_t * c, FILE * f) {
 }
 
 static silc_obj read_str(struct silc_ctx_t * c, FILE * f) {
-  struct read_buf_t read_buf = {0};
+  struct read_buf_t read_buf = { .buf = SILC_OBJ_NIL };
   bool prev_backslash = false;
 
   for (;;) {
@@ -225,7 +233,7 @@ static silc_obj read_str(struct silc_ctx_t * c, FILE * f) {
   }
 
   /* alloc string from the buffer */
-  return silc_str(c, read_buf.buf, read_buf.len);
+  return silc_str_from_byte_buf(c, read_buf.buf, read_buf.len);
 }
 
 static silc_obj read_obj(struct silc_ctx_t * c, FILE * f) {
@@ -255,7 +263,7 @@ static silc_obj read_obj(struct silc_ctx_t * c, FILE * f) {
   return silc_err_from_code(SILC_ERR_UNEXPECTED_CHARACTER);
 }
 
-silc_obj silc_read(struct silc_ctx_t* c, FILE* f, silc_obj eof) {
+silc_obj silc_int_read(struct silc_ctx_t* c, FILE* f, silc_obj eof) {
   int ch = get_nwc(f);
   if (ch == EOF) {
     return eof;
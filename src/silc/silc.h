@@ -16,6 +16,7 @@
 
 #include <stdio.h>
 #include <limits.h>
+#include <stdbool.h>
 
 #ifdef NDEBUG
 #define SILC_ASSERT(x)      ((void) (x))
@@ -30,7 +31,18 @@ extern "C" {
 
 /* Base declarations */
 
+/**
+ * Object word, SILC_OBJ64 build option turns it into 64-bit word (see configure --obj64), which widens
+ * inline integers to 60 bits and lifts the limit of position indexes.
+ * silc_fixnum is a signed integer type, wide enough to hold any inline integer.
+ */
+#ifdef SILC_OBJ64
+typedef unsigned long long silc_obj;
+typedef long long silc_fixnum;
+#else
 typedef unsigned int silc_obj;
+typedef int silc_fixnum;
+#endif
 
 /**
  * Counts of bits, used to represent object type information.
@@ -94,7 +106,7 @@ typedef unsigned int silc_obj;
 /** Creates inline object along with the type and subtype information */
 #define SILC_MAKE_INL_OBJECT(content, subtype)  (SILC_TYPE_INL | \
                                                 ((subtype) << SILC_INT_TYPE_SHIFT) | \
-                                                ((content) << (SILC_INT_TYPE_SHIFT + SILC_INT_INL_SUBTYPE_SHIFT)))
+                                                ((silc_obj) (content) << (SILC_INT_TYPE_SHIFT + SILC_INT_INL_SUBTYPE_SHIFT)))
 
 /**
  * Total count of bits in the inline object content.
@@ -116,6 +128,8 @@ typedef unsigned int silc_obj;
 #define SILC_ERR_STACK_ACCESS         (501)
 /* Stack exceeded */
 #define SILC_ERR_STACK_OVERFLOW       (502)
+/* File can not be read or written */
+#define SILC_ERR_IO                   (503)
 
 /* User called function */
 #define SILC_ERR_INVALID_ARGS         (400)
@@ -145,7 +159,7 @@ typedef unsigned int silc_obj;
  */
 const char* silc_err_code_to_str(int code);
 
-#define SILC_MAX_ERR_CODE             ((1<<(SILC_INL_INL_CONTENT_BITS)) - 1)
+#define SILC_MAX_ERR_CODE             ((silc_fixnum) (((silc_obj) 1 << SILC_INL_INL_CONTENT_BITS) - 1))
 
 static inline silc_obj silc_err_from_code(int err_code) {
   SILC_ASSERT(err_code > 0 && err_code < SILC_MAX_ERR_CODE);
@@ -195,11 +209,19 @@ static inline int silc_try_get_err_code(silc_obj obj) {
 #define SILC_OREF_SYMBOL_SUBTYPE      (10)
 #define SILC_OREF_HASHTABLE_SUBTYPE   (20)
 #define SILC_OREF_FUNCTION_SUBTYPE    (21)
+/** Hash tables, that hold either their keys or their values weakly */
+#define SILC_OREF_WEAK_KEY_HASHTABLE_SUBTYPE    (22)
+#define SILC_OREF_WEAK_VALUE_HASHTABLE_SUBTYPE  (23)
+
+/** Weak reference: its only element is not traced by the collector and it is cleared once its target dies */
+#define SILC_OREF_WEAK_REF_SUBTYPE    (30)
 
 /** Service object: stack */
 #define SILC_OREF_STACK_SUBTYPE       (50)
 /** Service object: GC root object */
 #define SILC_OREF_ROOT_VECTOR_SUBTYPE (51)
+/** Service object: associations of the shared symbols, see silc_freeze_context */
+#define SILC_OREF_SYM_ASSOCS_SUBTYPE  (52)
 
 /**
  * Contains length, then sequence of bytes.
@@ -243,26 +265,162 @@ struct silc_funcall_t {
   silc_obj* argv;
 };
 
+/** Context settings, zero fields stand for default values */
+struct silc_ctx_settings_t {
+  /** Initial heap size in bytes */
+  size_t init_heap_size;
+
+  /**
+   * Maximum heap size in bytes, heap grows up to this size when it gets crowded, allocation fails beyond it.
+   * Heap size is the total of the object buffer, the cons region and the large objects.
+   * Heap sizes are clamped to silc_get_max_heap_size()
+   */
+  size_t max_heap_size;
+
+  /** Factor, heap size is multiplied (or divided when heap shrinks) to, should be greater than 1 */
+  double heap_growth_factor;
+
+  /** Non-zero value enables background garbage collection, that runs while context is parked */
+  int background_gc;
+
+  /**
+   * Non-zero value makes heap reserve address space of the maximum heap size by mmap, so that it is resized in place,
+   * backed by the transparent huge pages where available, and its freed pages are returned to the system
+   */
+  int mmap_heap;
+
+  /**
+   * Non-zero value makes full garbage collection copy live objects to the spare heap buffer of the same size
+   * rather than compact them in place, that is faster if most of the allocated objects die young
+   */
+  int semispace_gc;
+
+  /**
+   * Share of the live objects in the heap, used by the time of the full collection, in percent. Non-zero value makes
+   * collection start once the memory, allocated since the previous one, would make heap reach it, given the observed
+   * survival rate of the allocated objects, rather than once the heap is full
+   */
+  int gc_target_occupancy;
+
+  /** Non-zero value enables allocation profile, call stack is sampled once per this many allocated bytes */
+  size_t alloc_sample_interval;
+};
+
 /* Service functions */
 
 struct silc_ctx_t* silc_new_context();
+struct silc_ctx_t* silc_new_context_with_settings(const struct silc_ctx_settings_t* settings);
 void silc_free_context(struct silc_ctx_t* c);
 
+/** Returns the largest heap size in bytes, supported by the build, it is 1G with 32-bit objects */
+size_t silc_get_max_heap_size();
+
+/**
+ * Saves context image, i.e. its heap along with the globals, so that the context could be recreated from it
+ * without evaluating its definitions again. Garbage is collected first. Image is only compatible with the same build.
+ * Returns nil or SILC_ERR_IO error if image can not be written, SILC_ERR_INVALID_ARGS if context shares heap.
+ */
+silc_obj silc_save_image(struct silc_ctx_t* c, const char* file_name);
+
+/**
+ * Creates context from the image, written by silc_save_image. Image file is mapped at once and its heap is copied
+ * to the new context. Returns NULL if image can not be read or it is not compatible with this build.
+ */
+struct silc_ctx_t* silc_new_context_from_image(const char* file_name);
+struct silc_ctx_t* silc_new_context_from_image_with_settings(const char* file_name,
+                                                             const struct silc_ctx_settings_t* settings);
+
+/**
+ * Shared heap: immutable heap of the frozen context, that is shared by the contexts created from it,
+ * so that builtins and definitions of the frozen context are kept once per process.
+ */
+struct silc_shared_t;
+
+/**
+ * Freezes the context, i.e. turns its heap into the shared one, the context is freed. Only the objects, reachable
+ * from the symbols, survive. Shared heap is never collected or written to, so that contexts, created from it,
+ * can be used by different threads. Returns NULL if the context has been created from the shared heap itself.
+ * Context should be frozen outside of the handle scopes.
+ */
+struct silc_shared_t* silc_freeze_context(struct silc_ctx_t* c);
+
+/**
+ * Creates context, that shares the objects of the frozen context: its symbols and their associations as of freezing.
+ * Symbols are associated in the context heap, so that definitions are not seen by the other contexts.
+ * Image of such a context can not be saved.
+ */
+struct silc_ctx_t* silc_new_context_from_shared(struct silc_shared_t* shared);
+struct silc_ctx_t* silc_new_context_from_shared_with_settings(struct silc_shared_t* shared,
+                                                              const struct silc_ctx_settings_t* settings);
+
+/** Frees shared heap, contexts, created from it, should be freed first */
+void silc_free_shared(struct silc_shared_t* shared);
+
+/**
+ * Handle scope, similar to the one of V8. Objects are only kept alive if they are reachable from the globals
+ * or registered as handles, so that intermediate objects should be registered by silc_handle before the next
+ * allocation. Handles are kept in the native stack, closing scope drops every handle, registered since it was opened.
+ */
+struct silc_handle_scope_t {
+  int prev_count;
+};
+
+void silc_open_handle_scope(struct silc_ctx_t* c, struct silc_handle_scope_t* scope);
+
+/** Closes handle scope, scopes should be closed in the reverse order */
+void silc_close_handle_scope(struct silc_ctx_t* c, struct silc_handle_scope_t* scope);
+
+/** Registers the given object in the innermost handle scope and returns it */
+silc_obj silc_handle(struct silc_ctx_t* c, silc_obj o);
+
+/**
+ * Allocation region: objects, allocated while the region is open, are released at once when it is closed,
+ * unless some of them escape it, i.e. they are referenced from the objects allocated before the region
+ * or from the handles registered since it has been opened. Region with escaping objects leaves all of its objects
+ * to the garbage collector, so does the region, that has been interrupted by a collection.
+ * Regions should be closed in the reverse order, fields are internal.
+ */
+struct silc_region_t {
+  struct silc_region_t* prev;
+  bool abandoned;
+  bool escaped; /* reference to the region object has been written to an older object */
+
+  /* allocation state at the time the region has been opened */
+  int avail_index;
+  int pos_limit;
+  int pos_count;
+  int cons_count;
+  int young_pos_count;
+  int alloc_sample_count;
+  int weak_ref_count;
+  int handle_count;
+};
+
+void silc_region_begin(struct silc_ctx_t* c, struct silc_region_t* region);
+
+/**
+ * Closes region, returns true if its objects have been released. Escapes are recorded by the write barrier once
+ * the reference is stored, so the region escapes even if that reference is overwritten before the region is closed.
+ * Escaped region is abandoned rather than promoted: none of its objects, escaping or not, are released, all of them
+ * are left to the garbage collector. Closing takes constant time either way.
+ */
+bool silc_region_end(struct silc_ctx_t* c, struct silc_region_t* region);
+
 
 /* Helper functions */
 
 /** Bit that designates sign in the inline int object (relative to object content) */
-#define SILC_INT_SIGN_BIT             (1<<(SILC_INL_INL_CONTENT_BITS - 1))
-#define SILC_MAX_INT                  (SILC_INT_SIGN_BIT - 1)
+#define SILC_INT_SIGN_BIT             ((silc_obj) 1 << (SILC_INL_INL_CONTENT_BITS - 1))
+#define SILC_MAX_INT                  ((silc_fixnum) (SILC_INT_SIGN_BIT - 1))
 
 /** Sign bit (must be the leftmost bit in an integer) */
-#define SILC_INT_OBJ_SIGN_BIT         (1 << ((sizeof(silc_obj) * CHAR_BIT) - 1))
+#define SILC_INT_OBJ_SIGN_BIT         ((silc_obj) 1 << ((sizeof(silc_obj) * CHAR_BIT) - 1))
 
 /**
  * Tries to convert a given value to an inline object, returns error with code=SILC_ERR_VALUE_OUT_OF_RANGE
  * in case of overflow.
  */
-static inline silc_obj silc_int_to_obj(int val) {
+static inline silc_obj silc_int_to_obj(silc_fixnum val) {
   silc_obj obj = 0;
 
   if (val == 0) {
@@ -278,7 +436,7 @@ static inline silc_obj silc_int_to_obj(int val) {
     obj = val;
   }
 
-  if (obj >= SILC_MAX_INT) {
+  if (obj >= (silc_obj) SILC_MAX_INT) {
     return silc_err_from_code(SILC_ERR_VALUE_OUT_OF_RANGE);
   }
 
@@ -292,22 +450,50 @@ static inline silc_obj silc_int_to_obj(int val) {
   return obj;
 }
 
-static inline int silc_obj_to_int(silc_obj o) {
+static inline silc_fixnum silc_obj_to_int(silc_obj o) {
   SILC_ASSERT((SILC_GET_TYPE(o) == SILC_TYPE_INL) && (SILC_GET_INL_SUBTYPE(o) == SILC_INL_SUBTYPE_INT));
 
-  int val = SILC_GET_INL_CONTENT(o);
-  if (val & SILC_INT_SIGN_BIT) {
+  silc_obj content = SILC_GET_INL_CONTENT(o);
+  if (content & SILC_INT_SIGN_BIT) {
     /* negative */
-    val = val & (~SILC_INT_SIGN_BIT);
-    val = -val;
+    return -(silc_fixnum) (content & (~SILC_INT_SIGN_BIT));
   }
 
-  return val;
+  return (silc_fixnum) content;
 }
 
 /** Triggers manual garbage collection. */
 void silc_gc(struct silc_ctx_t* c);
 
+/**
+ * Collects garbage if it pays off, e.g. while context waits for the next request, so that the allocations, that
+ * follow, do not pause for collection. Returns non-zero value if garbage has been collected.
+ */
+int silc_gc_hint(struct silc_ctx_t* c);
+
+/**
+ * Returns cumulative GC statistics as an association list: collection counts, pause times and histogram,
+ * reclaimed and moved memory, allocations per object type and subtype.
+ */
+silc_obj silc_gc_stats(struct silc_ctx_t* c);
+
+/**
+ * Writes allocation profile as folded stacks, i.e. lines of semicolon-separated frames followed by the amount of bytes,
+ * that can be turned into a flame graph. Retained profile only counts sampled objects, that are still alive,
+ * so it is precise right after the full collection. Returns count of the written stacks, it is 0 if allocation
+ * sampling is disabled, see silc_ctx_settings_t.alloc_sample_interval.
+ */
+int silc_write_alloc_profile(struct silc_ctx_t* c, FILE* out, int retained);
+
+/**
+ * Parks context while it is idle (e.g. waits for user input), so that background collector could compact its heap.
+ * Context must not be used and objects, obtained from it, must not be dereferenced until it is unparked.
+ */
+void silc_park(struct silc_ctx_t* c);
+
+/** Unparks context, that has been parked by silc_park */
+void silc_unpark(struct silc_ctx_t* c);
+
 /** Tries to load contents of a given file */
 silc_obj silc_load(struct silc_ctx_t* c, const char* file_name);
 
@@ -325,6 +511,20 @@ silc_obj silc_hash_table(struct silc_ctx_t* c, int initial_size);
 silc_obj silc_hash_table_get(struct silc_ctx_t* c, silc_obj hash_table, silc_obj key, silc_obj not_found_val);
 silc_obj silc_hash_table_put(struct silc_ctx_t* c, silc_obj hash_table, silc_obj key, silc_obj value, silc_obj not_found_val);
 
+/**
+ * Creates hash tables, that hold either keys or values weakly: an entry is dropped once its weakly held part is
+ * no longer referenced from elsewhere. Entries are accessed by silc_hash_table_get and silc_hash_table_put.
+ * Inline objects are never collected, so entries with inline keys (values) are never dropped.
+ */
+silc_obj silc_weak_key_hash_table(struct silc_ctx_t* c, int initial_size);
+silc_obj silc_weak_value_hash_table(struct silc_ctx_t* c, int initial_size);
+
+/** Creates weak reference, that does not keep the given object alive */
+silc_obj silc_weak_ref(struct silc_ctx_t* c, silc_obj target);
+
+/** Returns target of the given weak reference or SILC_OBJ_NIL if the target has been collected */
+silc_obj silc_weak_ref_get(struct silc_ctx_t* c, silc_obj weak_ref);
+
 FILE* silc_set_default_out(struct silc_ctx_t * c, FILE* f);
 FILE* silc_get_default_out(struct silc_ctx_t * c);
 
@@ -339,6 +539,8 @@ silc_obj silc_get_sym_info(struct silc_ctx_t* c, silc_obj o, silc_obj* sym_str);
 silc_obj silc_set_sym_assoc(struct silc_ctx_t* c, silc_obj o, silc_obj new_assoc);
 
 silc_obj silc_str(struct silc_ctx_t* c, const char* buf, int size);
+/** Creates string from the first size bytes of the given byte buffer */
+silc_obj silc_str_from_byte_buf(struct silc_ctx_t* c, silc_obj byte_buf, int size);
 int silc_get_str_chars(struct silc_ctx_t* c, silc_obj o, char* buf, int pos, int size);
 
 silc_obj silc_byte_buf(struct silc_ctx_t* c, int byte_len);
@@ -0,0 +1,7 @@
+# Generated file, do not edit
+
+CFLAGS    = -O3
+LFLAGS    =
+
+CFLAGS    += -DNDEBUG
+
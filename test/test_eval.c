@@ -66,6 +66,19 @@ BEGIN_TEST_METHOD(test_eval_inc)
   silc_free_context(c);
 END_TEST_METHOD()
 
+BEGIN_TEST_METHOD(test_eval_wide_int)
+  struct silc_ctx_t* c = silc_new_context();
+#ifdef SILC_OBJ64
+  assert_eval_result(c, "(+ 2000000000 2000000000 (* 3 1000000000))", "7000000000");
+#else
+  /* inline integer is limited by 28 bits */
+  write_and_rewind(out, "(+ 100000000 100000000)");
+  silc_obj result = silc_eval(c, silc_read(c, out, silc_err_from_code(SILC_ERR_UNEXPECTED_EOF)));
+  ASSERT(silc_try_get_err_code(result) == SILC_ERR_VALUE_OUT_OF_RANGE);
+#endif
+  silc_free_context(c);
+END_TEST_METHOD()
+
 BEGIN_TEST_METHOD(test_eval_nested_addition)
   struct silc_ctx_t* c = silc_new_context();
   assert_eval_result(c, "(inc (inc (inc 0)))", "3");
@@ -163,6 +176,179 @@ BEGIN_TEST_METHOD(test_eval_gc)
   silc_free_context(c);
 END_TEST_METHOD()
 
+BEGIN_TEST_METHOD(test_eval_gc_stats)
+  struct silc_ctx_t* c = silc_new_context();
+  silc_gc(c);
+
+  write_and_rewind(out, "(gc-stats)");
+  silc_obj result = not_an_error(silc_eval(c, silc_read(c, out, silc_err_from_code(SILC_ERR_UNEXPECTED_EOF))));
+
+  silc_print(c, result, in);
+  READ_BUF(in, buf);
+  ASSERT(0 == strncmp(buf, "((gc-count . ", 13));
+  ASSERT(NULL != strstr(buf, "(minor-gc-count . "));
+  ASSERT(NULL != strstr(buf, "(pause-histogram "));
+  ASSERT(NULL != strstr(buf, "(alloc-by-type (cons "));
+
+  silc_free_context(c);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_eval_gc_hint)
+  /* new context allocates about 40K, that is more than half of the collection trigger of the 256K heap */
+  struct silc_ctx_settings_t settings = { .init_heap_size = 256 * 1024, .gc_target_occupancy = 50 };
+  struct silc_ctx_t* c = silc_new_context_with_settings(&settings);
+  assert_eval_result(c, "(gc-hint)", "true");
+  silc_free_context(c);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_eval_alloc_profile)
+  /* every allocation is sampled */
+  struct silc_ctx_settings_t settings = { .alloc_sample_interval = 1 };
+  struct silc_ctx_t* c = silc_new_context_with_settings(&settings);
+
+  assert_eval_result(c, "(begin (define pair (lambda (x) (cons x x))) (define kept (pair 1)) (pair 2))", "(2 . 2)");
+  silc_gc(c);
+
+  /* cons takes two object words */
+  char kept_stack[64];
+  char dropped_stack[64];
+  snprintf(kept_stack, sizeof(kept_stack), "silc;begin;define;pair;cons;[cons] %d\n", (int) (2 * sizeof(silc_obj)));
+  snprintf(dropped_stack, sizeof(dropped_stack), "silc;begin;pair;cons;[cons] %d\n", (int) (2 * sizeof(silc_obj)));
+
+  FILE* f = tmpfile();
+  ASSERT(silc_write_alloc_profile(c, f, 0) > 0);
+  READ_BUF(f, allocated);
+  ASSERT(NULL != strstr(allocated, kept_stack));
+  ASSERT(NULL != strstr(allocated, dropped_stack));
+  fclose(f);
+
+  f = tmpfile();
+  ASSERT(silc_write_alloc_profile(c, f, 1) > 0);
+  READ_BUF(f, retained);
+  ASSERT(NULL != strstr(retained, kept_stack));
+  fclose(f);
+
+  silc_free_context(c);
+END_TEST_METHOD()
+
+/* Defines and calls the given count of functions, every one of them allocates cons at its own site */
+static void eval_pair_functions(struct silc_ctx_t* c, int count) {
+  char expr[128];
+  for (int i = 0; i < count; ++i) {
+    snprintf(expr, sizeof(expr), "(begin (define pair%d (lambda (x) (cons x x))) (pair%d %d))", i, i, i);
+    FILE* f = tmpfile();
+    write_and_rewind(f, expr);
+    not_an_error(silc_eval(c, silc_read(c, f, silc_err_from_code(SILC_ERR_UNEXPECTED_EOF))));
+    fclose(f);
+  }
+}
+
+BEGIN_TEST_METHOD(test_eval_alloc_profile_sites)
+  struct silc_ctx_settings_t settings = { .alloc_sample_interval = 1 };
+  struct silc_ctx_t* c = silc_new_context_with_settings(&settings);
+
+  /* sites outgrow the initial site table */
+  eval_pair_functions(c, 300);
+  int site_count = silc_write_alloc_profile(c, out, 0);
+  ASSERT(site_count >= 300);
+
+  /* repeated allocations are attributed to the known sites */
+  eval_pair_functions(c, 300);
+  ASSERT(site_count == silc_write_alloc_profile(c, in, 0));
+
+  silc_free_context(c);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_eval_image)
+  const char* image_file = "target/test_eval.image";
+  struct silc_ctx_t* c = silc_new_context();
+  assert_eval_result(c, "(begin (define base 40) (define add-base (lambda (x) (+ x base))) (add-base 1))", "41");
+  ASSERT(SILC_OBJ_NIL == silc_save_image(c, image_file));
+  silc_free_context(c);
+
+  /* definitions and builtins are available right away */
+  c = silc_new_context_from_image(image_file);
+  ASSERT(c != NULL);
+  fseek(out, 0, SEEK_SET);
+  write_and_rewind(out, "(add-base (inc 1))");
+  silc_obj result = not_an_error(silc_eval(c, silc_read(c, out, silc_err_from_code(SILC_ERR_UNEXPECTED_EOF))));
+  ASSERT(silc_int_to_obj(42) == result);
+  silc_gc(c);
+  silc_free_context(c);
+
+  /* malformed image is rejected */
+  FILE* f = fopen(image_file, "r+b");
+  ASSERT(f != NULL);
+  fputc('X', f);
+  fclose(f);
+  ASSERT(NULL == silc_new_context_from_image(image_file));
+  remove(image_file);
+  ASSERT(NULL == silc_new_context_from_image(image_file));
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_eval_with_region)
+  struct silc_ctx_t* c = silc_new_context();
+  /* escaping objects are kept, so that their cells are not reused by the subsequent allocations */
+  assert_eval_result(c,
+    "(begin\n"
+    "  (with-region (begin (cons 1 2) 3))\n"
+    "  (with-region (define kept (cons 3 4)))\n"
+    "  (define result (with-region (cons 1 2)))\n"
+    "  (cons 5 6)\n"
+    "  (define pair (lambda (x) (cons x x)))\n"
+    "  (cons result kept))",
+    "((1 . 2) 3 . 4)");
+
+  /* temporaries of the lambda call are released, since argument bindings are restored before the region is closed */
+  silc_gc(c); /* region is left to the collector if collection interrupts it, so the young generation is emptied */
+  FILE* f = tmpfile();
+  write_and_rewind(f, "(begin (pair 1) (pair 2) 3)");
+  silc_obj form = silc_read(c, f, silc_err_from_code(SILC_ERR_UNEXPECTED_EOF));
+  fclose(f);
+  struct silc_region_t region;
+  silc_region_begin(c, &region);
+  ASSERT(silc_int_to_obj(3) == silc_eval(c, form));
+  ASSERT(silc_region_end(c, &region));
+
+  silc_free_context(c);
+END_TEST_METHOD()
+
+static silc_obj eval_str(struct silc_ctx_t* c, const char* input) {
+  FILE* f = tmpfile();
+  write_and_rewind(f, input);
+  silc_obj result = silc_eval(c, silc_read(c, f, silc_err_from_code(SILC_ERR_UNEXPECTED_EOF)));
+  fclose(f);
+  return result;
+}
+
+BEGIN_TEST_METHOD(test_eval_shared)
+  struct silc_ctx_t* c = silc_new_context();
+  assert_eval_result(c, "(begin (define base 40) (define add-base (lambda (x) (+ x base))) (add-base 1))", "41");
+  struct silc_shared_t* shared = silc_freeze_context(c);
+  ASSERT(shared != NULL);
+
+  struct silc_ctx_t* c1 = silc_new_context_from_shared(shared);
+  struct silc_ctx_t* c2 = silc_new_context_from_shared(shared);
+  ASSERT(NULL == silc_freeze_context(c1));
+
+  /* shared symbols are associated in the context heaps, so that definitions are not seen by the other contexts */
+  ASSERT(silc_int_to_obj(2) == eval_str(c1, "(begin (define base 1) (define y (cons 1 2)) (add-base 1))"));
+  ASSERT(silc_int_to_obj(42) == eval_str(c2, "(add-base (inc 1))"));
+  silc_gc(c1);
+  silc_gc(c2);
+  ASSERT(silc_int_to_obj(1) == silc_car(c1, eval_str(c1, "y")));
+  ASSERT(silc_int_to_obj(4) == eval_str(c1, "(add-base 3)"));
+  ASSERT(SILC_ERR_UNRESOLVED_SYMBOL == silc_try_get_err_code(eval_str(c2, "y")));
+  ASSERT(silc_int_to_obj(40) == eval_str(c2, "base"));
+
+  /* image would reference the shared heap */
+  ASSERT(SILC_ERR_INVALID_ARGS == silc_try_get_err_code(silc_save_image(c1, "target/test_eval_shared.image")));
+
+  silc_free_context(c1);
+  silc_free_context(c2);
+  silc_free_shared(shared);
+END_TEST_METHOD()
+
 BEGIN_TEST_METHOD(test_eval_nonfunction)
   struct silc_ctx_t* c = silc_new_context();
 
@@ -190,6 +376,7 @@ int main(int argc, char** argv) {
   test_eval_inline();
   test_eval_empty_cons();
   test_eval_inc();
+  test_eval_wide_int();
   test_eval_nested_addition();
   test_eval_define();
   test_eval_begin();
@@ -202,6 +389,13 @@ int main(int argc, char** argv) {
   test_eval_restore_args();
   test_eval_capturing_lexical_context();
   test_eval_gc();
+  test_eval_gc_stats();
+  test_eval_gc_hint();
+  test_eval_alloc_profile();
+  test_eval_alloc_profile_sites();
+  test_eval_image();
+  test_eval_with_region();
+  test_eval_shared();
   test_eval_nonfunction();
   test_eval_unresolved_sym();
   TESTS_SUCCEEDED();
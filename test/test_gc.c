@@ -1,6 +1,8 @@
 #include "test.h"
 #include "mem.h"
 
+#include <setjmp.h>
+
 static void oom_abort(struct silc_mem_init_t* mem_init) {
   fputs(";; " __FILE__ " - out of memory, aborting...\n", stderr);
   abort();
@@ -8,6 +10,28 @@ static void oom_abort(struct silc_mem_init_t* mem_init) {
 
 #define MEM_SIZE          (1024)
 
+/* heap buffer units of the MEM_SIZE heap, a quarter of the initial memory is taken by the cons region */
+#define HEAP_SIZE         (MEM_SIZE - 2 * (MEM_SIZE / 8))
+
+/* full collection strategy of the test heaps, see main */
+static int g_gc_strategy = SILC_MEM_GC_MARK_COMPACT;
+
+/* heap units, taken by the position of an object, there is no position table in the direct mode */
+#ifdef SILC_DIRECT_OBJ
+#define POS_SIZE          (0)
+#else
+#define POS_SIZE          (1)
+#endif
+
+/* collects young generation, the whole heap is collected in the direct mode, that has no generations */
+static void collect_young(struct silc_mem_t* m) {
+#ifdef SILC_DIRECT_OBJ
+  silc_int_mem_gc(m);
+#else
+  silc_int_mem_minor_gc(m);
+#endif
+}
+
 static struct silc_mem_init_t g_mem_init_empty_root_objs = {
   .context = NULL,
   .init_memory_size = MEM_SIZE,
@@ -18,6 +42,142 @@ static struct silc_mem_init_t g_mem_init_empty_root_objs = {
   .free_mem = xfree
 };
 
+static struct silc_mem_init_t g_mem_init_generational = {
+  .context = NULL,
+  .init_memory_size = MEM_SIZE,
+  .max_memory_size = MEM_SIZE,
+  .init_root_vector_size = 10,
+  .nursery_size = MEM_SIZE, /* minor collections are triggered explicitly */
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+static struct silc_mem_init_t g_mem_init_incremental = {
+  .context = NULL,
+  .init_memory_size = MEM_SIZE,
+  .max_memory_size = MEM_SIZE,
+  .init_root_vector_size = 10,
+  .gc_slice_budget = 4,
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+#define LARGE_MEM_SIZE    (1024 * 1024)
+
+static struct silc_mem_init_t g_mem_init_small_mark_stack = {
+  .context = NULL,
+  .init_memory_size = LARGE_MEM_SIZE,
+  .max_memory_size = LARGE_MEM_SIZE,
+  .init_root_vector_size = 10,
+  .nursery_size = LARGE_MEM_SIZE, /* minor collections are triggered explicitly */
+  .max_mark_stack_size = 2,
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+static struct silc_mem_init_t g_mem_init_elastic = {
+  .context = NULL,
+  .init_memory_size = MEM_SIZE,
+  .max_memory_size = 16 * MEM_SIZE,
+  .growth_factor = 2,
+  .init_root_vector_size = 10,
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+static struct silc_mem_init_t g_mem_init_parallel = {
+  .context = NULL,
+  .init_memory_size = LARGE_MEM_SIZE,
+  .max_memory_size = LARGE_MEM_SIZE,
+  .init_root_vector_size = 10,
+  .max_mark_stack_size = 4,
+  .gc_threads = 3,
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+static struct silc_mem_init_t g_mem_init_large_objects = {
+  .context = NULL,
+  .init_memory_size = MEM_SIZE,
+  .max_memory_size = 64 * MEM_SIZE, /* large objects are charged against it */
+  .init_root_vector_size = 10,
+  .nursery_size = MEM_SIZE, /* minor collections are triggered explicitly */
+  .large_object_size = 64,
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+static struct silc_mem_init_t g_mem_init_background = {
+  .context = NULL,
+  .init_memory_size = LARGE_MEM_SIZE,
+  .max_memory_size = LARGE_MEM_SIZE,
+  .init_root_vector_size = 10,
+  .background_gc = true,
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+static struct silc_mem_init_t g_mem_init_paced = {
+  .context = NULL,
+  .init_memory_size = MEM_SIZE,
+  .max_memory_size = MEM_SIZE,
+  .init_root_vector_size = 10,
+  .gc_target_occupancy = 50,
+  .oom_abort = oom_abort,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+static struct silc_mem_gc_event_t g_gc_events[8];
+static int g_gc_event_count;
+
+static void record_gc_event(struct silc_mem_init_t* mem_init, const struct silc_mem_gc_event_t* event) {
+  if (g_gc_event_count < countof(g_gc_events)) {
+    g_gc_events[g_gc_event_count] = *event;
+  }
+  ++g_gc_event_count;
+}
+
+static struct silc_mem_init_t g_mem_init_telemetry = {
+  .context = NULL,
+  .init_memory_size = MEM_SIZE,
+  .max_memory_size = MEM_SIZE,
+  .init_root_vector_size = 10,
+  .nursery_size = MEM_SIZE, /* minor collections are triggered explicitly */
+  .oom_abort = oom_abort,
+  .on_gc_event = record_gc_event,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
+static int g_alloc_sample_count;
+
+/* allocation site is the subtype, subtype 203 is not tracked */
+static int record_alloc_sample(struct silc_mem_init_t* mem_init, silc_obj obj, int type, int subtype, long long bytes) {
+  ++g_alloc_sample_count;
+  return subtype != 203 ? subtype : -1;
+}
+
+static struct silc_mem_init_t g_mem_init_sampling = {
+  .context = NULL,
+  .init_memory_size = MEM_SIZE,
+  .max_memory_size = MEM_SIZE,
+  .init_root_vector_size = 10,
+  .nursery_size = MEM_SIZE, /* minor collections are triggered explicitly */
+  .oom_abort = oom_abort,
+  .alloc_sample_interval = 2 * sizeof(silc_obj),
+  .on_alloc_sample = record_alloc_sample,
+  .alloc_mem = xmalloc,
+  .free_mem = xfree
+};
+
 BEGIN_TEST_METHOD(test_get_initial_statistics)
   struct silc_mem_t mem = {0};
   struct silc_mem_t* m = &mem;
@@ -31,8 +191,11 @@ BEGIN_TEST_METHOD(test_get_initial_statistics)
   silc_int_mem_calc_stats(m, &stats);
 
   ASSERT(MEM_SIZE == stats.total_memory);
+  ASSERT(HEAP_SIZE == stats.heap_memory);
+  ASSERT(MEM_SIZE == stats.heap_memory + 2 * stats.cons_capacity);
 
-  ASSERT((MEM_SIZE - m->init->init_root_vector_size - 5) == stats.free_memory);
+  /* root vector takes the header, capacity and size words along with the entries */
+  ASSERT((HEAP_SIZE - m->init->init_root_vector_size - 3 - POS_SIZE) == stats.free_memory);
   ASSERT(stats.free_memory == stats.usable_memory);
   ASSERT(1 == stats.pos_count);
   ASSERT(0 == stats.free_pos_count);
@@ -136,6 +299,403 @@ BEGIN_TEST_METHOD(test_alloc_bref)
   silc_int_mem_free(m);
 END_TEST_METHOD()
 
+BEGIN_TEST_METHOD(test_object_header)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_empty_root_objs);
+  int content_length;
+
+  /* Test code goes here - subtype and length share the single header word, empty object takes the min size */
+  int alloc_index = silc_int_mem_get_alloc_index(m);
+  silc_obj o = silc_int_mem_alloc(m, 3, NULL, SILC_TYPE_OREF, SILC_INT_MEM_MAX_SUBTYPE);
+  silc_obj s = silc_int_mem_alloc(m, 0, NULL, SILC_TYPE_BREF, 20);
+  ASSERT(alloc_index + 1 + 3 + SILC_INT_MEM_MIN_OBJECT_SIZE == silc_int_mem_get_alloc_index(m));
+  ASSERT(SILC_INT_MEM_MAX_SUBTYPE == silc_int_mem_parse_ref(m, o, &content_length, NULL, NULL));
+  ASSERT(3 == content_length);
+  ASSERT(20 == silc_int_mem_parse_ref(m, s, &content_length, NULL, NULL) && 0 == content_length);
+
+  /* length, that does not fit the header, takes the extra word */
+  silc_obj h[2];
+  int huge = SILC_INT_MEM_HUGE_LENGTH < INT_MAX ? (int) SILC_INT_MEM_HUGE_LENGTH : INT_MAX;
+  int header_size = silc_int_mem_init_header(h, 21, huge);
+  ASSERT((sizeof(silc_obj) == sizeof(int) ? 2 : 1) == header_size);
+  ASSERT(header_size == silc_int_mem_get_header_size(huge) && header_size == silc_int_mem_get_obj_header_size(h));
+  ASSERT(21 == silc_int_mem_get_obj_subtype(h) && huge == silc_int_mem_get_obj_length(h));
+  ASSERT(1 == silc_int_mem_init_header(h, 21, huge - 1) && huge - 1 == silc_int_mem_get_obj_length(h));
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_alloc_fast_path)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_generational);
+  silc_obj* content;
+  int content_length;
+
+  /* Test code goes here - allocate handled objects around the max inline size */
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(m, &scope);
+
+  silc_obj a[SILC_INT_MEM_MAX_INLINE_ALLOC_LENGTH + 2];
+  for (int i = 0; i < countof(a); ++i) {
+    a[i] = silc_int_to_obj(i);
+  }
+
+  silc_obj objs[countof(a) + 1];
+  for (int i = 0; i <= countof(a); ++i) {
+    objs[i] = silc_int_mem_handle(m, silc_int_mem_alloc(m, i, a, SILC_TYPE_OREF, 100 + i));
+  }
+
+  /* every allocated object is logged as young (unless generations are disabled) and handles take no heap space */
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(stats.pos_count == (m->init->nursery_size > 0 ? m->young_pos.count : countof(objs) + 1));
+
+  silc_int_mem_gc(m);
+  for (int i = 0; i <= countof(a); ++i) {
+    ASSERT(100 + i == silc_int_mem_parse_ref(m, objs[i], &content_length, NULL, &content));
+    ASSERT(i == content_length && 0 == memcmp(a, content, content_length * sizeof(silc_obj)));
+  }
+
+  /* objects are released once the scope is closed */
+  silc_int_mem_close_handle_scope(m, &scope);
+  silc_int_mem_gc(m);
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(1 == stats.pos_count - stats.free_pos_count);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_handle_scopes)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  struct silc_mem_init_t init = g_mem_init_empty_root_objs;
+  init.max_memory_size = 2 * MEM_SIZE; /* the cons region grows beyond its initial quarter */
+
+  silc_int_mem_init(m, &init);
+
+  /* Test code goes here - nest scopes, the inner one grows the handle stack */
+  silc_obj a[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  struct silc_handle_scope_t outer;
+  struct silc_handle_scope_t inner;
+  silc_int_mem_open_handle_scope(m, &outer);
+  silc_obj o1 = silc_int_mem_handle(m, silc_int_mem_alloc(m, countof(a), a, SILC_TYPE_OREF, 10));
+
+  silc_int_mem_open_handle_scope(m, &inner);
+  const int inner_count = 300;
+  for (int i = 0; i < inner_count; ++i) {
+    a[1] = silc_int_mem_handle(m, silc_int_mem_alloc(m, countof(a), a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE));
+  }
+  ASSERT(1 + inner_count == m->handle_count);
+
+  silc_int_mem_gc(m);
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(inner_count == stats.cons_count && 2 == stats.pos_count - stats.free_pos_count);
+
+  /* closing inner scope releases inner handles only */
+  silc_int_mem_close_handle_scope(m, &inner);
+  ASSERT(1 == m->handle_count);
+  silc_int_mem_gc(m);
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(0 == stats.cons_count && 2 == stats.pos_count - stats.free_pos_count);
+  ASSERT(10 == silc_int_mem_parse_ref(m, o1, NULL, NULL, NULL));
+
+  /* only the root vector is left */
+  silc_int_mem_close_handle_scope(m, &outer);
+  silc_int_mem_gc(m);
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(1 == stats.pos_count - stats.free_pos_count);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_weak_refs)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_generational);
+
+  /* Test code goes here - weak references to the handled and unreachable objects and to the inline one */
+  silc_obj a[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(m, &scope);
+  silc_obj live = silc_int_mem_handle(m, silc_int_mem_alloc(m, countof(a), a, SILC_TYPE_OREF, 10));
+  silc_obj live_ref = silc_int_mem_handle(m, silc_int_mem_alloc_weak_ref(m, live));
+  silc_obj young_ref = silc_int_mem_handle(m, silc_int_mem_alloc_weak_ref(m,
+      silc_int_mem_alloc(m, countof(a), a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE)));
+  silc_obj inl_ref = silc_int_mem_handle(m, silc_int_mem_alloc_weak_ref(m, silc_int_to_obj(5)));
+
+  /* minor collection clears references to the young objects, weak reference does not keep its target alive */
+  collect_young(m);
+  ASSERT(live == silc_int_mem_get_weak_ref_target(m, live_ref));
+  ASSERT(SILC_OBJ_NIL == silc_int_mem_get_weak_ref_target(m, young_ref));
+  ASSERT(silc_int_to_obj(5) == silc_int_mem_get_weak_ref_target(m, inl_ref));
+  ASSERT(1 == m->weak_refs.count);
+
+  /* old target is cleared by the full collection once it becomes unreachable */
+  silc_int_mem_close_handle_scope(m, &scope);
+  silc_int_mem_handle(m, live_ref);
+  silc_int_mem_minor_gc(m);
+  ASSERT(live == silc_int_mem_get_weak_ref_target(m, live_ref));
+  silc_int_mem_gc(m);
+  ASSERT(SILC_OBJ_NIL == silc_int_mem_get_weak_ref_target(m, live_ref));
+  ASSERT(0 == m->weak_refs.count);
+
+  /* cleanup test objects */
+  silc_int_mem_close_handle_scope(m, &scope);
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+static void store(struct silc_mem_t* m, silc_obj holder, int index, silc_obj value) {
+  silc_get_oref(m, holder, NULL)[index] = value;
+  silc_int_mem_write_barrier(m, holder, value);
+}
+
+BEGIN_TEST_METHOD(test_regions)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_generational);
+
+  /* Test code goes here - garbage below the old holder, that leaves vacant positions and cells */
+  silc_obj garbage = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 301);
+  silc_obj garbage_cons = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  store(m, holder, 0, silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE));
+  silc_int_mem_gc(m);
+  int avail_index = m->avail_index;
+  int pos_count = m->pos_count;
+  int cons_count = m->cons_count;
+
+  /* temporaries are bump allocated and released at once, vacant positions and cells are reused afterwards */
+  struct silc_region_t region;
+  silc_int_mem_begin_region(m, &region);
+  for (int i = 0; i < 10; ++i) {
+    silc_obj o = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 302);
+    ASSERT(o != garbage);
+    silc_obj cons = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    ASSERT(cons != garbage_cons);
+    store(m, o, 0, cons);
+  }
+  ASSERT(silc_int_mem_end_region(m, &region));
+  ASSERT(avail_index == m->avail_index && pos_count == m->pos_count && cons_count == m->cons_count);
+  ASSERT(garbage == silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 303));
+  ASSERT(garbage_cons == silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE));
+  avail_index = m->avail_index;
+  pos_count = m->pos_count;
+
+  /* object, that is referenced from the old holder, escapes the region */
+  silc_int_mem_begin_region(m, &region);
+  silc_obj a[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  silc_obj kept = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  store(m, holder, 0, kept);
+  ASSERT(!silc_int_mem_end_region(m, &region));
+  ASSERT(kept == silc_get_oref(m, holder, NULL)[0]);
+  ASSERT(silc_int_to_obj(1) == silc_parse_cons(m, kept)[0]);
+
+  /* escape is recorded by the write barrier, so overwritten reference makes the object escape as well */
+  silc_int_mem_begin_region(m, &region);
+  store(m, holder, 1, silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 304));
+  store(m, holder, 1, SILC_OBJ_NIL);
+  ASSERT(!silc_int_mem_end_region(m, &region));
+
+  /* handle, that is still registered, makes the object escape, the one of the closed scope does not */
+  struct silc_handle_scope_t inner;
+  silc_int_mem_begin_region(m, &region);
+  silc_int_mem_open_handle_scope(m, &inner);
+  silc_int_mem_handle(m, silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 304));
+  silc_int_mem_close_handle_scope(m, &inner);
+  ASSERT(silc_int_mem_end_region(m, &region));
+
+  struct silc_handle_scope_t scope;
+  silc_int_mem_open_handle_scope(m, &scope);
+  silc_int_mem_begin_region(m, &region);
+  silc_int_mem_handle(m, silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 305));
+  ASSERT(!silc_int_mem_end_region(m, &region));
+  silc_int_mem_close_handle_scope(m, &scope);
+
+  /* nested region is released, though the enclosing one escapes through the write made inside the nested one */
+  struct silc_region_t nested;
+  silc_int_mem_begin_region(m, &region);
+  silc_obj outer = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 306);
+  silc_int_mem_begin_region(m, &nested);
+  store(m, holder, 1, outer);
+  store(m, silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 307), 0, outer);
+  ASSERT(silc_int_mem_end_region(m, &nested));
+  ASSERT(!silc_int_mem_end_region(m, &region));
+  ASSERT(outer == silc_get_oref(m, holder, NULL)[1]);
+
+  /* object, that is written to the enclosing region one, escapes the nested region only */
+  avail_index = m->avail_index;
+  pos_count = m->pos_count;
+  silc_int_mem_begin_region(m, &region);
+  outer = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 306);
+  silc_int_mem_begin_region(m, &nested);
+  store(m, outer, 0, silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 307));
+  ASSERT(!silc_int_mem_end_region(m, &nested));
+  ASSERT(silc_int_mem_end_region(m, &region));
+  ASSERT(avail_index == m->avail_index && pos_count == m->pos_count);
+
+  /* collection abandons the region, so that its objects are left to the collector */
+  silc_int_mem_begin_region(m, &region);
+  silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 308);
+  silc_int_mem_gc(m);
+  store(m, holder, 1, silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 309));
+  ASSERT(!silc_int_mem_end_region(m, &region));
+  ASSERT(region.abandoned && NULL == m->region);
+  ASSERT(309 == silc_int_mem_parse_ref(m, silc_get_oref(m, holder, NULL)[1], NULL, NULL, NULL));
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_heap_image)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_large_objects);
+
+  /* Test code goes here - heap with a large object, cells, weak references and garbage */
+  silc_obj holder = silc_int_mem_alloc(m, 4, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  silc_int_mem_alloc(m, 10, NULL, SILC_TYPE_OREF, 301);
+  silc_obj large = silc_int_mem_alloc(m, 2 * MEM_SIZE, NULL, SILC_TYPE_BREF, 302);
+  strcpy((char*) silc_int_mem_get_ref(m, large, NULL, NULL), "large buffer");
+  silc_get_oref(m, holder, NULL)[0] = large;
+  silc_obj a[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  silc_obj cons = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_get_oref(m, holder, NULL)[1] = cons;
+  silc_get_oref(m, holder, NULL)[2] = silc_int_mem_alloc_weak_ref(m, cons);
+  silc_get_oref(m, holder, NULL)[3] = silc_int_mem_alloc_weak_ref(m,
+      silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE));
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  int large_object_memory = stats.large_object_memory;
+
+  FILE* f = tmpfile();
+  ASSERT(silc_int_mem_save_image(m, f));
+  long size = ftell(f);
+  char* image = xmalloc(size);
+  fseek(f, 0, SEEK_SET);
+  ASSERT(1 == fread(image, size, 1, f));
+  fclose(f);
+  silc_int_mem_free(m);
+
+  /* restored heap keeps positions, so references stay valid */
+  struct silc_mem_init_t init = g_mem_init_large_objects;
+  struct silc_mem_t restored = {0};
+  m = &restored;
+  ASSERT(0 == silc_int_mem_init_from_image(m, &init, image, size - 1));
+
+  /* header fields are ints up to the root vector: version, direct, obj64, obj_size, avail_index, ... */
+  int* header = (int*) image;
+  int obj_size = header[3];
+  header[3] = (int) (sizeof(silc_obj) == 4 ? 8 : 4); /* image of the other object word */
+  ASSERT(0 == silc_int_mem_init_from_image(m, &init, image, size));
+  header[3] = obj_size;
+  int cons_count = header[8];
+  header[8] = INT_MAX / 3; /* cons count, that is not backed by the image */
+  ASSERT(0 == silc_int_mem_init_from_image(m, &init, image, size));
+  header[8] = cons_count;
+  int large_obj_count = header[12];
+  header[12] = INT_MAX;
+  ASSERT(0 == silc_int_mem_init_from_image(m, &init, image, size));
+  header[12] = large_obj_count;
+
+  ASSERT(size == silc_int_mem_init_from_image(m, &init, image, size));
+  xfree(image);
+
+  silc_obj* h = silc_get_oref(m, holder, NULL);
+  ASSERT(large == h[0] && 0 == strcmp("large buffer", (char*) silc_int_mem_get_ref(m, large, NULL, NULL)));
+  ASSERT(0 == memcmp(a, silc_parse_cons(m, h[1]), sizeof(a)));
+  ASSERT(h[1] == silc_int_mem_get_weak_ref_target(m, h[2]));
+  ASSERT(SILC_OBJ_NIL == silc_int_mem_get_weak_ref_target(m, h[3]));
+
+  /* restored heap is collected and allocated from as usual */
+  silc_get_oref(m, holder, NULL)[1] = SILC_OBJ_NIL;
+  silc_int_mem_gc(m);
+  ASSERT(SILC_OBJ_NIL == silc_int_mem_get_weak_ref_target(m, silc_get_oref(m, holder, NULL)[2]));
+  ASSERT(12 == silc_int_mem_parse_ref(m, silc_int_mem_alloc(m, 1, a, SILC_TYPE_OREF, 12), NULL, NULL, NULL));
+
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(large_object_memory == stats.large_object_memory);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_shared_heap)
+  struct silc_mem_t frozen = {0};
+  struct silc_mem_t* f = &frozen;
+
+  struct silc_mem_init_t frozen_init = g_mem_init_large_objects;
+  silc_int_mem_init(f, &frozen_init);
+
+  /* Test code goes here - shared vector references a string, a cell, a large object and itself */
+  silc_obj vec = silc_int_mem_alloc(f, 4, NULL, SILC_TYPE_OREF, 310);
+  silc_int_mem_add_root(f, vec);
+  silc_int_mem_add_root(f, silc_int_mem_alloc(f, 1, NULL, SILC_TYPE_OREF, 311)); /* roots are replaced */
+  silc_obj a[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  store(f, vec, 0, silc_int_mem_alloc(f, 6, "shared", SILC_TYPE_BREF, SILC_BREF_STR_SUBTYPE));
+  store(f, vec, 1, silc_int_mem_alloc(f, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE));
+  store(f, vec, 2, silc_int_mem_alloc(f, 100, NULL, SILC_TYPE_OREF, 312));
+  store(f, vec, 3, vec);
+
+  struct silc_mem_stats_t stats = {0};
+  silc_obj roots[] = { vec, silc_int_to_obj(1) };
+  silc_int_mem_freeze(f, roots, countof(roots));
+  ASSERT(f->frozen && silc_int_mem_is_shared(roots[0]) && silc_int_to_obj(1) == roots[1]);
+  silc_int_mem_calc_stats(f, &stats);
+  ASSERT(stats.total_memory < MEM_SIZE);
+
+  /* sharing heap */
+  struct silc_mem_init_t init = g_mem_init_generational;
+  init.shared = f;
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  silc_int_mem_init(m, &init);
+
+  silc_obj shared = roots[0];
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 313);
+  silc_int_mem_add_root(m, holder);
+  silc_int_mem_gc(m);
+  store(m, holder, 0, shared);
+  store(m, holder, 1, silc_int_mem_alloc_weak_ref(m, shared));
+  silc_int_mem_minor_gc(m);
+  silc_int_mem_gc(m);
+
+  /* shared objects are neither marked nor collected by the sharing heap, weak references to them are kept */
+  silc_obj* h = silc_get_oref(m, holder, NULL);
+  ASSERT(shared == h[0] && shared == silc_int_mem_get_weak_ref_target(m, h[1]) && silc_int_mem_is_marked(m, shared));
+
+  int len = 0;
+  silc_obj* v = silc_get_oref(m, shared, &len);
+  char* str = NULL;
+  ASSERT(4 == len && shared == v[3]);
+  ASSERT(SILC_BREF_STR_SUBTYPE == silc_int_mem_parse_ref(m, v[0], &len, &str, NULL));
+  ASSERT(6 == len && 0 == memcmp("shared", str, 6));
+  ASSERT(silc_int_mem_is_shared(v[1]) && 0 == memcmp(a, silc_parse_cons(m, v[1]), sizeof(a)));
+  ASSERT(312 == silc_int_mem_parse_ref(m, v[2], &len, NULL, NULL) && 100 == len);
+
+  /* image of the sharing heap would reference the shared heap */
+  FILE* image = tmpfile();
+  ASSERT(!silc_int_mem_save_image(m, image));
+  fclose(image);
+
+  /* cleanup test objects, sharing heap is freed first */
+  silc_int_mem_free(m);
+  silc_int_mem_free(f);
+END_TEST_METHOD()
+
 BEGIN_TEST_METHOD(test_gc_full_cleanup)
   struct silc_mem_t mem = {0};
   struct silc_mem_t* m = &mem;
@@ -159,9 +719,10 @@ BEGIN_TEST_METHOD(test_gc_full_cleanup)
 
   silc_int_mem_calc_stats(m, &stats);
 
-  ASSERT(4 == stats.pos_count); /* 3 objects allocated in total + 1 root object */
+  ASSERT(3 == stats.pos_count); /* 2 objects allocated in the heap + 1 root object */
+  ASSERT(1 == stats.cons_count); /* cons takes no position */
   ASSERT(MEM_SIZE == stats.total_memory);
-  ASSERT(stats.total_memory > stats.free_memory);
+  ASSERT(stats.heap_memory > stats.free_memory);
   ASSERT(stats.free_memory == stats.usable_memory);
 
   /* trigger gc and recheck statistics */
@@ -170,8 +731,9 @@ BEGIN_TEST_METHOD(test_gc_full_cleanup)
   silc_int_mem_calc_stats(m, &stats);
   ASSERT(1 == stats.pos_count);
   ASSERT(0 == stats.free_pos_count);
+  ASSERT(0 == stats.cons_count);
   ASSERT(MEM_SIZE == stats.total_memory);
-  ASSERT(stats.total_memory == (stats.free_memory + 5 + m->init->init_root_vector_size));
+  ASSERT(stats.heap_memory == (stats.free_memory + 3 + POS_SIZE + m->init->init_root_vector_size));
   ASSERT(stats.free_memory == stats.usable_memory);
  
   /* cleanup test objects */
@@ -223,9 +785,10 @@ BEGIN_TEST_METHOD(test_gc_partial_cleanup)
 
   silc_int_mem_calc_stats(m, &stats);
 
-  ASSERT(9 == stats.pos_count); /* 8 objects allocated in total + 1 root object */
+  ASSERT(6 == stats.pos_count); /* 5 objects allocated in the heap + 1 root object */
+  ASSERT(3 == stats.cons_count);
   ASSERT(MEM_SIZE == stats.total_memory);
-  ASSERT(stats.total_memory > stats.free_memory);
+  ASSERT(stats.heap_memory > stats.free_memory);
   ASSERT(stats.free_memory == stats.usable_memory);
 
   /* trigger gc and recheck statistics */
@@ -234,8 +797,13 @@ BEGIN_TEST_METHOD(test_gc_partial_cleanup)
   silc_int_mem_gc(m);
 
   silc_int_mem_calc_stats(m, &stats);
-  ASSERT(8 == stats.pos_count);
-  ASSERT(2 == stats.free_pos_count); /* 8-1-2 == 5: o7, o6, o5, o4, o1 should be reachable */
+#ifdef SILC_DIRECT_OBJ
+  ASSERT(4 == stats.pos_count); /* o6, o4, o1 should be reachable */
+#else
+  ASSERT(5 == stats.pos_count);
+  ASSERT(1 == stats.free_pos_count); /* o6, o4, o1 should be reachable */
+#endif
+  ASSERT(2 == stats.cons_count); /* o7, o5 should be reachable */
   ASSERT(MEM_SIZE == stats.total_memory);
 
   silc_obj objs2[] = { o7, o6, o5, o4, o1 };
@@ -253,14 +821,1122 @@ BEGIN_TEST_METHOD(test_gc_partial_cleanup)
 END_TEST_METHOD()
 
 
-int main(int argc, char** argv) {
+BEGIN_TEST_METHOD(test_gc_compaction_preserves_contents)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_empty_root_objs);
+
+  /* Test code goes here - interleave garbage and reachable objects */
+  silc_obj live[8]; /* fits into the initial root vector */
+  for (int i = 0; i < countof(live); ++i) {
+    silc_int_mem_alloc(m, 3, NULL, SILC_TYPE_OREF, 200); /* garbage */
+
+    if (i % 2 == 0) {
+      silc_obj a[] = { silc_int_to_obj(i), silc_int_to_obj(-i) };
+      live[i] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    } else {
+      char a[] = { 'l', 'i', 'v', 'e', (char) ('a' + i) };
+      live[i] = silc_int_mem_alloc(m, sizeof(a), a, SILC_TYPE_BREF, 201);
+    }
+    silc_int_mem_add_root(m, live[i]);
+
+    silc_int_mem_alloc(m, 1, "g", SILC_TYPE_BREF, 202); /* garbage */
+  }
+
+  silc_int_mem_gc(m);
+
+  /* live objects should be moved to the beginning of the heap in their allocation order */
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(stats.pos_count - stats.free_pos_count == countof(live) / 2 + 1); /* live byte refs + root vector */
+  ASSERT(stats.cons_count == countof(live) / 2);
+
+  int prev_index = -1;
+  for (int i = 1; i < countof(live); i += 2) {
+    int obj_index = (int) (silc_int_mem_get_contents(m, live[i]) - m->buf);
+    ASSERT(obj_index > prev_index);
+    prev_index = obj_index;
+
+    silc_obj* obj_content = NULL;
+    char* char_content = NULL;
+    int len = 0;
+    int subtype = silc_int_mem_parse_ref(m, live[i], &len, &char_content, &obj_content);
+    ASSERT(201 == subtype && 5 == len);
+    ASSERT(0 == memcmp("live", char_content, 4) && ('a' + i) == char_content[4]);
+  }
+
+  /* conses are not moved */
+  for (int i = 0; i < countof(live); i += 2) {
+    silc_obj* obj_content = silc_parse_cons(m, live[i]);
+    ASSERT(silc_int_to_obj(i) == obj_content[0] && silc_int_to_obj(-i) == obj_content[1]);
+  }
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_gc_free_pos_reuse)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_empty_root_objs);
+
+  /* Test code goes here - leave holes in the position table */
+  silc_obj objs[6];
+  for (int i = 0; i < countof(objs); ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    objs[i] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_OREF, 301);
+    if (i % 2 == 1) {
+      silc_int_mem_add_root(m, objs[i]);
+    }
+  }
+
+  silc_int_mem_gc(m);
+
+  /* positions are heap indexes in the direct mode, so the dead objects leave free chunks of the same size */
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+#ifdef SILC_DIRECT_OBJ
+  ASSERT(4 == stats.pos_count);
+  ASSERT(3 * 3 == m->free_memory);
+#else
+  ASSERT(7 == stats.pos_count);
+  ASSERT(3 == stats.free_pos_count);
+#endif
+
+  /* vacant positions should be reused in ascending order before the position table grows */
+  for (int i = 0; i < 3; ++i) {
+    silc_obj o = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 301);
+    ASSERT(objs[2 * i] == o);
+  }
+
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(7 == stats.pos_count);
+#ifdef SILC_DIRECT_OBJ
+  ASSERT(0 == m->free_memory);
+#else
+  ASSERT(0 == stats.free_pos_count);
+#endif
+
+  silc_obj o = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 301);
+  ASSERT(o != objs[0] && o != objs[2] && o != objs[4]);
+
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(8 == stats.pos_count);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+#ifdef SILC_DIRECT_OBJ
+BEGIN_TEST_METHOD(test_direct_free_chunks)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_empty_root_objs);
+
+  /* Test code goes here - adjacent garbage objects below the live one */
+  silc_obj garbage = silc_int_mem_alloc(m, 10, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_alloc(m, 10, NULL, SILC_TYPE_OREF, 300);
+  silc_obj live = silc_int_mem_alloc(m, 1, "l", SILC_TYPE_BREF, 301);
+  silc_int_mem_add_root(m, live);
+  int avail_index = m->avail_index;
+
+  /* adjacent gaps make a single chunk, objects stay in place */
+  silc_int_mem_gc(m);
+  ASSERT(avail_index == m->avail_index);
+  ASSERT(2 * 11 == m->free_memory);
+
+  /* chunk is split, so that its remainder is reused */
+  silc_obj o = silc_int_mem_alloc(m, 18, NULL, SILC_TYPE_OREF, 302);
+  ASSERT(garbage == o && 3 == m->free_memory);
+  ASSERT(302 == silc_int_mem_parse_ref(m, o, NULL, NULL, NULL));
+  ASSERT(301 == silc_int_mem_parse_ref(m, live, NULL, NULL, NULL));
+
+  /* chunk, that would leave a single unit, is skipped and the heap top is bumped instead */
+  o = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 303);
+  ASSERT(o != garbage && 3 == m->free_memory);
+  o = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 304);
+  ASSERT(0 == m->free_memory);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+#endif
+
+static bool is_mark_bitmap_clear(struct silc_mem_t* m) {
+  for (int i = 0; i < m->mark_bits_size; ++i) {
+    if (m->mark_bits[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+BEGIN_TEST_METHOD(test_gc_mark_bitmap)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_generational);
+
+  /* Test code goes here - live objects are spread over several bitmap words */
+  silc_obj holder = silc_int_mem_alloc(m, 40, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  for (int i = 0; i < 120; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    silc_obj o = silc_int_mem_alloc(m, 2, a, SILC_TYPE_OREF, 301);
+    if (i % 3 == 0) {
+      silc_get_oref(m, holder, NULL)[i / 3] = o;
+    }
+  }
+
+  /* marks are cleared by the minor collection, position table keeps no mark bits */
+  silc_int_mem_minor_gc(m);
+  ASSERT(is_mark_bitmap_clear(m));
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+#ifndef SILC_DIRECT_OBJ
+  ASSERT(80 == stats.free_pos_count);
+#endif
+
+  /* full collection cuts off trailing vacant positions and keeps the ones between the live objects */
+  silc_get_oref(m, holder, NULL)[39] = SILC_OBJ_NIL;
+  silc_int_mem_gc(m);
+  ASSERT(is_mark_bitmap_clear(m));
+
+  silc_int_mem_calc_stats(m, &stats);
+#ifdef SILC_DIRECT_OBJ
+  ASSERT(2 + 39 == stats.pos_count); /* root vector, holder and the referenced objects */
+#else
+  ASSERT(2 + 3 * 38 + 1 == stats.pos_count);
+  ASSERT(2 * 38 == stats.free_pos_count);
+#endif
+  for (int i = 0; i < 39; ++i) {
+    silc_obj a[] = { silc_int_to_obj(3 * i), SILC_OBJ_NIL };
+    ASSERT(0 == memcmp(a, silc_get_oref(m, silc_get_oref(m, holder, NULL)[i], NULL), sizeof(a)));
+  }
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+#ifndef SILC_DIRECT_OBJ /* objects never move in the direct mode */
+/* Returns heap index of the object, that resides in the heap buffer */
+static int get_heap_index(struct silc_mem_t* m, silc_obj o) {
+  return (int) (silc_int_mem_get_contents(m, o) - m->buf);
+}
+
+BEGIN_TEST_METHOD(test_semispace_gc)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  struct silc_mem_init_t init = g_mem_init_empty_root_objs;
+  init.gc_strategy = SILC_MEM_GC_SEMISPACE;
+  silc_int_mem_init(m, &init);
+
+  /* Test code goes here - holder references [a, "b"], a references cons, whose car is "c", garbage in between */
+  silc_obj str = silc_int_mem_alloc(m, 1, "c", SILC_TYPE_BREF, 200);
+  silc_int_mem_alloc(m, 3, NULL, SILC_TYPE_OREF, 300); /* garbage */
+  silc_obj cons_contents[] = { str, SILC_OBJ_NIL };
+  silc_obj cons = silc_int_mem_alloc(m, 2, cons_contents, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_obj a = silc_int_mem_alloc(m, 1, &cons, SILC_TYPE_OREF, 301);
+  silc_int_mem_alloc(m, 1, "g", SILC_TYPE_BREF, 200); /* garbage */
+  silc_obj holder_contents[] = { a, silc_int_mem_alloc(m, 1, "b", SILC_TYPE_BREF, 200) };
+  silc_obj holder = silc_int_mem_alloc(m, 2, holder_contents, SILC_TYPE_OREF, 302);
+  silc_int_mem_add_root(m, holder);
+  silc_obj* buf = m->buf;
+
+  silc_int_mem_gc(m);
+
+  /* objects are copied breadth-first: root vector, holder, its elements and then the string, reached through cons */
+  ASSERT(NULL != m->to_space && buf == m->to_space);
+  ASSERT(0 == get_heap_index(m, m->root_vector));
+  ASSERT(13 == get_heap_index(m, holder));
+  ASSERT(13 + 3 == get_heap_index(m, a));
+  ASSERT(13 + 3 + 2 == get_heap_index(m, silc_get_oref(m, holder, NULL)[1]));
+  ASSERT(13 + 3 + 2 + 2 == get_heap_index(m, str));
+  ASSERT(13 + 3 + 2 + 2 + 2 == m->avail_index);
+  ASSERT(is_mark_bitmap_clear(m));
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(5 == stats.pos_count - stats.free_pos_count);
+  ASSERT(1 == stats.cons_count);
+
+  /* the next collection copies objects back to the first buffer in the same order */
+  silc_int_mem_gc(m);
+  ASSERT(buf == m->buf);
+  ASSERT(13 + 3 + 2 + 2 == get_heap_index(m, str));
+  silc_obj* t = silc_parse_cons(m, silc_get_oref(m, a, NULL)[0]);
+  int len = 0;
+  char* chars = NULL;
+  ASSERT(200 == silc_int_mem_parse_ref(m, t[0], &len, &chars, NULL));
+  ASSERT(1 == len && 'c' == chars[0]);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+#endif
+
+#ifndef SILC_DIRECT_OBJ /* there are no generations in the direct mode */
+BEGIN_TEST_METHOD(test_minor_gc)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_generational);
+
+  /* Test code goes here - promote holder and the object it references */
+  silc_obj holder = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  silc_obj a1[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  silc_get_oref(m, holder, NULL)[0] = silc_int_mem_alloc(m, 2, a1, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+
+  silc_int_mem_minor_gc(m);
+  ASSERT(m->young_index == m->avail_index && 0 == m->young_pos.count);
+
+  /* old object becomes unreachable, young one is referenced from the old holder only */
+  silc_obj a2[] = { silc_int_to_obj(2), SILC_OBJ_NIL };
+  silc_obj young = silc_int_mem_alloc(m, 2, a2, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_get_oref(m, holder, NULL)[0] = young;
+  silc_int_mem_write_barrier(m, holder, young);
+  silc_int_mem_alloc(m, 2, a2, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* young garbage */
+
+  /* minor collection frees young garbage only */
+  silc_int_mem_minor_gc(m);
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(2 == stats.pos_count);
+  ASSERT(2 == stats.cons_count);
+  ASSERT(young == silc_get_oref(m, holder, NULL)[0]);
+  ASSERT(0 == memcmp(a2, silc_parse_cons(m, young), sizeof(a2)));
+
+  /* full collection frees old garbage */
+  silc_int_mem_gc(m);
+
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(2 == stats.pos_count);
+  ASSERT(1 == stats.cons_count);
+  ASSERT(0 == memcmp(a2, silc_parse_cons(m, young), sizeof(a2)));
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+#endif
+
+BEGIN_TEST_METHOD(test_cons_region)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  struct silc_mem_init_t init = g_mem_init_generational;
+  init.max_memory_size = 2 * MEM_SIZE; /* leaves the budget for the cons region to grow */
+
+  silc_int_mem_init(m, &init);
+
+  /* Test code goes here - old cons references young one, that is written after promotion */
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  silc_obj a1[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  silc_obj old = silc_int_mem_alloc(m, 2, a1, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_get_oref(m, holder, NULL)[0] = old;
+  collect_young(m);
+
+  silc_obj a2[] = { silc_int_to_obj(2), SILC_OBJ_NIL };
+  for (int i = 0; i < 3; ++i) {
+    silc_int_mem_alloc(m, 2, a2, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* young garbage */
+  }
+  silc_obj young = silc_int_mem_alloc(m, 2, a2, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_parse_cons(m, old)[1] = young;
+  silc_int_mem_write_barrier(m, old, young);
+  silc_int_mem_alloc(m, 2, a2, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* young garbage on top */
+
+  /* minor collection frees young cells in place, conses are never moved */
+  collect_young(m);
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(2 == stats.cons_count);
+  ASSERT(3 == m->cons_free_count); /* vacant cell on top is cut off */
+  ASSERT(young == silc_parse_cons(m, old)[1]);
+  ASSERT(0 == memcmp(a2, silc_parse_cons(m, young), sizeof(a2)));
+
+  /* vacant cells are reused before new ones are taken */
+  int cons_count = m->cons_count;
+  silc_obj o = silc_int_mem_alloc(m, 2, a1, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  ASSERT(o != old && o != young && cons_count == m->cons_count);
+
+  /* region grows, when live conses don't fit it, heap stays the same */
+  const int count = 400;
+  ASSERT(count > m->cons_capacity);
+  for (int i = 0; i < count; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), silc_get_oref(m, holder, NULL)[1] };
+    silc_obj head = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    silc_get_oref(m, holder, NULL)[1] = head;
+    silc_int_mem_write_barrier(m, holder, head);
+  }
+
+  silc_int_mem_gc(m);
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(count + 2 == stats.cons_count);
+  ASSERT(stats.cons_capacity >= count + 2);
+  ASSERT(HEAP_SIZE == stats.heap_memory);
+  ASSERT(stats.total_memory == stats.heap_memory + 2 * stats.cons_capacity);
+  ASSERT(stats.total_memory <= 2 * MEM_SIZE);
+
+  silc_obj it = silc_get_oref(m, holder, NULL)[1];
+  for (int i = count - 1; i >= 0; --i) {
+    silc_obj* t = silc_parse_cons(m, it);
+    ASSERT(silc_int_to_obj(i) == t[0]);
+    it = t[1];
+  }
+  ASSERT(SILC_OBJ_NIL == it);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+static bool is_black(struct silc_mem_t* m, silc_obj o) {
+  if (!silc_int_mem_is_marked(m, o)) {
+    return false;
+  }
+
+  for (int i = 0; i < m->mark_stack.count; ++i) {
+    if (m->mark_stack.arr[i] == (int) o) {
+      return false;
+    }
+  }
+  return true;
+}
+
+BEGIN_TEST_METHOD(test_incremental_gc)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_incremental);
+
+  /* Test code goes here - holder references list (1 2 3) */
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  silc_obj list = SILC_OBJ_NIL;
+  for (int i = 3; i > 0; --i) {
+    silc_obj a[] = { silc_int_to_obj(i), list };
+    list = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    silc_get_oref(m, holder, NULL)[0] = list;
+  }
+
+  /* produce garbage, so that several marking cycles are done */
+  int cycles = 0;
+  bool tail_moved = false;
+  for (int i = 0; i < 2000; ++i) {
+    silc_obj a[] = { silc_int_to_obj(i), SILC_OBJ_NIL };
+    bool marking = m->marking;
+    silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    if (marking && !m->marking) {
+      ++cycles;
+    }
+
+    /* once holder is black, move list tail into it, so that the only reference to the tail is in the black object */
+    if (!tail_moved && m->marking && is_black(m, holder)) {
+      silc_obj* head = silc_parse_cons(m, silc_get_oref(m, holder, NULL)[0]);
+      silc_obj tail = head[1];
+      head[1] = SILC_OBJ_NIL;
+      silc_get_oref(m, holder, NULL)[1] = tail;
+      silc_int_mem_write_barrier(m, holder, tail);
+      tail_moved = true;
+    }
+  }
+
+  ASSERT(cycles > 1);
+  ASSERT(tail_moved);
+
+  /* complete the cycle, only holder, root vector and the list must survive */
+  silc_int_mem_gc(m);
+  ASSERT(!m->marking);
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(2 == stats.pos_count - stats.free_pos_count);
+  ASSERT(3 == stats.cons_count);
+
+  silc_obj* head = silc_parse_cons(m, silc_get_oref(m, holder, NULL)[0]);
+  ASSERT(silc_int_to_obj(1) == head[0] && SILC_OBJ_NIL == head[1]);
+  silc_obj* tail = silc_parse_cons(m, silc_get_oref(m, holder, NULL)[1]);
+  ASSERT(silc_int_to_obj(2) == tail[0]);
+  tail = silc_parse_cons(m, tail[1]);
+  ASSERT(silc_int_to_obj(3) == tail[0] && SILC_OBJ_NIL == tail[1]);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_gc_long_list)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_small_mark_stack);
+
+  /* Test code goes here - long list, each element of which references a garbage-interleaved nested list */
+  const int count = 200000;
+  silc_obj holder = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  for (int i = 0; i < count; ++i) {
+    silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* garbage */
+    silc_obj a[] = { silc_int_to_obj(i), silc_get_oref(m, holder, NULL)[0] };
+    silc_obj head = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    silc_get_oref(m, holder, NULL)[0] = head;
+    silc_int_mem_write_barrier(m, holder, head);
+  }
+
+  /* minor collection promotes the list */
+  collect_young(m);
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(2 == stats.pos_count - stats.free_pos_count);
+  ASSERT(count == stats.cons_count);
+
+  /* full collection keeps the list */
+  silc_int_mem_gc(m);
+
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(2 == stats.pos_count - stats.free_pos_count);
+  ASSERT(count == stats.cons_count);
+
+  silc_obj it = silc_get_oref(m, holder, NULL)[0];
+  for (int i = count - 1; i >= 0; --i) {
+    silc_obj* t = silc_parse_cons(m, it);
+    ASSERT(silc_int_to_obj(i) == t[0]);
+    it = t[1];
+  }
+  ASSERT(SILC_OBJ_NIL == it);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_gc_mark_stack_overflow)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_small_mark_stack);
+
+  /* Test code goes here - vector of conses, car of each cons is a vector, i.e. tree, that can't fit mark stack */
+  const int count = 100;
+  silc_obj vec = silc_int_mem_alloc(m, count, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, vec);
+  for (int i = 0; i < count; ++i) {
+    silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* garbage */
+    silc_obj nested = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 300);
+    silc_obj a[] = { nested, silc_int_to_obj(i) };
+    silc_get_oref(m, vec, NULL)[i] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+    silc_get_oref(m, nested, NULL)[0] = silc_int_mem_alloc(m, 1, "a", SILC_TYPE_BREF, 200);
+    ASSERT(m->young_index == 0); /* no collections so far, so the stores above need no write barrier */
+  }
+
+  collect_young(m);
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(2 * count + 2 == stats.pos_count - stats.free_pos_count);
+  ASSERT(count == stats.cons_count);
+  ASSERT(!m->mark_stack_overflow);
+
+  silc_int_mem_gc(m);
+
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(2 * count + 2 == stats.pos_count - stats.free_pos_count);
+  ASSERT(count == stats.cons_count);
+  for (int i = 0; i < count; ++i) {
+    silc_obj* t = silc_parse_cons(m, silc_get_oref(m, vec, NULL)[i]);
+    ASSERT(silc_int_to_obj(i) == t[1]);
+    silc_obj str = silc_get_oref(m, t[0], NULL)[0];
+    int len = 0;
+    char* chars = NULL;
+    ASSERT(200 == silc_int_mem_parse_ref(m, str, &len, &chars, NULL));
+    ASSERT(1 == len && 'a' == chars[0]);
+  }
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+/* Returns true if the reserved heap buffer (if any) stays in place, copier swaps it with the reserved to-space */
+static bool is_heap_in_place(struct silc_mem_t* m, silc_obj* buf) {
+  return buf == NULL || buf == m->buf || buf == m->to_space;
+}
+
+/* Grows heap beyond its initial size and shrinks it back, heap with the reserved address space stays in place */
+static void check_heap_resize(struct silc_mem_init_t* init) {
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, init);
+  silc_obj* buf = m->heap_reserved_size > 0 ? m->buf : NULL;
+
+  /* list of two-element vectors, that doesn't fit initial heap */
+  const int count = 1000;
+  silc_obj holder = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  for (int i = 0; i < count; ++i) {
+    silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 301); /* garbage */
+    silc_obj a[] = { silc_int_to_obj(i), silc_get_oref(m, holder, NULL)[0] };
+    silc_obj head = silc_int_mem_alloc(m, 2, a, SILC_TYPE_OREF, 301);
+    silc_get_oref(m, holder, NULL)[0] = head; /* heap might have been relocated by the allocation */
+  }
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(stats.total_memory > MEM_SIZE && stats.total_memory <= 16 * MEM_SIZE);
+  ASSERT(is_heap_in_place(m, buf));
+
+  silc_obj it = silc_get_oref(m, holder, NULL)[0];
+  for (int i = count - 1; i >= 0; --i) {
+    silc_obj* t = silc_get_oref(m, it, NULL);
+    ASSERT(silc_int_to_obj(i) == t[0]);
+    it = t[1];
+  }
+  ASSERT(SILC_OBJ_NIL == it);
+
+  /* heap stays mostly empty, so it shrinks back to its initial size */
+  silc_get_oref(m, holder, NULL)[0] = SILC_OBJ_NIL;
+  for (int i = 0; i < 20; ++i) {
+    silc_int_mem_gc(m);
+  }
+
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(MEM_SIZE == stats.total_memory);
+  ASSERT(2 == stats.pos_count - stats.free_pos_count);
+  ASSERT(is_heap_in_place(m, buf));
+  ASSERT(SILC_OBJ_NIL == silc_get_oref(m, holder, NULL)[0]);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+}
+
+BEGIN_TEST_METHOD(test_heap_resize)
+  check_heap_resize(&g_mem_init_elastic);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_max_heap_size)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  struct silc_mem_init_t init = g_mem_init_elastic;
+  init.max_memory_size = INT_MAX;
+
+  /* heap size is clamped, so that positions, heap indexes and cells fit the object references */
+  silc_int_mem_init(m, &init);
+  ASSERT(SILC_INT_MEM_MAX_MEMORY_SIZE == init.max_memory_size);
+  ASSERT(MEM_SIZE == init.init_memory_size);
+  ASSERT(0 == ((((silc_obj) SILC_INT_MEM_MAX_MEMORY_SIZE - 1) << SILC_INT_TYPE_SHIFT) & SILC_INT_MEM_SHARED_BIT));
+
+  silc_obj o = silc_int_mem_alloc(m, 1, NULL, SILC_TYPE_OREF, 300);
+  ASSERT(!silc_int_mem_is_shared(o));
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_mmap_heap)
+  struct silc_mem_init_t init = g_mem_init_elastic;
+  init.mmap_heap = true;
+  check_heap_resize(&init);
+END_TEST_METHOD()
+
+/* Creates binary tree of the given depth, every node is interleaved with garbage */
+static silc_obj make_tree(struct silc_mem_t* m, int depth) {
+  silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 301); /* garbage */
+  if (depth == 0) {
+    return silc_int_mem_alloc(m, 1, "l", SILC_TYPE_BREF, 200);
+  }
+
+  silc_obj a[] = { make_tree(m, depth - 1), make_tree(m, depth - 1) };
+  return silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+}
+
+/* Returns count of leaves in the tree */
+static int count_leaves(struct silc_mem_t* m, silc_obj tree) {
+  if (SILC_GET_TYPE(tree) == SILC_TYPE_BREF) {
+    int len = 0;
+    char* chars = NULL;
+    silc_int_mem_parse_ref(m, tree, &len, &chars, NULL);
+    return (1 == len && 'l' == chars[0]) ? 1 : 0;
+  }
+
+  silc_obj* t = silc_parse_cons(m, tree);
+  return count_leaves(m, t[0]) + count_leaves(m, t[1]);
+}
+
+BEGIN_TEST_METHOD(test_parallel_mark)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_parallel);
+
+  /* Test code goes here - trees referenced from the root vector */
+  const int depth = 12;
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  for (int i = 0; i < 2; ++i) {
+    silc_obj tree = make_tree(m, depth);
+    silc_get_oref(m, holder, NULL)[i] = tree;
+  }
+
+  /* repeat collection, so that workers get a chance to race */
+  for (int i = 0; i < 20; ++i) {
+    silc_int_mem_gc(m);
+
+    struct silc_mem_stats_t stats = {0};
+    silc_int_mem_calc_stats(m, &stats);
+    ASSERT(2 * (1 << depth) + 2 == stats.pos_count - stats.free_pos_count); /* leaves + holder + root vector */
+    ASSERT(2 * ((1 << depth) - 1) == stats.cons_count);
+  }
+
+  ASSERT((1 << depth) == count_leaves(m, silc_get_oref(m, holder, NULL)[0]));
+  ASSERT((1 << depth) == count_leaves(m, silc_get_oref(m, holder, NULL)[1]));
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_background_gc)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_background);
+
+  /* Test code goes here - trees interleaved with garbage */
+  const int depth = 14;
+  silc_obj holder = silc_int_mem_alloc(m, 4, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  silc_obj tree = make_tree(m, depth);
+  silc_get_oref(m, holder, NULL)[0] = tree;
+
+  /* unpark right away, so that background collection is interrupted, then keep mutating the heap */
+  silc_int_mem_park(m);
+  silc_int_mem_unpark(m);
+  tree = make_tree(m, depth);
+  silc_get_oref(m, holder, NULL)[1] = tree;
+  silc_int_mem_write_barrier(m, holder, tree);
+
+  /* produce garbage on top of the compacted heap followed by live tree, that has to be moved */
+  silc_int_mem_gc(m);
+  make_tree(m, depth);
+  tree = make_tree(m, depth);
+  silc_get_oref(m, holder, NULL)[2] = tree;
+  silc_int_mem_write_barrier(m, holder, tree);
+  int avail_index = silc_int_mem_get_alloc_index(m);
+
+  int vec_count = 0;
+#ifndef SILC_DIRECT_OBJ /* objects never move in the direct mode, so live object on top keeps the heap size */
+  /* interrupt the collection again and place live object on top of the heap, that might be evacuated meanwhile */
+  silc_int_mem_park(m);
+  silc_int_mem_unpark(m);
+  silc_obj vec = silc_int_mem_alloc(m, 1000, NULL, SILC_TYPE_OREF, 300);
+  silc_get_oref(m, holder, NULL)[3] = vec;
+  silc_int_mem_write_barrier(m, holder, vec);
+  vec_count = 1;
+#endif
+
+  /* let background collector complete its work, it should reclaim all the garbage without leaving holes */
+  silc_int_mem_park(m);
+  ASSERT(silc_int_mem_wait_background_gc(m));
+  silc_int_mem_unpark(m);
+
+  ASSERT(avail_index > silc_int_mem_get_alloc_index(m));
+  avail_index = silc_int_mem_get_alloc_index(m);
+  silc_int_mem_gc(m);
+  ASSERT(avail_index == silc_int_mem_get_alloc_index(m));
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(3 * (1 << depth) + 2 + vec_count == stats.pos_count - stats.free_pos_count);
+  ASSERT(3 * ((1 << depth) - 1) == stats.cons_count);
+  ASSERT((1 << depth) == count_leaves(m, silc_get_oref(m, holder, NULL)[2]));
+  ASSERT((1 << depth) == count_leaves(m, silc_get_oref(m, holder, NULL)[0]));
+  ASSERT((1 << depth) == count_leaves(m, silc_get_oref(m, holder, NULL)[1]));
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+#ifndef SILC_DIRECT_OBJ /* large objects are placed in the heap in the direct mode */
+BEGIN_TEST_METHOD(test_large_objects)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_large_objects);
+
+  /* Test code goes here - large objects are placed outside of the heap, even if they exceed its size */
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  silc_int_mem_alloc(m, 10, NULL, SILC_TYPE_OREF, 301); /* garbage below the large objects */
+
+  silc_obj buf = silc_int_mem_alloc(m, 4 * MEM_SIZE * sizeof(silc_obj), NULL, SILC_TYPE_BREF, 302);
+  silc_get_oref(m, holder, NULL)[0] = buf;
+  char* buf_contents = (char*) silc_int_mem_get_ref(m, buf, NULL, NULL);
+  ASSERT(1 == m->large_obj_count && 0 == (size_t) m->large_objs[0].contents % 4096); /* mapped page aligned */
+  strcpy(buf_contents, "large buffer");
+  silc_int_mem_gc(m); /* otherwise the next large allocation triggers it, since the buffer exceeds the heap size */
+
+  silc_obj a[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  silc_obj young = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_obj content[100] = { young };
+  silc_obj vec = silc_int_mem_alloc(m, countof(content), content, SILC_TYPE_OREF, 303);
+  silc_get_oref(m, holder, NULL)[1] = vec;
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(1 + 4 * MEM_SIZE + 1 + countof(content) == stats.large_object_memory);
+  ASSERT(MEM_SIZE + stats.large_object_memory == stats.total_memory);
+
+  /* young object, referenced from the large one only, survives minor collection */
+  silc_int_mem_minor_gc(m);
+  ASSERT(0 == memcmp(a, silc_parse_cons(m, silc_get_oref(m, vec, NULL)[0]), sizeof(a)));
+
+  /* so does the one, stored with the write barrier */
+  young = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_get_oref(m, vec, NULL)[1] = young;
+  silc_int_mem_write_barrier(m, vec, young);
+  silc_int_mem_minor_gc(m);
+  ASSERT(0 == memcmp(a, silc_parse_cons(m, silc_get_oref(m, vec, NULL)[1]), sizeof(a)));
+
+  /* compaction does not move large objects */
+  silc_int_mem_gc(m);
+  ASSERT(buf_contents == (char*) silc_int_mem_get_ref(m, buf, NULL, NULL));
+  ASSERT(0 == strcmp(buf_contents, "large buffer"));
+
+  /* unreachable large object is released by the full collection, its slot is reused */
+  silc_get_oref(m, holder, NULL)[0] = SILC_OBJ_NIL;
+  silc_int_mem_gc(m);
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(1 + countof(content) == stats.large_object_memory);
+
+  silc_obj vec2 = silc_int_mem_alloc(m, countof(content), NULL, SILC_TYPE_OREF, 304);
+  ASSERT(m->large_obj_count == 2);
+  ASSERT(304 == silc_int_mem_parse_ref(m, vec2, NULL, NULL, NULL));
+  ASSERT(303 == silc_int_mem_parse_ref(m, vec, NULL, NULL, NULL));
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+#endif
+
+static jmp_buf g_oom_jmp;
+
+/* returns to the test, that has caught out of memory error by setjmp */
+static void oom_longjmp(struct silc_mem_init_t* mem_init) {
+  longjmp(g_oom_jmp, 1);
+}
+
+BEGIN_TEST_METHOD(test_max_memory_size)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+  struct silc_mem_init_t init = g_mem_init_large_objects;
+  init.max_memory_size = 4 * MEM_SIZE;
+  init.oom_abort = oom_longjmp;
+
+  silc_int_mem_init(m, &init);
+
+  /* Test code goes here - large objects take half of the budget, they are placed in the heap in the direct mode */
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  volatile bool oom = false;
+  if (setjmp(g_oom_jmp) == 0) {
+    for (int i = 0; i < 8; ++i) {
+      silc_obj content[256] = { silc_get_oref(m, holder, NULL)[0] };
+      silc_obj vec = silc_int_mem_alloc(m, countof(content), content, SILC_TYPE_OREF, 301);
+      silc_get_oref(m, holder, NULL)[0] = vec;
+      silc_int_mem_write_barrier(m, holder, vec);
+    }
+  } else {
+    oom = true;
+  }
+  ASSERT(!oom);
+
+  /* live conses take the rest of it, heap buffer gives up its unused part, then allocation fails */
+  volatile int count = 0;
+  if (setjmp(g_oom_jmp) == 0) {
+    for (;;) {
+      silc_obj a[] = { silc_int_to_obj(count), silc_get_oref(m, holder, NULL)[1] };
+      silc_obj head = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+      silc_get_oref(m, holder, NULL)[1] = head;
+      silc_int_mem_write_barrier(m, holder, head);
+      ++count;
+    }
+  } else {
+    oom = true;
+  }
+  ASSERT(oom);
+
+  struct silc_mem_stats_t stats = {0};
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(count == stats.cons_count);
+  ASSERT(stats.total_memory <= 4 * MEM_SIZE);
+  ASSERT(stats.total_memory > 3 * MEM_SIZE);
+
+  /* neither does the object, that is larger than the free memory */
+  oom = false;
+  if (setjmp(g_oom_jmp) == 0) {
+    silc_int_mem_alloc(m, 2 * MEM_SIZE, NULL, SILC_TYPE_OREF, 302);
+  } else {
+    oom = true;
+  }
+  ASSERT(oom);
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(stats.total_memory <= 4 * MEM_SIZE);
+
+  /* unreachable conses give their memory back */
+  oom = false;
+  silc_get_oref(m, holder, NULL)[1] = SILC_OBJ_NIL;
+  if (setjmp(g_oom_jmp) == 0) {
+    silc_int_mem_alloc(m, 256, NULL, SILC_TYPE_OREF, 302);
+  } else {
+    oom = true;
+  }
+  ASSERT(!oom);
+  silc_int_mem_calc_stats(m, &stats);
+  ASSERT(stats.total_memory <= 4 * MEM_SIZE);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_gc_telemetry)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  g_gc_event_count = 0;
+  silc_int_mem_init(m, &g_mem_init_telemetry);
+  const struct silc_mem_gc_counters_t* counters = silc_int_mem_get_gc_counters(m);
+  ASSERT(1 == counters->alloc_by_type[SILC_TYPE_OREF].count); /* root vector */
+
+  /* Test code goes here - young garbage around the live cons */
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  for (int i = 0; i < 3; ++i) {
+    silc_int_mem_alloc(m, 1, "g", SILC_TYPE_BREF, 200); /* garbage */
+  }
+  silc_obj a[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  silc_get_oref(m, holder, NULL)[0] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  for (int i = 0; i < 2; ++i) {
+    silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* garbage */
+  }
+  silc_int_mem_alloc(m, 1, "g", SILC_TYPE_BREF, 5000); /* garbage of the untracked subtype */
+
+  /* allocations are counted per type and subtype */
+  ASSERT(3 == counters->alloc_by_type[SILC_TYPE_CONS].count);
+  ASSERT(3 * 2 * sizeof(silc_obj) == counters->alloc_by_type[SILC_TYPE_CONS].bytes);
+  ASSERT(4 == counters->alloc_by_type[SILC_TYPE_BREF].count);
+  ASSERT(3 == silc_int_mem_get_subtype_alloc_counter(m, 200)->count);
+  ASSERT(3 * 2 * sizeof(silc_obj) == silc_int_mem_get_subtype_alloc_counter(m, 200)->bytes);
+  ASSERT(1 == silc_int_mem_get_subtype_alloc_counter(m, 300)->count);
+  ASSERT(1 == silc_int_mem_get_subtype_alloc_counter(m, -1)->count);
+  ASSERT(silc_int_mem_get_subtype_alloc_counter(m, 5000) == silc_int_mem_get_subtype_alloc_counter(m, -1));
+
+#ifndef SILC_DIRECT_OBJ /* there are neither minor collections nor moves in the direct mode */
+  /* minor collection reports start and end events */
+  silc_int_mem_minor_gc(m);
+  ASSERT(2 == g_gc_event_count);
+  ASSERT(SILC_MEM_GC_MINOR == g_gc_events[0].kind && !g_gc_events[0].end);
+  ASSERT(SILC_MEM_GC_MINOR == g_gc_events[1].kind && g_gc_events[1].end);
+  ASSERT(6 == g_gc_events[1].reclaimed_objects);
+  ASSERT((4 * 2 + 2 * 2) * sizeof(silc_obj) == g_gc_events[1].reclaimed_bytes);
+  ASSERT(0 == g_gc_events[1].moved_bytes);
+  ASSERT(m->pos_count == g_gc_events[1].pos_count);
+
+  /* full collection moves the live string over the garbage, copier moves root vector and holder as well */
+  long long moved_bytes = (g_gc_strategy == SILC_MEM_GC_SEMISPACE ? 13 + 3 + 2 : 2) * (long long) sizeof(silc_obj);
+  silc_int_mem_alloc(m, 1, "g", SILC_TYPE_BREF, 200); /* garbage */
+  silc_obj str = silc_int_mem_alloc(m, 1, "s", SILC_TYPE_BREF, 201);
+  silc_get_oref(m, holder, NULL)[1] = str;
+  silc_int_mem_write_barrier(m, holder, str);
+  silc_int_mem_gc(m);
+  ASSERT(4 == g_gc_event_count);
+  ASSERT(SILC_MEM_GC_FULL == g_gc_events[3].kind && g_gc_events[3].end);
+  ASSERT(1 == g_gc_events[3].reclaimed_objects);
+  ASSERT(moved_bytes == g_gc_events[3].moved_bytes);
+
+  /* cumulative counters */
+  ASSERT(1 == counters->gc_count && 1 == counters->minor_gc_count);
+  ASSERT(7 == counters->reclaimed_objects);
+  ASSERT(moved_bytes == counters->moved_bytes);
+  ASSERT(counters->total_pause_ns == g_gc_events[1].pause_ns + g_gc_events[3].pause_ns);
+  ASSERT(counters->max_pause_ns <= counters->total_pause_ns);
+  long long pauses = 0;
+  for (int i = 0; i < SILC_MEM_PAUSE_HISTOGRAM_SIZE; ++i) {
+    pauses += counters->pause_histogram[i];
+  }
+  ASSERT(2 == pauses);
+#else
+  /* full collection sweeps the garbage in place */
+  silc_int_mem_gc(m);
+  ASSERT(2 == g_gc_event_count);
+  ASSERT(SILC_MEM_GC_FULL == g_gc_events[1].kind && g_gc_events[1].end);
+  ASSERT(6 == g_gc_events[1].reclaimed_objects);
+  ASSERT((4 * 2 + 2 * 2) * sizeof(silc_obj) == g_gc_events[1].reclaimed_bytes);
+  ASSERT(0 == g_gc_events[1].moved_bytes);
+  ASSERT(m->pos_count == g_gc_events[1].pos_count);
+#endif
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_gc_pacing)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  silc_int_mem_init(m, &g_mem_init_paced);
+  const struct silc_mem_gc_counters_t* counters = silc_int_mem_get_gc_counters(m);
+  silc_obj holder = silc_int_mem_alloc(m, 40, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+
+  /* Test code goes here - garbage triggers collection once a quarter of the small heap is allocated */
+  int count = 0;
+  while (counters->gc_count == 0) {
+    silc_int_mem_alloc(m, 1, "g", SILC_TYPE_BREF, 200);
+    ++count;
+  }
+  ASSERT(count * 2 >= MEM_SIZE / 4 - 60 && count * 2 < MEM_SIZE / 2);
+  ASSERT(m->survival_percent < 50 && m->gc_trigger == MEM_SIZE / 4);
+
+  /* survivors make early collection pointless, so it is left to the heap overflow */
+  for (int i = 0; i < 40; ++i) {
+    silc_obj str = silc_int_mem_alloc(m, 1, "s", SILC_TYPE_BREF, 201);
+    silc_get_oref(m, holder, NULL)[i] = str;
+    silc_int_mem_write_barrier(m, holder, str);
+  }
+  silc_int_mem_gc(m);
+  ASSERT(m->survival_percent >= 50 && LLONG_MAX == m->gc_trigger);
+  long long gc_count = counters->gc_count;
+  for (int i = 0; i < 40; ++i) {
+    silc_int_mem_alloc(m, 1, "g", SILC_TYPE_BREF, 200);
+  }
+  ASSERT(gc_count == counters->gc_count);
+
+  /* garbage brings survival rate down, hint collects once half of the allocation trigger is used up */
+  memset(silc_get_oref(m, holder, NULL), 0, 40 * sizeof(silc_obj));
+  silc_int_mem_gc(m);
+  ASSERT(m->survival_percent < 50 && m->gc_trigger < LLONG_MAX);
+  ASSERT(-1 == silc_int_mem_gc_hint(m));
+  gc_count = counters->gc_count;
+  for (int i = 0; 2 * 2 * i < m->gc_trigger; ++i) {
+    silc_int_mem_alloc(m, 1, "g", SILC_TYPE_BREF, 200);
+  }
+  ASSERT(gc_count == counters->gc_count);
+  ASSERT(SILC_MEM_GC_FULL == silc_int_mem_gc_hint(m));
+  ASSERT(gc_count + 1 == counters->gc_count);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+static long long get_sampled_bytes(struct silc_mem_t* m, int site) {
+  int count = 0;
+  const struct silc_mem_alloc_sample_t* samples = silc_int_mem_get_alloc_samples(m, &count);
+  long long bytes = 0;
+  for (int i = 0; i < count; ++i) {
+    bytes += samples[i].site == site ? samples[i].bytes : 0;
+  }
+  return bytes;
+}
+
+BEGIN_TEST_METHOD(test_alloc_sampling)
+  struct silc_mem_t mem = {0};
+  struct silc_mem_t* m = &mem;
+
+  g_alloc_sample_count = 0;
+  silc_int_mem_init(m, &g_mem_init_sampling);
+  int count = 0;
+  silc_int_mem_get_alloc_samples(m, &count);
+  ASSERT(1 == g_alloc_sample_count && 1 == count); /* root vector */
+
+  /* Test code goes here - every cons is sampled, a string stands for the intervals it passes */
+  silc_obj holder = silc_int_mem_alloc(m, 2, NULL, SILC_TYPE_OREF, 300);
+  silc_int_mem_add_root(m, holder);
+  silc_obj a[] = { silc_int_to_obj(1), SILC_OBJ_NIL };
+  silc_get_oref(m, holder, NULL)[0] = silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE);
+  silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* garbage */
+  silc_int_mem_alloc(m, 7 * sizeof(silc_obj), NULL, SILC_TYPE_BREF, 201); /* garbage */
+  silc_int_mem_alloc(m, 2, a, SILC_TYPE_CONS, SILC_INT_MEM_CONS_SUBTYPE); /* garbage */
+  silc_int_mem_alloc(m, 2 * sizeof(silc_obj), NULL, SILC_TYPE_BREF, 203); /* untracked */
+  ASSERT(7 == g_alloc_sample_count);
+  ASSERT(3 * 2 * sizeof(silc_obj) == get_sampled_bytes(m, SILC_INT_MEM_CONS_SUBTYPE));
+  ASSERT(8 * sizeof(silc_obj) == get_sampled_bytes(m, 201));
+
+  /* collections drop samples of the dead objects */
+  collect_young(m);
+  ASSERT(2 * sizeof(silc_obj) == get_sampled_bytes(m, SILC_INT_MEM_CONS_SUBTYPE));
+  ASSERT(0 == get_sampled_bytes(m, 201));
+  ASSERT(4 * sizeof(silc_obj) == get_sampled_bytes(m, 300));
+
+  silc_get_oref(m, holder, NULL)[0] = SILC_OBJ_NIL;
+  silc_int_mem_gc(m);
+  ASSERT(0 == get_sampled_bytes(m, SILC_INT_MEM_CONS_SUBTYPE));
+  ASSERT(4 * sizeof(silc_obj) == get_sampled_bytes(m, 300));
+  silc_int_mem_get_alloc_samples(m, &count);
+  ASSERT(2 == count);
+
+  /* cleanup test objects */
+  silc_int_mem_free(m);
+END_TEST_METHOD()
+
+/* Heap settings of the tests, the suite is run for every collection strategy */
+static struct silc_mem_init_t* g_mem_inits[] = {
+  &g_mem_init_empty_root_objs, &g_mem_init_generational, &g_mem_init_incremental, &g_mem_init_small_mark_stack,
+  &g_mem_init_elastic, &g_mem_init_parallel, &g_mem_init_large_objects, &g_mem_init_background,
+  &g_mem_init_paced, &g_mem_init_telemetry, &g_mem_init_sampling
+};
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--semispace") == 0) {
+    g_gc_strategy = SILC_MEM_GC_SEMISPACE;
+    for (int i = 0; i < countof(g_mem_inits); ++i) {
+      g_mem_inits[i]->gc_strategy = g_gc_strategy;
+    }
+  }
+
   TESTS_STARTED();
   test_get_initial_statistics();
   test_alloc_cons();
   test_alloc_oref();
   test_alloc_bref();
+  test_object_header();
+  test_alloc_fast_path();
+  test_handle_scopes();
+  test_weak_refs();
+  test_regions();
+  test_heap_image();
+  test_shared_heap();
   test_gc_full_cleanup();
   test_gc_partial_cleanup();
+  test_gc_compaction_preserves_contents();
+  test_gc_free_pos_reuse();
+#ifdef SILC_DIRECT_OBJ
+  test_direct_free_chunks();
+#endif
+  test_gc_mark_bitmap();
+#ifndef SILC_DIRECT_OBJ
+  test_semispace_gc();
+  test_minor_gc();
+#endif
+  test_cons_region();
+  test_incremental_gc();
+  test_gc_long_list();
+  test_gc_mark_stack_overflow();
+  test_heap_resize();
+  test_max_heap_size();
+  test_mmap_heap();
+  test_parallel_mark();
+  test_background_gc();
+#ifndef SILC_DIRECT_OBJ
+  test_large_objects();
+#endif
+  test_max_memory_size();
+  test_gc_pacing();
+  test_gc_telemetry();
+  test_alloc_sampling();
   TESTS_SUCCEEDED();
   return 0;
 }
@@ -59,6 +59,27 @@ BEGIN_TEST_METHOD(test_int_conversions)
   ASSERT(-1 == silc_obj_to_int(o));
 END_TEST_METHOD()
 
+BEGIN_TEST_METHOD(test_int_range)
+  silc_obj o;
+
+  /* inline integer takes all the object bits except type, subtype and sign ones */
+  ASSERT(SILC_MAX_INT == (silc_fixnum) (((silc_obj) 1 << (sizeof(silc_obj) * CHAR_BIT - 5)) - 1));
+
+  o = silc_int_to_obj(SILC_MAX_INT - 1);
+  ASSERT(SILC_MAX_INT - 1 == silc_obj_to_int(o));
+
+  o = silc_int_to_obj(1 - SILC_MAX_INT);
+  ASSERT(1 - SILC_MAX_INT == silc_obj_to_int(o));
+
+  o = silc_int_to_obj(SILC_MAX_INT);
+  ASSERT(silc_try_get_err_code(o) == SILC_ERR_VALUE_OUT_OF_RANGE);
+
+#ifdef SILC_OBJ64
+  o = silc_int_to_obj(-5000000000LL);
+  ASSERT(-5000000000LL == silc_obj_to_int(o));
+#endif
+END_TEST_METHOD()
+
 BEGIN_TEST_METHOD(test_inline_errors)
   silc_obj o;
 
@@ -127,6 +148,7 @@ int main(int argc, char** argv) {
   test_inline_object_subtype();
   test_nil_equivalence_to_zero();
   test_int_conversions();
+  test_int_range();
   test_inline_errors();
   test_non_error_object_to_code_conversion();
   test_do_error_op();
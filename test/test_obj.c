@@ -34,7 +34,11 @@ BEGIN_TEST_METHOD(test_sym_create)
   silc_obj o1;
   silc_obj o2;
 
-  o1 = silc_sym_from_buf(c, "s", 1);
+  /* unassociated symbols are held weakly by the symbol table, so keep them alive */
+  struct silc_handle_scope_t scope;
+  silc_open_handle_scope(c, &scope);
+
+  o1 = silc_handle(c, silc_sym_from_buf(c, "s", 1));
   o2 = silc_sym_from_buf(c, "s", 1);
   ASSERT(o1 == o2);
 
@@ -47,7 +51,7 @@ BEGIN_TEST_METHOD(test_sym_create)
   silc_obj syms[16500];
   for (size_t n = 0; n < countof(syms); ++n) {
     size_t sz = (size_t) sprintf(buf, "s%zu", n);
-    syms[n] = silc_sym_from_buf(c, buf, sz);
+    syms[n] = silc_handle(c, silc_sym_from_buf(c, buf, sz));
   }
 
   /* try recreate N symbols - it should result in matching symbols */
@@ -82,6 +86,7 @@ BEGIN_TEST_METHOD(test_sym_create)
     ASSERT(silc_int_to_obj(n) == assoc); /* old assoc should be null */
   }
 
+  silc_close_handle_scope(c, &scope);
   silc_free_context(c);
 END_TEST_METHOD()
 
@@ -111,11 +116,75 @@ BEGIN_TEST_METHOD(test_hash_table_lookup)
   silc_free_context(c);
 END_TEST_METHOD()
 
+BEGIN_TEST_METHOD(test_sym_table_weakness)
+  struct silc_ctx_t* c = silc_new_context();
+
+  struct silc_handle_scope_t scope;
+  silc_open_handle_scope(c, &scope);
+  silc_obj unused = silc_handle(c, silc_weak_ref(c, silc_sym_from_buf(c, "unused-sym", 10)));
+  silc_obj defined_sym = silc_sym_from_buf(c, "defined-sym", 11);
+  silc_set_sym_assoc(c, defined_sym, silc_int_to_obj(1));
+  silc_obj defined = silc_handle(c, silc_weak_ref(c, defined_sym));
+
+  /* symbol without association is collected unless it is referenced from elsewhere */
+  silc_gc(c);
+  ASSERT(SILC_OBJ_NIL == silc_weak_ref_get(c, unused));
+  ASSERT(defined_sym == silc_weak_ref_get(c, defined));
+
+  /* symbol is recreated on demand and associated one is looked up */
+  ASSERT(SILC_GET_TYPE(silc_sym_from_buf(c, "unused-sym", 10)) == SILC_TYPE_OREF);
+  ASSERT(defined_sym == silc_sym_from_buf(c, "defined-sym", 11));
+  ASSERT(silc_int_to_obj(1) == silc_get_sym_info(c, defined_sym, NULL));
+
+  silc_close_handle_scope(c, &scope);
+  silc_free_context(c);
+END_TEST_METHOD()
+
+BEGIN_TEST_METHOD(test_weak_hash_tables)
+  struct silc_ctx_t* c = silc_new_context();
+
+  struct silc_handle_scope_t scope;
+  silc_open_handle_scope(c, &scope);
+  silc_obj weak_keys = silc_handle(c, silc_weak_key_hash_table(c, 4));
+  silc_obj weak_values = silc_handle(c, silc_weak_value_hash_table(c, 4));
+  silc_obj live = silc_handle(c, silc_str(c, "live", 4));
+
+  /* objects of the inner scope become unreachable once it is closed */
+  struct silc_handle_scope_t inner;
+  silc_open_handle_scope(c, &inner);
+  silc_obj dead = silc_handle(c, silc_str(c, "dead", 4));
+  silc_hash_table_put(c, weak_keys, live, silc_int_to_obj(1), SILC_OBJ_NIL);
+  silc_hash_table_put(c, weak_keys, dead, silc_int_to_obj(2), SILC_OBJ_NIL);
+  silc_hash_table_put(c, weak_keys, silc_int_to_obj(3), silc_int_to_obj(3), SILC_OBJ_NIL);
+  silc_hash_table_put(c, weak_values, silc_int_to_obj(1), live, SILC_OBJ_NIL);
+  silc_hash_table_put(c, weak_values, silc_int_to_obj(2), dead, SILC_OBJ_NIL);
+  ASSERT(silc_int_to_obj(2) == silc_hash_table_get(c, weak_keys, dead, SILC_OBJ_FALSE));
+  ASSERT(dead == silc_hash_table_get(c, weak_values, silc_int_to_obj(2), SILC_OBJ_FALSE));
+  silc_close_handle_scope(c, &inner);
+
+  /* entries, whose weakly held parts are unreachable, are dropped, inline keys are never collected */
+  silc_gc(c);
+  ASSERT(silc_int_to_obj(1) == silc_hash_table_get(c, weak_keys, live, SILC_OBJ_FALSE));
+  ASSERT(silc_int_to_obj(3) == silc_hash_table_get(c, weak_keys, silc_int_to_obj(3), SILC_OBJ_FALSE));
+  ASSERT(live == silc_hash_table_get(c, weak_values, silc_int_to_obj(1), SILC_OBJ_FALSE));
+  ASSERT(SILC_OBJ_FALSE == silc_hash_table_get(c, weak_values, silc_int_to_obj(2), SILC_OBJ_FALSE));
+
+  /* dead entry is replaced */
+  ASSERT(SILC_OBJ_NIL == silc_hash_table_put(c, weak_values, silc_int_to_obj(2), live, SILC_OBJ_NIL));
+  ASSERT(live == silc_hash_table_put(c, weak_values, silc_int_to_obj(2), silc_int_to_obj(4), SILC_OBJ_NIL));
+  ASSERT(silc_int_to_obj(4) == silc_hash_table_get(c, weak_values, silc_int_to_obj(2), SILC_OBJ_FALSE));
+
+  silc_close_handle_scope(c, &scope);
+  silc_free_context(c);
+END_TEST_METHOD()
+
 int main(int argc, char** argv) {
   TESTS_STARTED();
   test_object_type();
   test_sym_create();
   test_hash_table_lookup();
+  test_sym_table_weakness();
+  test_weak_hash_tables();
   TESTS_SUCCEEDED();
   return 0;
 }
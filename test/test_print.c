@@ -70,13 +70,17 @@ END_TEST_METHOD()
 
 BEGIN_TEST_METHOD(test_print_cons_primitive)
   struct silc_ctx_t* c = silc_new_context();
+  struct silc_handle_scope_t scope;
+  silc_open_handle_scope(c, &scope);
 
+  /* intermediate conses are registered as handles, since the next allocation may collect them */
   silc_obj cons = silc_cons(c, silc_int_to_obj(1),
-                    silc_cons(c, silc_int_to_obj(2),
-                      silc_cons(c, silc_int_to_obj(3),
-                        SILC_OBJ_NIL)));
+                    silc_handle(c, silc_cons(c, silc_int_to_obj(2),
+                      silc_handle(c, silc_cons(c, silc_int_to_obj(3),
+                        SILC_OBJ_NIL)))));
 
   silc_print(c, cons, out);
+  silc_close_handle_scope(c, &scope);
 
   /* Test contents */
   READ_BUF(out, buf);
@@ -87,14 +91,17 @@ END_TEST_METHOD()
 
 BEGIN_TEST_METHOD(test_print_cons_nested)
   struct silc_ctx_t* c = silc_new_context();
+  struct silc_handle_scope_t scope;
+  silc_open_handle_scope(c, &scope);
 
   silc_obj cons = silc_cons(c, silc_int_to_obj(1),
-                    silc_cons(c, SILC_OBJ_FALSE,
-                      silc_cons(c, SILC_OBJ_NIL,
-                        silc_cons(c, silc_cons(c, SILC_OBJ_TRUE, SILC_OBJ_NIL),
-                          SILC_OBJ_NIL))));
+                    silc_handle(c, silc_cons(c, SILC_OBJ_FALSE,
+                      silc_handle(c, silc_cons(c, SILC_OBJ_NIL,
+                        silc_handle(c, silc_cons(c, silc_handle(c, silc_cons(c, SILC_OBJ_TRUE, SILC_OBJ_NIL)),
+                          SILC_OBJ_NIL)))))));
 
   silc_print(c, cons, out);
+  silc_close_handle_scope(c, &scope);
 
   /* Test contents */
   READ_BUF(out, buf);